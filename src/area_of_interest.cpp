@@ -0,0 +1,155 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "area_of_interest.h"
+#include "outbound_coalescer.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    auto member_less = [](aoi_member const &member, uint64_t connection_id) {
+        return member.connection_id < connection_id;
+    };
+
+    void erase_member(vector<aoi_member> &members, uint64_t connection_id) {
+        auto position = lower_bound(begin(members), end(members), connection_id, member_less);
+        if(position != end(members) && position->connection_id == connection_id) {
+            members.erase(position);
+        }
+    }
+}
+
+area_of_interest::area_of_interest(float cell_size, float max_radius) : _cell_size(cell_size), _max_radius(max_radius), _cells(), _positions() {
+    if(!(cell_size > 0) || !isfinite(cell_size)) {
+        LOG(ERROR) << NAMEOF(area_of_interest::area_of_interest) << " cell_size has to be greater than 0";
+        throw runtime_error("[area_of_interest] cell_size has to be greater than 0");
+    }
+
+    if(!(max_radius >= 0) || !isfinite(max_radius)) {
+        LOG(ERROR) << NAMEOF(area_of_interest::area_of_interest) << " max_radius has to be finite and not negative";
+        throw runtime_error("[area_of_interest] max_radius has to be finite and not negative");
+    }
+}
+
+bool area_of_interest::place(user_connection const &connection, interned_string map, float x, float y) {
+    if(unlikely(map.id() > max_map_id)) {
+        LOG(ERROR) << NAMEOF(area_of_interest::place) << " map " << map.str() << " has an id past " << max_map_id << ", not placing";
+        return false;
+    }
+
+    return place_on(connection, map.id(), x, y);
+}
+
+bool area_of_interest::move(user_connection const &connection, float x, float y) {
+    aoi_position current{};
+    if(!_positions.find(connection.connection_id, current)) {
+        return false;
+    }
+
+    return place_on(connection, current.map_id, x, y);
+}
+
+bool area_of_interest::place_on(user_connection const &connection, uint32_t map_id, float x, float y) {
+    if(!valid_position(x, y)) {
+        LOG(DEBUG) << NAMEOF(area_of_interest::place_on) << " rejecting position " << x << ", " << y << " for connection " << connection.connection_id;
+        return false;
+    }
+
+    auto connection_id = connection.connection_id;
+    auto cell = cell_key(map_id, cell_coordinate(x), cell_coordinate(y));
+
+    aoi_position previous{};
+    bool placed = _positions.find(connection_id, previous);
+
+    if(placed && previous.cell == cell) {
+        _cells.update_fn(cell, [&](vector<aoi_member> &members) {
+            auto position = lower_bound(begin(members), end(members), connection_id, member_less);
+            if(position != end(members) && position->connection_id == connection_id) {
+                position->x = x;
+                position->y = y;
+            }
+        });
+    } else {
+        if(placed) {
+            _cells.erase_fn(previous.cell, [&](vector<aoi_member> &members) {
+                erase_member(members, connection_id);
+                return members.empty();
+            });
+        }
+
+        aoi_member member{connection_id, connection.ws, x, y};
+        _cells.upsert(cell, [&](vector<aoi_member> &members) {
+            members.insert(lower_bound(begin(members), end(members), connection_id, member_less), member);
+        }, vector<aoi_member>{member});
+    }
+
+    aoi_position current{cell, map_id, x, y};
+    _positions.upsert(connection_id, [&](aoi_position &position) {
+        position = current;
+    }, current);
+    return true;
+}
+
+void area_of_interest::remove(uint64_t connection_id) {
+    aoi_position previous{};
+    bool placed = false;
+    _positions.erase_fn(connection_id, [&](aoi_position &position) {
+        previous = position;
+        placed = true;
+        return true;
+    });
+
+    if(!placed) {
+        return;
+    }
+
+    _cells.erase_fn(previous.cell, [&](vector<aoi_member> &members) {
+        erase_member(members, connection_id);
+        return members.empty();
+    });
+}
+
+size_t area_of_interest::broadcast_near(interned_string map, float x, float y, float radius, string const &payload, outbound_class priority) const {
+    return visit_near(map.id(), x, y, radius, [&](aoi_member const &member) {
+        outbound_frames().send(member.connection_id, member.ws, payload, priority);
+    });
+}
+
+bool area_of_interest::valid_position(float x, float y) const noexcept {
+    // checked as floats, casting a coordinate too large for int64_t is undefined
+    auto within = [&](float position) {
+        return isfinite(position) && fabs(floor(position / _cell_size)) <= static_cast<float>(max_cell_coordinate);
+    };
+    return within(x) && within(y);
+}
+
+int64_t area_of_interest::cell_coordinate(float position) const noexcept {
+    return static_cast<int64_t>(floor(position / _cell_size));
+}
+
+uint64_t area_of_interest::cell_key(uint32_t map_id, int64_t cell_x, int64_t cell_y) noexcept {
+    // 24 bits of map id and 20 bits per axis, place() keeps every stored position within those so keys never alias
+    return (static_cast<uint64_t>(map_id) << 40) |
+           ((static_cast<uint64_t>(cell_x) & 0xFFFFF) << 20) |
+           (static_cast<uint64_t>(cell_y) & 0xFFFFF);
+}
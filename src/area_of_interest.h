@@ -0,0 +1,114 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <uWS.h>
+#include <string>
+#include <vector>
+#include <libcuckoo/cuckoohash_map.hh>
+#include "user_connection.h"
+#include "string_interner.h"
+#include "outbound_coalescer.h"
+
+namespace roa {
+    struct aoi_member {
+        uint64_t connection_id;
+        uWS::WebSocket<uWS::SERVER> *ws;
+        float x;
+        float y;
+    };
+
+    // Positions of playing connections in a uniform grid per map, so updates about a spot on a map only go to
+    // the connections near it instead of everyone on the gateway.
+    class area_of_interest {
+    public:
+        // a query never looks further than max_radius, however large the radius it is given
+        explicit area_of_interest(float cell_size, float max_radius);
+
+        // enters the map or moves within it, leaving the cell or map the connection was in before.
+        // false for positions that aren't finite or lie beyond max_cell_coordinate cells from the origin
+        bool place(user_connection const &connection, interned_string map, float x, float y);
+        // moves within the map the connection was placed on, false when it isn't on one or the position is rejected
+        bool move(user_connection const &connection, float x, float y);
+        void remove(uint64_t connection_id);
+
+        // calls fn(member) for every connection on map within radius of (x, y), returns the number of calls
+        template <class F>
+        size_t visit_near(uint32_t map_id, float x, float y, float radius, F &&fn) const {
+            if(!(radius >= 0) || !valid_position(x, y)) {
+                return 0;
+            }
+
+            radius = radius < _max_radius ? radius : _max_radius;
+            size_t visited = 0;
+            float const radius_squared = radius * radius;
+            auto const first_x = clamp_cell(cell_coordinate(x - radius));
+            auto const last_x = clamp_cell(cell_coordinate(x + radius));
+            auto const first_y = clamp_cell(cell_coordinate(y - radius));
+            auto const last_y = clamp_cell(cell_coordinate(y + radius));
+
+            for(auto cell_x = first_x; cell_x <= last_x; cell_x++) {
+                for(auto cell_y = first_y; cell_y <= last_y; cell_y++) {
+                    _cells.find_fn(cell_key(map_id, cell_x, cell_y), [&](std::vector<aoi_member> const &members) {
+                        for(auto const &member : members) {
+                            float const dx = member.x - x;
+                            float const dy = member.y - y;
+                            if(dx * dx + dy * dy <= radius_squared) {
+                                fn(member);
+                                visited++;
+                            }
+                        }
+                    });
+                }
+            }
+
+            return visited;
+        }
+
+        // sends payload to every connection on map within radius of (x, y), returns the number of recipients
+        size_t broadcast_near(interned_string map, float x, float y, float radius, std::string const &payload,
+                              outbound_class priority = CHAT) const;
+
+        // cell coordinates are packed into 20 bits per axis, positions further out are rejected instead of aliasing
+        static constexpr int64_t max_cell_coordinate = (1 << 19) - 1;
+        // map ids are packed into the remaining 24 bits
+        static constexpr uint32_t max_map_id = (1u << 24) - 1;
+
+    private:
+        struct aoi_position {
+            uint64_t cell;
+            uint32_t map_id;
+            float x;
+            float y;
+        };
+
+        bool place_on(user_connection const &connection, uint32_t map_id, float x, float y);
+        bool valid_position(float x, float y) const noexcept;
+        int64_t cell_coordinate(float position) const noexcept;
+        static int64_t clamp_cell(int64_t cell) noexcept {
+            return cell < -max_cell_coordinate ? -max_cell_coordinate : (cell > max_cell_coordinate ? max_cell_coordinate : cell);
+        }
+        static uint64_t cell_key(uint32_t map_id, int64_t cell_x, int64_t cell_y) noexcept;
+
+        float _cell_size;
+        float _max_radius;
+        cuckoohash_map<uint64_t, std::vector<aoi_member>> _cells; // members sorted on connection id
+        cuckoohash_map<uint64_t, aoi_position> _positions;
+    };
+}
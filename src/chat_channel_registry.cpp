@@ -0,0 +1,226 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "chat_channel_registry.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <algorithm>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    auto subscriber_less = [](channel_subscriber const &subscriber, uint64_t connection_id) {
+        return subscriber.connection_id < connection_id;
+    };
+
+    // channel per location name id
+    cuckoohash_map<uint32_t, interned_string> map_channels;
+    cuckoohash_map<uint32_t, interned_string> world_channels;
+
+    interned_string location_channel(cuckoohash_map<uint32_t, interned_string> &channels, char const *prefix, interned_string name) {
+        interned_string channel;
+        if(channels.find(name.id(), channel)) {
+            return channel;
+        }
+
+        channel = routing_names().intern(prefix + name.str());
+        channels.insert(name.id(), channel);
+        return channel;
+    }
+}
+
+chat_channel_registry::chat_channel_registry() : _channels(), _subscriptions(), _connection_locks() {
+
+}
+
+void chat_channel_registry::subscribe(string const &channel, user_connection const &connection) {
+    lock_guard<mutex> lock(connection_lock(connection.connection_id));
+    if(connection.closed.load(memory_order_relaxed)) {
+        LOG(DEBUG) << NAMEOF(chat_channel_registry::subscribe) << " " << connection.connection_id << " disconnected before joining " << channel;
+        return;
+    }
+
+    channel_subscriber subscriber{connection.connection_id, connection.ws};
+    bool added = true;
+
+    // subscribers are kept sorted on connection id for cheap lookups and duplicate checks
+    _channels.upsert(channel, [&](vector<channel_subscriber> &subscribers) {
+        auto position = lower_bound(begin(subscribers), end(subscribers), subscriber.connection_id, subscriber_less);
+        if(position != end(subscribers) && position->connection_id == subscriber.connection_id) {
+            added = false;
+            return;
+        }
+        subscribers.insert(position, subscriber);
+    }, vector<channel_subscriber>{subscriber});
+
+    if(!added) {
+        return;
+    }
+
+    _subscriptions.upsert(connection.connection_id, [&](vector<string> &channels) {
+        channels.push_back(channel);
+    }, vector<string>{channel});
+
+    LOG(DEBUG) << NAMEOF(chat_channel_registry::subscribe) << " " << connection.connection_id << " joined " << channel;
+}
+
+void chat_channel_registry::subscribe_exclusive(string const &channel, user_connection const &connection) {
+    auto prefix_end = channel.find(':');
+    if(prefix_end == string::npos) {
+        subscribe(channel, connection);
+        return;
+    }
+
+    vector<string> previous;
+    _subscriptions.find_fn(connection.connection_id, [&](vector<string> const &channels) {
+        for(auto const &subscribed : channels) {
+            if(subscribed != channel && subscribed.compare(0, prefix_end + 1, channel, 0, prefix_end + 1) == 0) {
+                previous.push_back(subscribed);
+            }
+        }
+    });
+
+    for(auto const &subscribed : previous) {
+        unsubscribe(subscribed, connection.connection_id);
+    }
+
+    subscribe(channel, connection);
+}
+
+void chat_channel_registry::subscribe_logged_in(user_connection const &connection, session_state const &session) {
+    subscribe(all_channel, connection);
+    subscribe(user_channel(session.username), connection);
+    if(session.admin_status == 1) {
+        subscribe(admin_channel, connection);
+    }
+}
+
+void chat_channel_registry::unsubscribe(string const &channel, uint64_t connection_id) {
+    _channels.erase_fn(channel, [&](vector<channel_subscriber> &subscribers) {
+        auto position = lower_bound(begin(subscribers), end(subscribers), connection_id, subscriber_less);
+        if(position != end(subscribers) && position->connection_id == connection_id) {
+            subscribers.erase(position);
+        }
+        return subscribers.empty();
+    });
+
+    _subscriptions.erase_fn(connection_id, [&](vector<string> &channels) {
+        channels.erase(remove(begin(channels), end(channels), channel), end(channels));
+        return channels.empty();
+    });
+}
+
+void chat_channel_registry::unsubscribe_all(user_connection &connection) {
+    auto connection_id = connection.connection_id;
+    lock_guard<mutex> lock(connection_lock(connection_id));
+    connection.closed.store(true, memory_order_relaxed);
+
+    vector<string> channels;
+    _subscriptions.erase_fn(connection_id, [&](vector<string> &subscribed) {
+        channels = move(subscribed);
+        return true;
+    });
+
+    for(auto const &channel : channels) {
+        _channels.erase_fn(channel, [&](vector<channel_subscriber> &subscribers) {
+            auto position = lower_bound(begin(subscribers), end(subscribers), connection_id, subscriber_less);
+            if(position != end(subscribers) && position->connection_id == connection_id) {
+                subscribers.erase(position);
+            }
+            return subscribers.empty();
+        });
+    }
+}
+
+mutex &chat_channel_registry::connection_lock(uint64_t connection_id) {
+    return _connection_locks[connection_id % _connection_locks.size()];
+}
+
+bool chat_channel_registry::is_subscribed(string const &channel, uint64_t connection_id) const {
+    bool subscribed = false;
+    _channels.find_fn(channel, [&](vector<channel_subscriber> const &subscribers) {
+        subscribed = binary_search(begin(subscribers), end(subscribers), channel_subscriber{connection_id, nullptr},
+                                   [](channel_subscriber const &a, channel_subscriber const &b) {
+            return a.connection_id < b.connection_id;
+        });
+    });
+    return subscribed;
+}
+
+size_t chat_channel_registry::broadcast(string const &channel, string const &payload, outbound_class priority) const {
+    size_t sent = 0;
+    _channels.find_fn(channel, [&](vector<channel_subscriber> const &subscribers) {
+        for(auto const &subscriber : subscribers) {
+            outbound_frames().send(subscriber.connection_id, subscriber.ws, payload, priority);
+        }
+        sent = subscribers.size();
+    });
+    return sent;
+}
+
+bool chat_channel_registry::is_channel_target(string_view target) {
+    return target == all_channel || (target.length() > 1 && target[0] == '#');
+}
+
+string chat_channel_registry::channel_from_target(string const &target) {
+    if(target == all_channel) {
+        return target;
+    }
+    return target.substr(1);
+}
+
+void chat_channel_registry::channel_from_target(string_view target, string &out) {
+    if(target == all_channel) {
+        out.assign(target.data(), target.size());
+        return;
+    }
+    out.assign(target.data() + 1, target.size() - 1);
+}
+
+string chat_channel_registry::map_channel(string const &map_name) {
+    return "map:" + map_name;
+}
+
+string chat_channel_registry::world_channel(string const &world_name) {
+    return "world:" + world_name;
+}
+
+interned_string chat_channel_registry::map_channel(interned_string map_name) {
+    return location_channel(map_channels, "map:", map_name);
+}
+
+interned_string chat_channel_registry::world_channel(interned_string world_name) {
+    return location_channel(world_channels, "world:", world_name);
+}
+
+string chat_channel_registry::guild_channel(uint64_t guild_id) {
+    return "guild:" + to_string(guild_id);
+}
+
+string chat_channel_registry::user_channel(string const &username) {
+    return "user:" + username;
+}
+
+void chat_channel_registry::user_channel(string_view username, string &out) {
+    out.assign("user:");
+    out.append(username.data(), username.size());
+}
+
+constexpr char const *chat_channel_registry::all_channel;
+constexpr char const *chat_channel_registry::admin_channel;
@@ -0,0 +1,80 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <uWS.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <libcuckoo/cuckoohash_map.hh>
+#include "user_connection.h"
+#include "outbound_coalescer.h"
+#include "string_interner.h"
+
+namespace roa {
+    struct channel_subscriber {
+        uint64_t connection_id;
+        uWS::WebSocket<uWS::SERVER> *ws;
+    };
+
+    // Subscription sets for chat channels, so a broadcast only touches the connections that joined.
+    // Channels are named "all", "admin", "map:<name>", "world:<name>", "guild:<id>" and "user:<name>".
+    // Clients address a channel by prefixing the chat target with '#', "all" is kept as is for older clients.
+    class chat_channel_registry {
+    public:
+        explicit chat_channel_registry();
+
+        void subscribe(std::string const &channel, user_connection const &connection);
+        // leaves every other channel that starts with the same "<kind>:" prefix, e.g. the previous map
+        void subscribe_exclusive(std::string const &channel, user_connection const &connection);
+        // joins "all", the personal channel used for whispers and "admin" for admins
+        void subscribe_logged_in(user_connection const &connection, session_state const &session);
+        void unsubscribe(std::string const &channel, uint64_t connection_id);
+        // marks the connection closed, subscribes racing the disconnect on another thread are ignored afterwards
+        void unsubscribe_all(user_connection &connection);
+        bool is_subscribed(std::string const &channel, uint64_t connection_id) const;
+        size_t broadcast(std::string const &channel, std::string const &payload, outbound_class priority = CHAT) const;
+
+        static bool is_channel_target(std::string_view target);
+        static std::string channel_from_target(std::string const &target);
+        // write into out, so callers reusing a buffer don't allocate per message, target has to be a channel target
+        static void channel_from_target(std::string_view target, std::string &out);
+        static void user_channel(std::string_view username, std::string &out);
+        static std::string map_channel(std::string const &map_name);
+        static std::string world_channel(std::string const &world_name);
+        // names from location_names(), the channel names are interned in routing_names() the first time they're asked for
+        static interned_string map_channel(interned_string map_name);
+        static interned_string world_channel(interned_string world_name);
+        static std::string guild_channel(uint64_t guild_id);
+        static std::string user_channel(std::string const &username);
+
+        static constexpr char const *all_channel = "all";
+        static constexpr char const *admin_channel = "admin";
+
+    private:
+        std::mutex &connection_lock(uint64_t connection_id);
+
+        cuckoohash_map<std::string, std::vector<channel_subscriber>> _channels;
+        cuckoohash_map<uint64_t, std::vector<std::string>> _subscriptions;
+        // orders a connection's subscribes against its unsubscribe_all, so a subscribe can't leave a freed socket behind
+        std::array<std::mutex, 64> _connection_locks;
+    };
+}
@@ -0,0 +1,79 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compression_dictionary.h"
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    void count_fragments(string_view sample, unordered_map<string_view, size_t> &counts) {
+        size_t start = 0;
+        while(start < sample.size()) {
+            auto end = sample.find(',', start);
+            end = end == string_view::npos ? sample.size() : end + 1;
+            auto fragment = sample.substr(start, end - start);
+            counts[fragment]++;
+
+            // the key on its own as well, values like coordinates differ where the keys repeat
+            auto key_end = fragment.find("\":");
+            if(key_end != string_view::npos && key_end + 2 < fragment.size()) {
+                counts[fragment.substr(0, key_end + 2)]++;
+            }
+            start = end;
+        }
+    }
+}
+
+string roa::build_compression_dictionary(vector<string> const &samples, size_t max_bytes) {
+    unordered_map<string_view, size_t> counts;
+    for(auto const &sample : samples) {
+        count_fragments(sample, counts);
+    }
+
+    // a fragment seen once saves nothing
+    vector<pair<string_view, size_t>> scored;
+    for(auto const &fragment : counts) {
+        if(fragment.second > 1 && fragment.first.size() > 2) {
+            scored.emplace_back(fragment.first, fragment.second * fragment.first.size());
+        }
+    }
+    sort(begin(scored), end(scored), [](pair<string_view, size_t> const &a, pair<string_view, size_t> const &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+
+    vector<string_view> kept;
+    size_t kept_bytes = 0;
+    for(auto const &fragment : scored) {
+        if(kept_bytes + fragment.first.size() > max_bytes) {
+            continue;
+        }
+        kept.push_back(fragment.first);
+        kept_bytes += fragment.first.size();
+    }
+
+    string dictionary;
+    dictionary.reserve(kept_bytes);
+    for(auto fragment = rbegin(kept); fragment != rend(kept); ++fragment) {
+        dictionary.append(fragment->data(), fragment->size());
+    }
+    return dictionary;
+}
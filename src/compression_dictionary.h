@@ -0,0 +1,34 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace roa {
+    // zlib only looks back 32 KiB, a larger dictionary is cut to its end
+    constexpr size_t compression_dictionary_max_bytes = 32 * 1024;
+
+    // Builds a preset dictionary for PRESET_DICTIONARY from sample payloads, one json message per sample.
+    // Samples are cut into fragments after every ',', plus the "key": each fragment starts with. The fragments saving the
+    // most bytes over all samples, count times length, are kept and the best go last, where zlib reaches them cheapest.
+    // tools/build_compression_dictionary.cpp writes the result for COMPRESSION_DICTIONARY_FILE.
+    std::string build_compression_dictionary(std::vector<std::string> const &samples, size_t max_bytes = compression_dictionary_max_bytes);
+}
@@ -26,4 +26,33 @@ struct Config {
     uint32_t server_id;
     std::string connection_string;
     std::string debug_level;
+    std::string resume_token_secret;
+    uint32_t resume_token_ttl_seconds;
+    uint32_t compression_threshold;
+    int32_t compression_level;
+    uint32_t compression_cache_entries;
+    std::string compression_dictionary_file;
+    bool local_chat_delivery;
+    bool kafka_event_loop_consumer;
+    bool kafka_multicast_envelopes;
+    bool kafka_partition_keys;
+    uint32_t kafka_packing_linger_ms;
+    size_t kafka_packing_max_bytes;
+    std::string traffic_capture_file;
+    uint64_t traffic_capture_max_bytes;
+    std::string main_thread_cpus;
+    std::string uws_thread_cpus;
+    std::string consumer_thread_cpus;
+    uint32_t connection_shards;
+    float aoi_cell_size;
+    float aoi_radius;
+    uint32_t position_updates_per_second;
+    uint32_t snapshot_delta_history;
+    uint32_t outbound_flush_interval_ms;
+    uint32_t outbound_control_queue_bytes;
+    uint32_t outbound_chat_queue_bytes;
+    uint32_t outbound_bulk_queue_bytes;
+    uint32_t outbound_bulk_bytes_per_flush;
+    uint32_t serialization_workers;
+    std::string serialization_worker_cpus;
 };
\ No newline at end of file
@@ -0,0 +1,64 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "connection_registry.h"
+#include <easylogging++.h>
+#include <macros.h>
+
+using namespace std;
+using namespace roa;
+
+connection_registry::connection_registry(size_t shard_count) : _shards() {
+    if(shard_count == 0) {
+        LOG(ERROR) << NAMEOF(connection_registry::connection_registry) << " shard_count has to be greater than 0";
+        throw runtime_error("[connection_registry] shard_count has to be greater than 0");
+    }
+
+    _shards.reserve(shard_count);
+    for(size_t i = 0; i < shard_count; i++) {
+        _shards.push_back(make_unique<shard_map>());
+    }
+}
+
+void connection_registry::insert(shared_ptr<user_connection> connection) {
+    auto connection_id = connection->connection_id;
+    shard_for(connection_id).insert(connection_id, move(connection));
+}
+
+shared_ptr<user_connection> connection_registry::find(uint64_t connection_id) const {
+    shared_ptr<user_connection> connection;
+    shard_for(connection_id).find(connection_id, connection);
+    return connection;
+}
+
+shared_ptr<user_connection> connection_registry::erase(uint64_t connection_id) {
+    shared_ptr<user_connection> connection;
+    shard_for(connection_id).erase_fn(connection_id, [&](shared_ptr<user_connection> &erased) {
+        connection = move(erased);
+        return true;
+    });
+    return connection;
+}
+
+size_t connection_registry::size() const {
+    size_t count = 0;
+    for(auto &shard : _shards) {
+        count += shard->size();
+    }
+    return count;
+}
@@ -0,0 +1,66 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <libcuckoo/cuckoohash_map.hh>
+#include "user_connection.h"
+
+namespace roa {
+    // All live connections, keyed on connection id and split over independent shards. The shard follows from the id,
+    // so a lookup or erase only ever touches the locks of one shard and resizing one shard doesn't stall the others.
+    class connection_registry {
+    public:
+        explicit connection_registry(size_t shard_count);
+
+        void insert(std::shared_ptr<user_connection> connection);
+        // empty when the connection is gone, the returned pointer keeps it alive while it's being used
+        std::shared_ptr<user_connection> find(uint64_t connection_id) const;
+        std::shared_ptr<user_connection> erase(uint64_t connection_id);
+        // calls fn with the connection under the shard lock, without taking a reference, false when it's gone
+        template <class F>
+        bool find_fn(uint64_t connection_id, F &&fn) const {
+            return shard_for(connection_id).find_fn(connection_id, [&](std::shared_ptr<user_connection> const &connection) {
+                fn(*connection);
+            });
+        }
+        // Calls fn for every connection, one shard at a time under that shard's locks, so connects and disconnects on
+        // the other shards carry on meanwhile. fn must not call back into the registry.
+        template <class F>
+        void for_each(F &&fn) const {
+            for(auto const &shard : _shards) {
+                auto locked = shard->lock_table();
+                for(auto const &entry : locked) {
+                    fn(*entry.second);
+                }
+            }
+        }
+        size_t size() const;
+
+    private:
+        using shard_map = cuckoohash_map<uint64_t, std::shared_ptr<user_connection>>;
+
+        shard_map &shard_for(uint64_t connection_id) const noexcept {
+            return *_shards[connection_id % _shards.size()];
+        }
+
+        std::vector<std::unique_ptr<shard_map>> _shards;
+    };
+}
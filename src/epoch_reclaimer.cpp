@@ -0,0 +1,176 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "epoch_reclaimer.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    atomic<uint64_t> reclaimer_generations{0};
+
+    // exiting threads only give slots back to reclaimers that still exist
+    mutex &live_reclaimers_mutex() {
+        static mutex live_mutex;
+        return live_mutex;
+    }
+
+    vector<uint64_t> &live_reclaimers() {
+        static vector<uint64_t> live;
+        return live;
+    }
+}
+
+thread_local epoch_reclaimer::thread_slots epoch_reclaimer::_thread_slots;
+
+epoch_reclaimer::thread_slots::~thread_slots() {
+    lock_guard<mutex> lock(live_reclaimers_mutex());
+    auto const &live = live_reclaimers();
+    for(auto const &cached_slot : cached) {
+        if(find(begin(live), end(live), cached_slot.generation) == end(live)) {
+            continue;
+        }
+
+        cached_slot.slot->depth = 0;
+        cached_slot.slot->epoch.store(inactive, memory_order_release);
+        cached_slot.slot->used.store(false, memory_order_release);
+    }
+}
+
+epoch_reclaimer::epoch_reclaimer() : _generation(reclaimer_generations.fetch_add(1, memory_order_relaxed) + 1), _global_epoch(1), _slots(),
+                                     _retired_mutex(), _retired() {
+    for(auto &slot : _slots) {
+        slot.epoch.store(inactive, memory_order_relaxed);
+        slot.used.store(false, memory_order_relaxed);
+        slot.depth = 0;
+    }
+
+    lock_guard<mutex> lock(live_reclaimers_mutex());
+    live_reclaimers().push_back(_generation);
+}
+
+epoch_reclaimer::~epoch_reclaimer() {
+    {
+        lock_guard<mutex> lock(live_reclaimers_mutex());
+        auto &live = live_reclaimers();
+        live.erase(remove(begin(live), end(live), _generation), end(live));
+    }
+
+    for(auto &retired : _retired) {
+        retired.deleter(retired.ptr);
+    }
+}
+
+void epoch_reclaimer::enter() {
+    auto &slot = local_slot();
+    if(slot.depth++ > 0) {
+        return;
+    }
+
+    // seq_cst so a writer scanning the slots either sees us or we see its newly published pointer
+    slot.epoch.store(_global_epoch.load(memory_order_seq_cst), memory_order_seq_cst);
+}
+
+void epoch_reclaimer::exit() {
+    auto &slot = local_slot();
+    if(--slot.depth > 0) {
+        return;
+    }
+
+    slot.epoch.store(inactive, memory_order_release);
+}
+
+void epoch_reclaimer::retire(void *ptr, void (*deleter)(void *)) {
+    {
+        lock_guard<mutex> lock(_retired_mutex);
+        _retired.push_back(retired_ptr{ptr, deleter, _global_epoch.load(memory_order_seq_cst)});
+    }
+    collect();
+}
+
+void epoch_reclaimer::collect() {
+    try_advance();
+
+    vector<retired_ptr> reclaimable;
+    {
+        lock_guard<mutex> lock(_retired_mutex);
+        auto safe_epoch = _global_epoch.load(memory_order_acquire);
+        auto it = partition(begin(_retired), end(_retired), [safe_epoch](retired_ptr const &retired) {
+            return retired.epoch + 2 > safe_epoch;
+        });
+        reclaimable.assign(it, end(_retired));
+        _retired.erase(it, end(_retired));
+    }
+
+    for(auto &retired : reclaimable) {
+        retired.deleter(retired.ptr);
+    }
+}
+
+bool epoch_reclaimer::try_advance() noexcept {
+    auto epoch = _global_epoch.load(memory_order_seq_cst);
+    for(auto &slot : _slots) {
+        if(!slot.used.load(memory_order_acquire)) {
+            continue;
+        }
+
+        auto slot_epoch = slot.epoch.load(memory_order_seq_cst);
+        if(slot_epoch != inactive && slot_epoch != epoch) {
+            return false;
+        }
+    }
+
+    return _global_epoch.compare_exchange_strong(epoch, epoch + 1, memory_order_seq_cst);
+}
+
+epoch_reclaimer::thread_slot &epoch_reclaimer::local_slot() {
+    auto &cached = _thread_slots.cached;
+    for(auto const &cached_slot : cached) {
+        if(likely(cached_slot.owner == this && cached_slot.generation == _generation)) {
+            return *cached_slot.slot;
+        }
+    }
+
+    // drops what is left of an earlier reclaimer at this address
+    cached.erase(remove_if(begin(cached), end(cached), [this](thread_slots::cached_slot const &cached_slot) {
+        return cached_slot.owner == this;
+    }), end(cached));
+
+    for(auto &slot : _slots) {
+        bool expected = false;
+        if(slot.used.compare_exchange_strong(expected, true, memory_order_acq_rel)) {
+            cached.push_back(thread_slots::cached_slot{this, _generation, &slot});
+            return slot;
+        }
+    }
+
+    LOG(ERROR) << NAMEOF(epoch_reclaimer::local_slot) << " more than " << max_threads << " threads registered";
+    throw runtime_error("epoch_reclaimer out of thread slots");
+}
+
+epoch_reclaimer &roa::session_reclaimer() {
+    static epoch_reclaimer reclaimer;
+    return reclaimer;
+}
+
+constexpr size_t epoch_reclaimer::max_threads;
+constexpr uint64_t epoch_reclaimer::inactive;
@@ -0,0 +1,112 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+namespace roa {
+    // Epoch based reclamation for data that is read without locks and replaced by writers publishing new versions.
+    // Readers announce the epoch they entered in, writers retire old versions which get deleted once every
+    // thread inside a critical section has moved at least two epochs past the retirement.
+    class epoch_reclaimer {
+    public:
+        static constexpr size_t max_threads = 64;
+
+        explicit epoch_reclaimer();
+        ~epoch_reclaimer();
+
+        epoch_reclaimer(epoch_reclaimer const &) = delete;
+        epoch_reclaimer &operator=(epoch_reclaimer const &) = delete;
+
+        void enter();
+        void exit();
+
+        template <class T>
+        void retire(T const *ptr) {
+            if(ptr == nullptr) {
+                return;
+            }
+            retire(const_cast<T *>(ptr), [](void *p) { delete static_cast<T *>(p); });
+        }
+
+        void collect();
+
+    private:
+        static constexpr uint64_t inactive = UINT64_MAX;
+
+        struct alignas(64) thread_slot {
+            std::atomic<uint64_t> epoch;
+            std::atomic<bool> used;
+            uint32_t depth;
+        };
+
+        struct retired_ptr {
+            void *ptr;
+            void (*deleter)(void *);
+            uint64_t epoch;
+        };
+
+        // the slots a thread took, given back when it exits so threads coming and going don't run out of them
+        struct thread_slots {
+            struct cached_slot {
+                epoch_reclaimer const *owner;
+                uint64_t generation;
+                thread_slot *slot;
+            };
+
+            ~thread_slots();
+            std::vector<cached_slot> cached;
+        };
+
+        void retire(void *ptr, void (*deleter)(void *));
+        bool try_advance() noexcept;
+        thread_slot &local_slot();
+
+        static thread_local thread_slots _thread_slots;
+
+        // tells a reclaimer apart from an earlier one destroyed at the same address
+        uint64_t const _generation;
+        std::atomic<uint64_t> _global_epoch;
+        thread_slot _slots[max_threads];
+        std::mutex _retired_mutex;
+        std::vector<retired_ptr> _retired;
+    };
+
+    // Keeps the calling thread inside a critical section, pointers loaded inside stay valid until it is destroyed.
+    class epoch_guard {
+    public:
+        explicit epoch_guard(epoch_reclaimer &reclaimer) : _reclaimer(reclaimer) {
+            _reclaimer.enter();
+        }
+
+        ~epoch_guard() {
+            _reclaimer.exit();
+        }
+
+        epoch_guard(epoch_guard const &) = delete;
+        epoch_guard &operator=(epoch_guard const &) = delete;
+    private:
+        epoch_reclaimer &_reclaimer;
+    };
+
+    epoch_reclaimer &session_reclaimer();
+}
@@ -0,0 +1,186 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gateway_message.h"
+#include "src/json_scanner.h"
+#include <cstring>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    bool is_json_whitespace(char c) noexcept {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+}
+
+STD_OPTIONAL<uint32_t> roa::peek_message_type(char const *data, size_t length) noexcept {
+    static char const key[] = "\"type\"";
+    size_t const key_length = sizeof(key) - 1;
+    char const *end = data + length;
+    int depth = 0;
+    bool in_string = false;
+
+    for(char const *it = data; it < end; it++) {
+        // only quotes, escapes and brackets matter until the type key is found
+        it = find_json_structural(it, end);
+        if(it == end) {
+            break;
+        }
+
+        if(in_string) {
+            if(*it == '\\') {
+                it++;
+            } else if(*it == '"') {
+                in_string = false;
+            }
+            continue;
+        }
+
+        if(*it == '{' || *it == '[') {
+            depth++;
+            continue;
+        }
+
+        if(*it == '}' || *it == ']') {
+            depth--;
+            continue;
+        }
+
+        if(*it != '"') {
+            continue;
+        }
+
+        if(depth != 1 || static_cast<size_t>(end - it) < key_length || memcmp(it, key, key_length) != 0) {
+            in_string = true;
+            continue;
+        }
+
+        it += key_length;
+        while(it < end && (*it == ' ' || *it == '\t' || *it == '\n' || *it == '\r')) {
+            it++;
+        }
+        if(it == end || *it != ':') {
+            // "type" was a value, not a key
+            it--;
+            continue;
+        }
+        it++;
+        while(it < end && (*it == ' ' || *it == '\t' || *it == '\n' || *it == '\r')) {
+            it++;
+        }
+
+        uint64_t type = 0;
+        char const *digits_start = it;
+        while(it < end && *it >= '0' && *it <= '9' && type <= UINT32_MAX) {
+            type = type * 10 + static_cast<uint64_t>(*it - '0');
+            it++;
+        }
+
+        if(it == digits_start || type > UINT32_MAX) {
+            return {};
+        }
+
+        return static_cast<uint32_t>(type);
+    }
+
+    return {};
+}
+
+message_batch roa::split_message_batch(char const *data, size_t length, vector<pair<char const *, size_t>> &messages) {
+    char const *end = data + length;
+    char const *it = data;
+    int depth = 0;
+    bool in_string = false;
+    bool expect_message = true;
+    char const *message_start = nullptr;
+
+    messages.clear();
+    while(it < end && is_json_whitespace(*it)) {
+        it++;
+    }
+    if(it == end || *it != '[') {
+        return message_batch::NOT_A_BATCH;
+    }
+
+    for(it++; it < end; it++) {
+        // between messages every byte counts, only whitespace, commas and objects may sit in the array
+        if(depth == 0) {
+            if(is_json_whitespace(*it)) {
+                continue;
+            }
+
+            if(*it == '{' && expect_message) {
+                message_start = it;
+                expect_message = false;
+                depth++;
+            } else if(*it == ',' && !expect_message) {
+                expect_message = true;
+            } else if(*it == ']' && (!expect_message || messages.empty())) {
+                for(it++; it < end; it++) {
+                    if(!is_json_whitespace(*it)) {
+                        return message_batch::MALFORMED;
+                    }
+                }
+                return message_batch::BATCH;
+            } else {
+                return message_batch::MALFORMED;
+            }
+            continue;
+        }
+
+        // only quotes, escapes and brackets matter inside a message
+        it = find_json_structural(it, end);
+        if(it == end) {
+            break;
+        }
+
+        if(in_string) {
+            if(*it == '\\') {
+                it++;
+            } else if(*it == '"') {
+                in_string = false;
+            }
+            continue;
+        }
+
+        switch(*it) {
+            case '"':
+                in_string = true;
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                if(depth == 0) {
+                    if(messages.size() == max_batched_messages) {
+                        return message_batch::MALFORMED;
+                    }
+                    messages.emplace_back(message_start, static_cast<size_t>(it + 1 - message_start));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    return message_batch::MALFORMED;
+}
@@ -0,0 +1,58 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <custom_optional.h>
+
+namespace roa {
+    // Messages that are handled by the gateway itself and never reach kafka.
+    // Numbered well away from the ids of the common library so both can share the "type" field.
+    enum gateway_message_type : uint32_t {
+        RESUME_SESSION = 10000,
+        RESUME_TOKEN = 10001,
+        SNAPSHOT_ACK = 10002,
+        SNAPSHOT = 10003,
+        POSITION = 10004,
+        NEARBY_POSITION = 10005
+    };
+
+    // Finds the value of the top level "type" field without building a json DOM.
+    STD_OPTIONAL<uint32_t> peek_message_type(char const *data, size_t length) noexcept;
+
+    constexpr size_t max_batched_messages = 64;
+
+    enum class message_batch {
+        NOT_A_BATCH,
+        BATCH,
+        // an array that isn't only objects, holds more than max_batched_messages or has more than whitespace after it
+        MALFORMED
+    };
+
+    // Batched client input is a frame holding a top level json array of messages, [{"type": ...}, {"type": ...}].
+    // Splits it into the raw objects without parsing them, stopping as soon as the batch turns out to be malformed.
+    message_batch split_message_batch(char const *data, size_t length, std::vector<std::pair<char const *, size_t>> &messages);
+
+    constexpr bool is_gateway_message(uint32_t type) noexcept {
+        return type >= RESUME_SESSION && type < RESUME_SESSION + 1000;
+    }
+}
@@ -0,0 +1,173 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <type_traits>
+
+namespace roa {
+    // Appends a flat json object straight to a string, for messages owned by the gateway that don't need a DOM.
+    class json_writer {
+    public:
+        explicit json_writer(std::string &out) : _out(out), _first(true) {
+            _out.push_back('{');
+        }
+
+        template <class Integer, std::enable_if_t<std::is_integral<Integer>::value && !std::is_same<Integer, bool>::value, int> = 0>
+        json_writer &field(char const *key, Integer value) {
+            write_key(key);
+            char digits[24];
+            auto length = std::is_signed<Integer>::value ? snprintf(digits, sizeof(digits), "%lld", static_cast<long long>(value))
+                                                         : snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(value));
+            _out.append(digits, static_cast<size_t>(length));
+            return *this;
+        }
+
+        json_writer &field(char const *key, bool value) {
+            write_key(key);
+            if(value) {
+                _out.append("true", 4);
+            } else {
+                _out.append("false", 5);
+            }
+            return *this;
+        }
+
+        // only finite values, json has no representation for the others
+        json_writer &field(char const *key, double value) {
+            write_key(key);
+            char digits[32];
+            auto length = snprintf(digits, sizeof(digits), "%.9g", value);
+            _out.append(digits, static_cast<size_t>(length));
+            return *this;
+        }
+
+        json_writer &field(char const *key, std::string_view value) {
+            write_key(key);
+            write_string(value);
+            return *this;
+        }
+
+        // writes the value with write(out), usually through a json_writer of its own
+        template <class F>
+        json_writer &object(char const *key, F &&write) {
+            write_key(key);
+            write(_out);
+            return *this;
+        }
+
+        // writes count elements with write(index, out), usually through a json_writer of their own
+        template <class F>
+        json_writer &array(char const *key, size_t count, F &&write) {
+            write_key(key);
+            _out.push_back('[');
+            for(size_t i = 0; i < count; i++) {
+                if(i > 0) {
+                    _out.push_back(',');
+                }
+                write(i, _out);
+            }
+            _out.push_back(']');
+            return *this;
+        }
+
+        void finish() {
+            _out.push_back('}');
+        }
+
+    private:
+        void write_key(char const *key) {
+            if(!_first) {
+                _out.push_back(',');
+            }
+            _first = false;
+            _out.push_back('"');
+            _out.append(key);
+            _out.append("\":", 2);
+        }
+
+        void write_string(std::string_view value) {
+            static char const hex[] = "0123456789abcdef";
+            _out.push_back('"');
+            for(char c : value) {
+                switch(c) {
+                    case '"': _out.append("\\\"", 2); break;
+                    case '\\': _out.append("\\\\", 2); break;
+                    case '\n': _out.append("\\n", 2); break;
+                    case '\r': _out.append("\\r", 2); break;
+                    case '\t': _out.append("\\t", 2); break;
+                    default:
+                        if(static_cast<unsigned char>(c) < 0x20) {
+                            char escaped[] = {'\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF]};
+                            _out.append(escaped, sizeof(escaped));
+                        } else {
+                            _out.push_back(c);
+                        }
+                }
+            }
+            _out.push_back('"');
+        }
+
+        std::string &_out;
+        bool _first;
+    };
+
+    // Scratch buffer for outbound frames, taken from a per thread pool so every loop reuses the capacity instead of
+    // allocating per send. Each instance owns its string until it goes out of scope, so a nested send gets a buffer of
+    // its own instead of clearing the one an outer frame is still being written into.
+    class outbound_buffer {
+    public:
+        outbound_buffer() : _buffer(take()) {}
+
+        ~outbound_buffer() {
+            _buffer.clear();
+            pool().push_back(std::move(_buffer));
+        }
+
+        outbound_buffer(outbound_buffer const &) = delete;
+        outbound_buffer &operator=(outbound_buffer const &) = delete;
+
+        std::string &str() noexcept {
+            return _buffer;
+        }
+
+    private:
+        static std::vector<std::string> &pool() {
+            thread_local std::vector<std::string> buffers;
+            return buffers;
+        }
+
+        static std::string take() {
+            auto &buffers = pool();
+            if(buffers.empty()) {
+                return {};
+            }
+
+            auto buffer = std::move(buffers.back());
+            buffers.pop_back();
+            return buffer;
+        }
+
+        std::string _buffer;
+    };
+}
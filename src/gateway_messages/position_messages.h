@@ -0,0 +1,67 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <cmath>
+#include <json.hpp>
+#include <custom_optional.h>
+#include "gateway_message.h"
+#include "json_writer.h"
+
+namespace roa {
+    // client -> gateway: {"type": 10004, "x": 12.5, "y": -3}
+    // Where the client says its character is, see client_position_handler for what the gateway does with it.
+    struct position_message {
+        float x;
+        float y;
+
+        static STD_OPTIONAL<position_message> deserialize(nlohmann::json const &j) {
+            auto x = j.find("x");
+            auto y = j.find("y");
+            if(x == j.end() || !x->is_number() || y == j.end() || !y->is_number()) {
+                return {};
+            }
+
+            position_message msg{x->get<float>(), y->get<float>()};
+            // doubles past the float range come out as infinity
+            if(!std::isfinite(msg.x) || !std::isfinite(msg.y)) {
+                return {};
+            }
+            return msg;
+        }
+
+        static constexpr uint32_t id = POSITION;
+    };
+
+    // gateway -> client: {"type": 10005, "player_id": 42, "x": 12.5, "y": -3}
+    // Framed by the world server once it validated a position, the gateway delivers it through an area multicast envelope.
+    struct nearby_position_message {
+        uint64_t player_id;
+        float x;
+        float y;
+
+        void serialize(std::string &out) const {
+            json_writer(out).field("type", id).field("player_id", player_id).field("x", static_cast<double>(x))
+                    .field("y", static_cast<double>(y)).finish();
+        }
+
+        static constexpr uint32_t id = NEARBY_POSITION;
+    };
+}
@@ -0,0 +1,44 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "response_writers.h"
+#include <messages/user_access_control/login_response_message.h>
+#include <messages/chat/chat_receive_message.h>
+#include <messages/error_response_message.h>
+
+using namespace std;
+using namespace roa;
+
+void roa::write_client_sender(string &out) {
+    json_writer(out).field("is_server", false).field("client_id", 0).field("server_origin_id", 0).field("server_destination_id", 0).finish();
+}
+
+void roa::write_login_response(string &out, int8_t admin_status, uint64_t user_id) {
+    json_writer(out).field("type", json_login_response_message::id).object("sender", write_client_sender).field("admin_status", admin_status)
+            .field("user_id", user_id).finish();
+}
+
+void roa::write_chat_receive(string &out, string_view from_username, string_view target, string_view message) {
+    json_writer(out).field("type", json_chat_receive_message::id).object("sender", write_client_sender).field("from_username", from_username)
+            .field("target", target).field("message", message).finish();
+}
+
+void roa::write_error_response(string &out, int32_t error_number, string_view error_str) {
+    json_writer(out).field("type", json_error_response_message::id).object("sender", write_client_sender).field("error_number", error_number)
+            .field("error_str", error_str).finish();
+}
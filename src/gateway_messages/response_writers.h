@@ -0,0 +1,54 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <messages/user_access_control/get_characters_response_message.h>
+#include "json_writer.h"
+
+namespace roa {
+    // Write the json the common library's json_*_message::serialize() produces for a response to a client, straight
+    // from the fields instead of through its DOM. tests/response_writers_tests.cpp keeps the two equal.
+
+    void write_login_response(std::string &out, int8_t admin_status, uint64_t user_id);
+    void write_chat_receive(std::string &out, std::string_view from_username, std::string_view target, std::string_view message);
+    void write_error_response(std::string &out, int32_t error_number, std::string_view error_str);
+
+    struct character_fields {
+        uint64_t player_id;
+        std::string_view player_name;
+        std::string_view map_name;
+    };
+
+    // every message to a client carries this sender, the gateway doesn't tell clients apart by it
+    void write_client_sender(std::string &out);
+
+    // player_at(index) returns the character_fields of each of the count players
+    template <class F>
+    void write_get_characters_response(std::string &out, size_t count, F &&player_at, std::string_view world_name) {
+        json_writer(out).field("type", json_get_characters_response_message::id).object("sender", write_client_sender)
+                .array("players", count, [&](size_t i, std::string &player_out) {
+                    character_fields const player = player_at(i);
+                    json_writer(player_out).field("player_id", player.player_id).field("player_name", player.player_name)
+                            .field("map_name", player.map_name).finish();
+                }).field("world_name", world_name).finish();
+    }
+}
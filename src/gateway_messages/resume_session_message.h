@@ -0,0 +1,60 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <json.hpp>
+#include <custom_optional.h>
+#include "gateway_message.h"
+#include "json_writer.h"
+
+namespace roa {
+    // client -> gateway: {"type": 10000, "token": "..."}
+    struct resume_session_message {
+        std::string token;
+
+        static STD_OPTIONAL<resume_session_message> deserialize(nlohmann::json const &j) {
+            auto token = j.find("token");
+            if(token == j.end() || !token->is_string()) {
+                return {};
+            }
+            return resume_session_message{token->get<std::string>()};
+        }
+
+        static constexpr uint32_t id = RESUME_SESSION;
+    };
+
+    // gateway -> client: {"type": 10001, "token": "...", "expires_in": 300}
+    struct resume_token_message {
+        std::string token;
+        int64_t expires_in;
+
+        void serialize(std::string &out) const {
+            json_writer(out).field("type", id).field("token", token).field("expires_in", expires_in).finish();
+        }
+
+        std::string serialize() const {
+            std::string out;
+            serialize(out);
+            return out;
+        }
+
+        static constexpr uint32_t id = RESUME_TOKEN;
+    };
+}
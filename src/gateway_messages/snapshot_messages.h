@@ -0,0 +1,76 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <json.hpp>
+#include <custom_optional.h>
+#include "gateway_message.h"
+#include "json_writer.h"
+
+namespace roa {
+    // client -> gateway: {"type": 10002, "stream": 123, "sequence": 4}
+    // Acknowledges a snapshot so it becomes the baseline for deltas. Sequence 0 opts the connection into deltas
+    // for that stream without acknowledging anything.
+    struct snapshot_ack_message {
+        uint32_t stream;
+        uint64_t sequence;
+
+        static STD_OPTIONAL<snapshot_ack_message> deserialize(nlohmann::json const &j) {
+            auto stream = j.find("stream");
+            auto sequence = j.find("sequence");
+            if(stream == j.end() || !stream->is_number_unsigned() || sequence == j.end() || !sequence->is_number_unsigned()) {
+                return {};
+            }
+            return snapshot_ack_message{stream->get<uint32_t>(), sequence->get<uint64_t>()};
+        }
+
+        static constexpr uint32_t id = SNAPSHOT_ACK;
+    };
+
+    // gateway -> client, either the full snapshot:
+    //   {"type": 10003, "stream": 123, "sequence": 5, "snapshot": {...}}
+    // or a JSON Patch (RFC 6902) against the acknowledged snapshot with sequence baseline:
+    //   {"type": 10003, "stream": 123, "sequence": 5, "baseline": 4, "patch": [...]}
+    struct snapshot_message {
+        uint32_t stream;
+        uint64_t sequence;
+        STD_OPTIONAL<uint64_t> baseline;
+        // already serialized json, copied into the frame as is
+        std::string_view body;
+
+        std::string serialize() const {
+            std::string out;
+            out.reserve(body.size() + 96);
+            json_writer writer(out);
+            writer.field("type", id).field("stream", stream).field("sequence", sequence);
+            if(baseline) {
+                writer.field("baseline", baseline.value());
+            }
+            writer.object(baseline ? "patch" : "snapshot", [&](std::string &frame) {
+                frame.append(body.data(), body.size());
+            });
+            writer.finish();
+            return out;
+        }
+
+        static constexpr uint32_t id = SNAPSHOT;
+    };
+}
@@ -0,0 +1,207 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "json_scanner.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ROA_X86_SIMD
+#endif
+
+using namespace std;
+using namespace roa;
+
+static bool is_structural(char c) noexcept {
+    return c == '"' || c == '\\' || c == '{' || c == '}' || c == '[' || c == ']';
+}
+
+static char const *find_structural_scalar(char const *it, char const *end) noexcept {
+    while(it < end && !is_structural(*it)) {
+        it++;
+    }
+    return it;
+}
+
+#ifdef ROA_X86_SIMD
+__attribute__((target("sse4.2")))
+static char const *find_structural_sse42(char const *it, char const *end) noexcept {
+    __m128i const set = _mm_setr_epi8('"', '\\', '{', '}', '[', ']', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    while(end - it >= 16) {
+        __m128i const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const *>(it));
+        int const index = _mm_cmpestri(set, 6, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if(index != 16) {
+            return it + index;
+        }
+        it += 16;
+    }
+
+    return find_structural_scalar(it, end);
+}
+
+__attribute__((target("avx2")))
+static char const *find_structural_avx2(char const *it, char const *end) noexcept {
+    __m256i const quote = _mm256_set1_epi8('"');
+    __m256i const backslash = _mm256_set1_epi8('\\');
+    __m256i const open = _mm256_set1_epi8('{');
+    __m256i const close = _mm256_set1_epi8('}');
+    // '[' and ']' are '{' and '}' without bit 5, folding them saves two compares per chunk
+    __m256i const fold = _mm256_set1_epi8(0x20);
+
+    while(end - it >= 32) {
+        __m256i const chunk = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(it));
+        __m256i const folded = _mm256_or_si256(chunk, fold);
+        __m256i const matches = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)));
+        auto const mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+        if(mask != 0) {
+            return it + __builtin_ctz(mask);
+        }
+        it += 32;
+    }
+
+    return find_structural_sse42(it, end);
+}
+#endif
+
+static char const *find_non_ascii_scalar(char const *it, char const *end) noexcept {
+    while(it < end && static_cast<unsigned char>(*it) < 0x80) {
+        it++;
+    }
+    return it;
+}
+
+#ifdef ROA_X86_SIMD
+__attribute__((target("sse2")))
+static char const *find_non_ascii_sse2(char const *it, char const *end) noexcept {
+    while(end - it >= 16) {
+        auto const mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(it))));
+        if(mask != 0) {
+            return it + __builtin_ctz(mask);
+        }
+        it += 16;
+    }
+
+    return find_non_ascii_scalar(it, end);
+}
+
+__attribute__((target("avx2")))
+static char const *find_non_ascii_avx2(char const *it, char const *end) noexcept {
+    while(end - it >= 32) {
+        auto const mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(it))));
+        if(mask != 0) {
+            return it + __builtin_ctz(mask);
+        }
+        it += 32;
+    }
+
+    return find_non_ascii_sse2(it, end);
+}
+#endif
+
+// returns the byte after the sequence starting at it, nullptr when it isn't valid
+static char const *skip_utf8_sequence(char const *it, char const *end) noexcept {
+    auto const lead = static_cast<unsigned char>(*it);
+    size_t continuations;
+    uint32_t code_point;
+    uint32_t smallest;
+    if((lead & 0xE0) == 0xC0) {
+        continuations = 1;
+        code_point = lead & 0x1F;
+        smallest = 0x80;
+    } else if((lead & 0xF0) == 0xE0) {
+        continuations = 2;
+        code_point = lead & 0x0F;
+        smallest = 0x800;
+    } else if((lead & 0xF8) == 0xF0) {
+        continuations = 3;
+        code_point = lead & 0x07;
+        smallest = 0x10000;
+    } else {
+        return nullptr;
+    }
+
+    if(static_cast<size_t>(end - it) <= continuations) {
+        return nullptr;
+    }
+
+    for(size_t i = 1; i <= continuations; i++) {
+        auto const continuation = static_cast<unsigned char>(it[i]);
+        if((continuation & 0xC0) != 0x80) {
+            return nullptr;
+        }
+        code_point = (code_point << 6) | (continuation & 0x3F);
+    }
+
+    if(code_point < smallest || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+        return nullptr;
+    }
+
+    return it + continuations + 1;
+}
+
+using structural_finder = char const *(*)(char const *, char const *);
+
+static structural_finder select_structural_finder() noexcept {
+#ifdef ROA_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return find_structural_avx2;
+    }
+    if(__builtin_cpu_supports("sse4.2")) {
+        return find_structural_sse42;
+    }
+#endif
+    return find_structural_scalar;
+}
+
+static structural_finder select_non_ascii_finder() noexcept {
+#ifdef ROA_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return find_non_ascii_avx2;
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return find_non_ascii_sse2;
+    }
+#endif
+    return find_non_ascii_scalar;
+}
+
+static structural_finder const structural_finder_impl = select_structural_finder();
+static structural_finder const non_ascii_finder_impl = select_non_ascii_finder();
+
+char const *roa::find_json_structural(char const *data, char const *end) noexcept {
+    return structural_finder_impl(data, end);
+}
+
+bool roa::is_valid_utf8(char const *data, size_t length) noexcept {
+    auto const end = data + length;
+    auto it = non_ascii_finder_impl(data, end);
+    while(it != end) {
+        it = skip_utf8_sequence(it, end);
+        if(it == nullptr) {
+            return false;
+        }
+        it = non_ascii_finder_impl(it, end);
+    }
+
+    return true;
+}
@@ -0,0 +1,31 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace roa {
+    // Returns the first '"', '\\', '{', '}', '[' or ']' at or after data, end when there is none.
+    // Uses AVX2 or SSE4.2 when the cpu supports it, picked once at startup.
+    char const *find_json_structural(char const *data, char const *end) noexcept;
+
+    // False for overlong encodings, surrogates, code points past U+10FFFF and truncated sequences.
+    // Runs of ASCII are skipped 32 or 16 bytes at a time with AVX2 or SSE2, picked like find_json_structural.
+    bool is_valid_utf8(char const *data, size_t length) noexcept;
+}
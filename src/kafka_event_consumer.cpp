@@ -0,0 +1,189 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "kafka_event_consumer.h"
+#include "packed_record.h"
+#include "kafka_settings.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <exceptions.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+using namespace std;
+using namespace roa;
+
+kafka_event_consumer::kafka_event_consumer(string broker_list, string group_id, vector<string> topics)
+        : _broker_list(move(broker_list)), _group_id(move(group_id)), _topics(move(topics)), _rk(nullptr), _queue(nullptr),
+          _pipe_fds{-1, -1}, _loop(nullptr), _poll(nullptr), _callback(), _records() {
+
+}
+
+kafka_event_consumer::~kafka_event_consumer() {
+    stop();
+}
+
+void kafka_event_consumer::start(uS::Loop *loop, message_callback callback, record_callback records) {
+    char errstr[512];
+    auto conf = kafka_consumer_conf(_broker_list, _group_id);
+
+    _rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, errstr, sizeof(errstr));
+    if(_rk == nullptr) {
+        // only taken over by librdkafka when the consumer is created
+        rd_kafka_conf_destroy(conf);
+        LOG(ERROR) << NAMEOF(kafka_event_consumer::start) << " " << errstr;
+        throw runtime_error(errstr);
+    }
+
+    rd_kafka_poll_set_consumer(_rk);
+
+    auto topics = rd_kafka_topic_partition_list_new(static_cast<int>(_topics.size()));
+    for(auto const &topic : _topics) {
+        rd_kafka_topic_partition_list_add(topics, topic.c_str(), RD_KAFKA_PARTITION_UA);
+    }
+    auto err = rd_kafka_subscribe(_rk, topics);
+    rd_kafka_topic_partition_list_destroy(topics);
+
+    if(err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        LOG(ERROR) << NAMEOF(kafka_event_consumer::start) << " subscribe failed: " << rd_kafka_err2str(err);
+        throw runtime_error(rd_kafka_err2str(err));
+    }
+
+    if(pipe2(_pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+        LOG(ERROR) << NAMEOF(kafka_event_consumer::start) << " pipe2 failed";
+        throw runtime_error("pipe2 failed");
+    }
+
+    // librdkafka writes the payload to the pipe whenever the queue goes from empty to non-empty
+    _queue = rd_kafka_queue_get_consumer(_rk);
+    rd_kafka_queue_io_event_enable(_queue, _pipe_fds[1], "1", 1);
+
+    _loop = loop;
+    _callback = move(callback);
+    _records = move(records);
+    _poll = new kafka_poll(loop, _pipe_fds[0], this);
+    _poll->setCb(&kafka_event_consumer::on_readable);
+    _poll->start(loop, _poll, UV_READABLE);
+
+    LOG(INFO) << NAMEOF(kafka_event_consumer::start) << " consuming on event loop";
+
+    // anything queued before the io event was enabled doesn't trigger a write
+    drain();
+}
+
+void kafka_event_consumer::stop() {
+    if(_poll != nullptr) {
+        _poll->stop(_loop);
+        _poll->close(_loop, [](uS::Poll *p) {
+            delete static_cast<kafka_poll *>(p);
+        });
+        _poll = nullptr;
+    }
+
+    if(_queue != nullptr) {
+        rd_kafka_queue_io_event_enable(_queue, -1, nullptr, 0);
+        rd_kafka_queue_destroy(_queue);
+        _queue = nullptr;
+    }
+
+    if(_rk != nullptr) {
+        rd_kafka_consumer_close(_rk);
+        rd_kafka_destroy(_rk);
+        _rk = nullptr;
+    }
+
+    for(auto &fd : _pipe_fds) {
+        if(fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+
+void kafka_event_consumer::on_readable(uS::Poll *poll, int status, int events) {
+    auto owner = static_cast<kafka_poll *>(poll)->owner;
+    if(status < 0) {
+        LOG(ERROR) << NAMEOF(kafka_event_consumer::on_readable) << " poll error " << status;
+        return;
+    }
+
+    char buffer[64];
+    while(read(owner->_pipe_fds[0], buffer, sizeof(buffer)) > 0) {
+    }
+
+    owner->drain();
+}
+
+void kafka_event_consumer::drain() {
+    size_t handled = 0;
+    while(handled < records_per_drain) {
+        auto msg = rd_kafka_consumer_poll(_rk, 0);
+        if(msg == nullptr) {
+            return;
+        }
+        handled++;
+
+        if(msg->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+            if(msg->err != RD_KAFKA_RESP_ERR__PARTITION_EOF) {
+                LOG(ERROR) << NAMEOF(kafka_event_consumer::drain) << " consumer error: " << rd_kafka_err2str(msg->err);
+            }
+            rd_kafka_message_destroy(msg);
+            continue;
+        }
+
+        auto data = static_cast<char const *>(msg->payload);
+        if(is_packed_record(data, msg->len)) {
+            vector<pair<char const *, size_t>> messages;
+            if(!split_packed_record(data, msg->len, messages)) {
+                LOG(ERROR) << NAMEOF(kafka_event_consumer::drain) << " malformed packed record of " << msg->len << " bytes, handling "
+                           << messages.size() << " messages before the cut";
+            }
+            for(auto &packed : messages) {
+                handle_message(packed.first, packed.second);
+            }
+        } else {
+            handle_message(data, msg->len);
+        }
+
+        rd_kafka_message_destroy(msg);
+    }
+
+    // librdkafka only writes to the pipe when the queue was empty, so wake ourselves up for the rest
+    // after the loop had a chance to serve the sockets
+    if(write(_pipe_fds[1], "1", 1) < 0 && errno != EAGAIN) {
+        LOG(ERROR) << NAMEOF(kafka_event_consumer::drain) << " re-arming failed, errno " << errno;
+    }
+}
+
+void kafka_event_consumer::handle_message(char const *data, size_t length) {
+    try {
+        if(_records && _records(data, length)) {
+            return;
+        }
+
+        auto deserialized = message<false>::deserialize<false>(string(data, length));
+        if(get<1>(deserialized)) {
+            _callback(move(deserialized));
+        }
+    } catch (serialization_exception &e) {
+        LOG(ERROR) << NAMEOF(kafka_event_consumer::handle_message) << " received serialization exception " << e.what();
+    } catch(exception &e) {
+        LOG(ERROR) << NAMEOF(kafka_event_consumer::handle_message) << " received exception " << e.what();
+    }
+}
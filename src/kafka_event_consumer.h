@@ -0,0 +1,75 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <uWS.h>
+#include <rdkafka.h>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <memory>
+#include <functional>
+#include <messages/message.h>
+
+namespace roa {
+    // Kafka consumer driven by the uWS loop: librdkafka signals new messages on a pipe that is polled by the loop,
+    // so messages are handled on the loop that owns the sockets, without a polling thread or timeout.
+    class kafka_event_consumer {
+    public:
+        using message_callback = std::function<void(std::tuple<uint32_t, std::unique_ptr<message<false> const>>)>;
+        // sees every record before it is deserialized, returns true when it handled the record itself
+        // packed records are split first, the callback then sees each message they carry
+        using record_callback = std::function<bool(char const *data, size_t length)>;
+
+        explicit kafka_event_consumer(std::string broker_list, std::string group_id, std::vector<std::string> topics);
+        ~kafka_event_consumer();
+
+        kafka_event_consumer(kafka_event_consumer const &) = delete;
+        kafka_event_consumer &operator=(kafka_event_consumer const &) = delete;
+
+        // has to be called on the thread running the loop
+        void start(uS::Loop *loop, message_callback callback, record_callback records = {});
+        void stop();
+
+    private:
+        struct kafka_poll : uS::Poll {
+            kafka_poll(uS::Loop *loop, int fd, kafka_event_consumer *owner) : uS::Poll(loop, fd), owner(owner) {}
+            kafka_event_consumer *owner;
+        };
+
+        // records handled per wake up before the loop gets to serve its sockets again
+        static constexpr size_t records_per_drain = 64;
+
+        static void on_readable(uS::Poll *poll, int status, int events);
+        // handles at most records_per_drain records, re-arms the poll when more are queued
+        void drain();
+        void handle_message(char const *data, size_t length);
+
+        std::string _broker_list;
+        std::string _group_id;
+        std::vector<std::string> _topics;
+        rd_kafka_t *_rk;
+        rd_kafka_queue_t *_queue;
+        int _pipe_fds[2];
+        uS::Loop *_loop;
+        kafka_poll *_poll;
+        message_callback _callback;
+        record_callback _records;
+    };
+}
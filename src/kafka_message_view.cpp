@@ -0,0 +1,176 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "kafka_message_view.h"
+#include <cstring>
+#include <messages/chat/chat_send_message.h>
+#include "gateway_messages/gateway_message.h"
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    template <class T>
+    T load_big_endian(char const *data) noexcept {
+        T value = 0;
+        for(size_t i = 0; i < sizeof(T); i++) {
+            value = static_cast<T>((value << 8) | static_cast<unsigned char>(data[i]));
+        }
+        return value;
+    }
+
+    template <class T>
+    void append_big_endian(string &out, T value) {
+        for(size_t i = sizeof(T); i > 0; i--) {
+            out.push_back(static_cast<char>(value >> (8 * (i - 1))));
+        }
+    }
+
+    constexpr size_t field_entry_size = 2 * sizeof(uint32_t);
+}
+
+bool kafka_message_view::is_view(char const *data, size_t length) noexcept {
+    return length >= kafka_message_view_header_size && memcmp(data, kafka_message_view_magic, sizeof(kafka_message_view_magic)) == 0;
+}
+
+STD_OPTIONAL<kafka_message_view> kafka_message_view::parse(char const *data, size_t length) noexcept {
+    if(!is_view(data, length)) {
+        return {};
+    }
+
+    kafka_message_view view;
+    view._data = data;
+    view._type = load_big_endian<uint32_t>(data + 4);
+    view._sender = message_sender{true, load_big_endian<uint64_t>(data + 8), load_big_endian<uint32_t>(data + 16), load_big_endian<uint32_t>(data + 20)};
+    view._count = load_big_endian<uint32_t>(data + 24);
+
+    if(view._count > (length - kafka_message_view_header_size) / field_entry_size) {
+        return {};
+    }
+
+    // checked once here, so the accessors can trust the table
+    for(uint32_t i = 0; i < view._count; i++) {
+        auto entry = data + kafka_message_view_header_size + i * field_entry_size;
+        auto offset = load_big_endian<uint32_t>(entry);
+        auto field_length = load_big_endian<uint32_t>(entry + sizeof(uint32_t));
+        if(offset > length || field_length > length - offset) {
+            return {};
+        }
+    }
+
+    return view;
+}
+
+string_view kafka_message_view::string_field(uint32_t index) const noexcept {
+    if(index >= _count) {
+        return {};
+    }
+
+    auto entry = _data + kafka_message_view_header_size + index * field_entry_size;
+    return string_view(_data + load_big_endian<uint32_t>(entry), load_big_endian<uint32_t>(entry + sizeof(uint32_t)));
+}
+
+uint64_t kafka_message_view::uint_field(uint32_t index) const noexcept {
+    auto field = string_field(index);
+    if(field.size() != sizeof(uint64_t)) {
+        return 0;
+    }
+    return load_big_endian<uint64_t>(field.data());
+}
+
+kafka_message_view_writer::kafka_message_view_writer(uint32_t type, message_sender const &sender) : _type(type), _sender(sender), _fields(), _bytes() {
+}
+
+kafka_message_view_writer &kafka_message_view_writer::string_field(string_view field) {
+    _fields.emplace_back(static_cast<uint32_t>(_bytes.size()), static_cast<uint32_t>(field.size()));
+    _bytes.append(field.data(), field.size());
+    return *this;
+}
+
+kafka_message_view_writer &kafka_message_view_writer::uint_field(uint64_t field) {
+    _fields.emplace_back(static_cast<uint32_t>(_bytes.size()), static_cast<uint32_t>(sizeof(field)));
+    append_big_endian(_bytes, field);
+    return *this;
+}
+
+string kafka_message_view_writer::finish() const {
+    auto fields_start = kafka_message_view_header_size + _fields.size() * field_entry_size;
+
+    string record;
+    record.reserve(fields_start + _bytes.size());
+    record.append(kafka_message_view_magic, sizeof(kafka_message_view_magic));
+    append_big_endian(record, _type);
+    append_big_endian(record, _sender.client_id);
+    append_big_endian(record, _sender.server_origin_id);
+    append_big_endian(record, _sender.server_destination_id);
+    append_big_endian(record, static_cast<uint32_t>(_fields.size()));
+    for(auto const &field : _fields) {
+        append_big_endian(record, static_cast<uint32_t>(fields_start + field.first));
+        append_big_endian(record, field.second);
+    }
+    record.append(_bytes);
+    return record;
+}
+
+STD_OPTIONAL<chat_send_view> chat_send_view::from(kafka_message_view const &view) noexcept {
+    if(view.field_count() != field_count) {
+        return {};
+    }
+    return chat_send_view{view.string_field(0), view.string_field(1), view.string_field(2)};
+}
+
+string chat_send_view::write(message_sender const &sender, string_view from_username, string_view target, string_view message) {
+    return kafka_message_view_writer(binary_chat_send_message::id, sender).string_field(from_username).string_field(target).string_field(message).finish();
+}
+
+STD_OPTIONAL<get_characters_response_view> get_characters_response_view::from(kafka_message_view const &view) noexcept {
+    if(view.field_count() == 0 || (view.field_count() - 1) % player_field_count != 0) {
+        return {};
+    }
+    return get_characters_response_view{view, view.string_field(0), (view.field_count() - 1) / player_field_count};
+}
+
+string get_characters_response_view::write(message_sender const &sender, vector<message_player> const &players, string_view world_name) {
+    kafka_message_view_writer writer(binary_get_characters_response_message::id, sender);
+    writer.string_field(world_name);
+    for(auto const &player : players) {
+        writer.uint_field(player.player_id).string_field(player.player_name).string_field(player.map_name);
+    }
+    return writer.finish();
+}
+
+STD_OPTIONAL<position_view> position_view::from(kafka_message_view const &view) noexcept {
+    if(view.field_count() != field_count) {
+        return {};
+    }
+
+    auto x_bits = static_cast<uint32_t>(view.uint_field(1));
+    auto y_bits = static_cast<uint32_t>(view.uint_field(2));
+    position_view position{view.uint_field(0), 0, 0};
+    memcpy(&position.x, &x_bits, sizeof(position.x));
+    memcpy(&position.y, &y_bits, sizeof(position.y));
+    return position;
+}
+
+string position_view::write(message_sender const &sender, uint64_t player_id, float x, float y) {
+    uint32_t x_bits;
+    uint32_t y_bits;
+    memcpy(&x_bits, &x, sizeof(x_bits));
+    memcpy(&y_bits, &y, sizeof(y_bits));
+    return kafka_message_view_writer(POSITION, sender).uint_field(player_id).uint_field(x_bits).uint_field(y_bits).finish();
+}
@@ -0,0 +1,146 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <custom_optional.h>
+#include <messages/message.h>
+#include <messages/user_access_control/get_characters_response_message.h>
+
+namespace roa {
+    // Kafka record a backend sends instead of a cereal message, so the gateway can read it in place. Integers big endian:
+    //   0  magic "RVW1"
+    //   4  type, uint32, id of the common library message it stands in for
+    //   8  client_id, uint64
+    //   16 server_origin_id, uint32
+    //   20 server_destination_id, uint32
+    //   24 count, uint32, number of fields
+    //   28 count times a uint32 offset from the start of the record and a uint32 length
+    //   .. the field bytes, strings as is and numbers as uint64
+    // Which field is which depends on the type, see the views below.
+    constexpr char kafka_message_view_magic[4] = {'R', 'V', 'W', '1'};
+    constexpr size_t kafka_message_view_header_size = 28;
+
+    // Points into the record it was parsed from, for records consumed on the loop that is the rd_kafka message,
+    // which is only alive until the record callback returns. Anything kept longer has to be copied out.
+    class kafka_message_view {
+    public:
+        static bool is_view(char const *data, size_t length) noexcept;
+        // nothing when the header or one of the fields reaches past the end of the record
+        static STD_OPTIONAL<kafka_message_view> parse(char const *data, size_t length) noexcept;
+
+        uint32_t type() const noexcept {
+            return _type;
+        }
+
+        message_sender const &sender() const noexcept {
+            return _sender;
+        }
+
+        uint32_t field_count() const noexcept {
+            return _count;
+        }
+
+        // empty when index is out of range
+        std::string_view string_field(uint32_t index) const noexcept;
+        // 0 when index is out of range or the field isn't 8 bytes
+        uint64_t uint_field(uint32_t index) const noexcept;
+
+    private:
+        kafka_message_view() = default;
+
+        char const *_data;
+        uint32_t _type;
+        message_sender _sender;
+        uint32_t _count;
+    };
+
+    // Writes a view record, the producer side of the layout above. Fields are added in the order the view of the type
+    // reads them, see the write functions below for the types the gateway reads as views.
+    class kafka_message_view_writer {
+    public:
+        kafka_message_view_writer(uint32_t type, message_sender const &sender);
+
+        kafka_message_view_writer &string_field(std::string_view field);
+        kafka_message_view_writer &uint_field(uint64_t field);
+
+        std::string finish() const;
+
+    private:
+        uint32_t _type;
+        message_sender _sender;
+        // offset into _bytes and length of every field
+        std::vector<std::pair<uint32_t, uint32_t>> _fields;
+        std::string _bytes;
+    };
+
+    // chat_send_message: from_username, target, message
+    struct chat_send_view {
+        static constexpr uint32_t field_count = 3;
+
+        std::string_view from_username;
+        std::string_view target;
+        std::string_view message;
+
+        static STD_OPTIONAL<chat_send_view> from(kafka_message_view const &view) noexcept;
+        static std::string write(message_sender const &sender, std::string_view from_username, std::string_view target, std::string_view message);
+    };
+
+    // get_characters_response_message: world_name, then player_id, player_name and map_name of every player
+    struct get_characters_response_view {
+        static constexpr uint32_t player_field_count = 3;
+
+        kafka_message_view const &view;
+        std::string_view world_name;
+        uint32_t player_count;
+
+        uint64_t player_id(uint32_t index) const noexcept {
+            return view.uint_field(1 + index * player_field_count);
+        }
+
+        std::string_view player_name(uint32_t index) const noexcept {
+            return view.string_field(2 + index * player_field_count);
+        }
+
+        std::string_view map_name(uint32_t index) const noexcept {
+            return view.string_field(3 + index * player_field_count);
+        }
+
+        static STD_OPTIONAL<get_characters_response_view> from(kafka_message_view const &view) noexcept;
+        static std::string write(message_sender const &sender, std::vector<message_player> const &players, std::string_view world_name);
+    };
+
+    // position_message of a client, forwarded to the world server of its character to be validated: player_id, x and y,
+    // the coordinates as the bits of a float32 in the low half of their field
+    struct position_view {
+        static constexpr uint32_t field_count = 3;
+
+        uint64_t player_id;
+        float x;
+        float y;
+
+        static STD_OPTIONAL<position_view> from(kafka_message_view const &view) noexcept;
+        static std::string write(message_sender const &sender, uint64_t player_id, float x, float y);
+    };
+}
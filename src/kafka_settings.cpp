@@ -0,0 +1,58 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "kafka_settings.h"
+#include <easylogging++.h>
+#include <macros.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    void log_failed_delivery(rd_kafka_t *, rd_kafka_message_t const *message, void *) {
+        if(unlikely(message->err != RD_KAFKA_RESP_ERR_NO_ERROR)) {
+            LOG(ERROR) << NAMEOF(log_failed_delivery) << " delivering to " << rd_kafka_topic_name(message->rkt) << " failed: " << rd_kafka_err2str(message->err);
+        }
+    }
+}
+
+rd_kafka_conf_t *roa::kafka_consumer_conf(string const &broker_list, string const &group_id) {
+    auto conf = rd_kafka_conf_new();
+    set_kafka_setting(conf, "metadata.broker.list", broker_list);
+    set_kafka_setting(conf, "group.id", group_id);
+    // end of partition isn't interesting to a gateway, it would only take records out of the drain budget
+    set_kafka_setting(conf, "enable.partition.eof", "false");
+    return conf;
+}
+
+rd_kafka_conf_t *roa::kafka_producer_conf(string const &broker_list, uint32_t ack_timeout_ms) {
+    auto conf = rd_kafka_conf_new();
+    set_kafka_setting(conf, "metadata.broker.list", broker_list);
+    set_kafka_setting(conf, "request.timeout.ms", to_string(ack_timeout_ms));
+    rd_kafka_conf_set_dr_msg_cb(conf, log_failed_delivery);
+    return conf;
+}
+
+void roa::set_kafka_setting(rd_kafka_conf_t *conf, char const *name, string const &value) {
+    char errstr[512];
+    if(rd_kafka_conf_set(conf, name, value.c_str(), errstr, sizeof(errstr)) != RD_KAFKA_CONF_OK) {
+        rd_kafka_conf_destroy(conf);
+        LOG(ERROR) << NAMEOF(set_kafka_setting) << " " << name << ": " << errstr;
+        throw runtime_error(errstr);
+    }
+}
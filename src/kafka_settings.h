@@ -0,0 +1,35 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <rdkafka.h>
+#include <string>
+#include <cstdint>
+
+namespace roa {
+    // librdkafka settings for the clients the gateway creates itself next to the common consumer and producer, kept in
+    // one place so they all connect and consume the same way.
+    // Returns a conf for rd_kafka_new, throws when librdkafka rejects a setting.
+    rd_kafka_conf_t *kafka_consumer_conf(std::string const &broker_list, std::string const &group_id);
+    // ack_timeout_ms is how long a broker gets to acknowledge a produce request, failed deliveries are logged
+    rd_kafka_conf_t *kafka_producer_conf(std::string const &broker_list, uint32_t ack_timeout_ms);
+
+    // destroys conf before throwing when the setting is rejected
+    void set_kafka_setting(rd_kafka_conf_t *conf, char const *name, std::string const &value);
+}
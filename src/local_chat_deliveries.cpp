@@ -0,0 +1,74 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "local_chat_deliveries.h"
+
+using namespace std;
+using namespace roa;
+
+local_chat_deliveries::local_chat_deliveries(chrono::seconds retention)
+        : _retention(retention), _mutex(), _deliveries(), _next_expiry(chrono::steady_clock::now() + retention) {
+
+}
+
+void local_chat_deliveries::mark(string_view from, string_view target, string_view message) {
+    auto now = chrono::steady_clock::now();
+    lock_guard<mutex> lock(_mutex);
+    expire(now);
+
+    auto &entry = _deliveries[key(from, target, message)];
+    entry.count++;
+    entry.marked_at = now;
+}
+
+bool local_chat_deliveries::consume(string_view from, string_view target, string_view message) {
+    lock_guard<mutex> lock(_mutex);
+    auto entry = _deliveries.find(key(from, target, message));
+    if(entry == end(_deliveries)) {
+        return false;
+    }
+
+    if(--entry->second.count == 0) {
+        _deliveries.erase(entry);
+    }
+    return true;
+}
+
+size_t local_chat_deliveries::key(string_view from, string_view target, string_view message) {
+    hash<string_view> hasher;
+    auto ret = hasher(from);
+    ret ^= hasher(target) + 0x9e3779b97f4a7c15ULL + (ret << 6) + (ret >> 2);
+    ret ^= hasher(message) + 0x9e3779b97f4a7c15ULL + (ret << 6) + (ret >> 2);
+    return ret;
+}
+
+void local_chat_deliveries::expire(chrono::steady_clock::time_point now) {
+    if(now < _next_expiry) {
+        return;
+    }
+
+    // echoes that never came back, e.g. because kafka was unavailable
+    for(auto it = begin(_deliveries); it != end(_deliveries);) {
+        if(it->second.marked_at + _retention < now) {
+            it = _deliveries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    _next_expiry = now + _retention;
+}
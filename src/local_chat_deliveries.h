@@ -0,0 +1,52 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+
+namespace roa {
+    // Remembers chat messages that were delivered straight to a local recipient, so the copy coming back from kafka
+    // is not delivered a second time.
+    class local_chat_deliveries {
+    public:
+        explicit local_chat_deliveries(std::chrono::seconds retention);
+
+        void mark(std::string_view from, std::string_view target, std::string_view message);
+        // true once for every mark of the same message
+        bool consume(std::string_view from, std::string_view target, std::string_view message);
+
+    private:
+        struct delivery {
+            uint32_t count;
+            std::chrono::steady_clock::time_point marked_at;
+        };
+
+        static size_t key(std::string_view from, std::string_view target, std::string_view message);
+        void expire(std::chrono::steady_clock::time_point now);
+
+        std::chrono::seconds _retention;
+        std::mutex _mutex;
+        std::unordered_map<size_t, delivery> _deliveries;
+        std::chrono::steady_clock::time_point _next_expiry;
+    };
+}
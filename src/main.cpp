@@ -27,6 +27,7 @@
 #include <string>
 #include <fstream>
 #include <streambuf>
+#include <cmath>
 #include <vector>
 #include <thread>
 #include <unordered_map>
@@ -49,7 +50,28 @@
 #include "message_handlers/client/client_login_handler.h"
 #include "message_handlers/client/client_register_handler.h"
 #include "message_handlers/client/client_chat_send_handler.h"
+#include "message_handlers/client/client_resume_session_handler.h"
+#include "message_handlers/client/client_position_handler.h"
+#include "message_handlers/handler_registration.h"
+#include "gateway_messages/gateway_message.h"
+#include "resume_token_manager.h"
+#include "payload_compressor.h"
+#include "chat_channel_registry.h"
+#include "local_chat_deliveries.h"
+#include "kafka_event_consumer.h"
+#include "traffic_recorder.h"
+#include "thread_placement.h"
 #include "user_connection.h"
+#include "connection_registry.h"
+#include "area_of_interest.h"
+#include "snapshot_deltas.h"
+#include "outbound_coalescer.h"
+#include "worker_pool.h"
+#include "partitioned_producer.h"
+#include "multicast_envelope.h"
+#include "kafka_message_view.h"
+#include "json_scanner.h"
+#include "gateway_messages/snapshot_messages.h"
 #include "config.h"
 
 using namespace std;
@@ -160,54 +182,457 @@ STD_OPTIONAL<Config> parse_env_file() {
         return {};
     }
 
+    // optional, session resumption is disabled without a secret
+    config.resume_token_ttl_seconds = 300;
+    if(env_json.find("RESUME_TOKEN_SECRET") != env_json.end()) {
+        config.resume_token_secret = env_json["RESUME_TOKEN_SECRET"];
+    }
+
+    if(env_json.find("RESUME_TOKEN_TTL_SECONDS") != env_json.end()) {
+        config.resume_token_ttl_seconds = env_json["RESUME_TOKEN_TTL_SECONDS"];
+    }
+
+    // optional, payloads smaller than the threshold are never compressed, 0 disables compression
+    config.compression_threshold = 1024;
+    config.compression_level = Z_DEFAULT_COMPRESSION;
+    config.compression_cache_entries = 32;
+    if(env_json.find("COMPRESSION_THRESHOLD") != env_json.end()) {
+        config.compression_threshold = env_json["COMPRESSION_THRESHOLD"];
+    }
+
+    if(env_json.find("COMPRESSION_LEVEL") != env_json.end()) {
+        config.compression_level = env_json["COMPRESSION_LEVEL"];
+    }
+
+    if(env_json.find("COMPRESSION_CACHE_ENTRIES") != env_json.end()) {
+        config.compression_cache_entries = env_json["COMPRESSION_CACHE_ENTRIES"];
+    }
+
+    // optional, preset dictionary for clients opting into roa-deflate-dictionary, written by tools/build_compression_dictionary.cpp
+    if(env_json.find("COMPRESSION_DICTIONARY_FILE") != env_json.end()) {
+        config.compression_dictionary_file = env_json["COMPRESSION_DICTIONARY_FILE"];
+    }
+
+    // optional, deliver whispers to recipients on this gateway without waiting for kafka
+    config.local_chat_delivery = false;
+    if(env_json.find("LOCAL_CHAT_DELIVERY") != env_json.end()) {
+        config.local_chat_delivery = env_json["LOCAL_CHAT_DELIVERY"];
+    }
+
+    // optional, consume kafka on the uws loop instead of a separate polling thread
+    config.kafka_event_loop_consumer = false;
+    if(env_json.find("KAFKA_EVENT_LOOP_CONSUMER") != env_json.end()) {
+        config.kafka_event_loop_consumer = env_json["KAFKA_EVENT_LOOP_CONSUMER"];
+    }
+
+    // optional, deliver multicast envelopes addressed to this gateway, see multicast_envelope.h
+    config.kafka_multicast_envelopes = false;
+    if(env_json.find("KAFKA_MULTICAST_ENVELOPES") != env_json.end()) {
+        config.kafka_multicast_envelopes = env_json["KAFKA_MULTICAST_ENVELOPES"];
+    }
+
+    if(config.kafka_multicast_envelopes && !config.kafka_event_loop_consumer) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " KAFKA_MULTICAST_ENVELOPES requires KAFKA_EVENT_LOOP_CONSUMER, the common consumer can't hand out raw records";
+        return {};
+    }
+
+    // optional, key client messages on the user so backends can consume partitions in parallel and still see them in order
+    config.kafka_partition_keys = false;
+    if(env_json.find("KAFKA_PARTITION_KEYS") != env_json.end()) {
+        config.kafka_partition_keys = env_json["KAFKA_PARTITION_KEYS"];
+    }
+
+    // optional, hold client messages back this long to send the ones for the same partition as one packed record, 0 sends each on its own
+    config.kafka_packing_linger_ms = 0;
+    config.kafka_packing_max_bytes = 256 * 1024;
+    if(env_json.find("KAFKA_PACKING_LINGER_MS") != env_json.end()) {
+        config.kafka_packing_linger_ms = env_json["KAFKA_PACKING_LINGER_MS"];
+    }
+
+    if(env_json.find("KAFKA_PACKING_MAX_BYTES") != env_json.end()) {
+        config.kafka_packing_max_bytes = env_json["KAFKA_PACKING_MAX_BYTES"];
+    }
+
+    if(config.kafka_packing_linger_ms > 0 && !config.kafka_partition_keys) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " KAFKA_PACKING_LINGER_MS needs KAFKA_PARTITION_KEYS";
+        return {};
+    }
+
+    // gateways read packed records back on broadcast and chat_messages, only the loop consumer unpacks them
+    if(config.kafka_packing_linger_ms > 0 && !config.kafka_event_loop_consumer) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " KAFKA_PACKING_LINGER_MS needs KAFKA_EVENT_LOOP_CONSUMER";
+        return {};
+    }
+
+    // optional, capture all websocket and kafka traffic for replaying it offline
+    config.traffic_capture_max_bytes = 1024ull * 1024 * 1024;
+    if(env_json.find("TRAFFIC_CAPTURE_FILE") != env_json.end()) {
+        config.traffic_capture_file = env_json["TRAFFIC_CAPTURE_FILE"];
+    }
+
+    if(env_json.find("TRAFFIC_CAPTURE_MAX_BYTES") != env_json.end()) {
+        config.traffic_capture_max_bytes = env_json["TRAFFIC_CAPTURE_MAX_BYTES"];
+    }
+
+    // optional, number of independently locked connection table shards
+    config.connection_shards = 16;
+    if(env_json.find("CONNECTION_SHARDS") != env_json.end()) {
+        config.connection_shards = env_json["CONNECTION_SHARDS"];
+    }
+
+    if(config.connection_shards == 0) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " CONNECTION_SHARDS has to be greater than 0";
+        return {};
+    }
+
+    // optional, edge length of the area of interest grid cells in world units
+    config.aoi_cell_size = 32;
+    if(env_json.find("AOI_CELL_SIZE") != env_json.end()) {
+        config.aoi_cell_size = env_json["AOI_CELL_SIZE"];
+    }
+
+    if(!(config.aoi_cell_size > 0)) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " AOI_CELL_SIZE has to be greater than 0";
+        return {};
+    }
+
+    // optional, caps how far away in world units connections hear about an area multicast from the world server
+    config.aoi_radius = 64;
+    if(env_json.find("AOI_RADIUS") != env_json.end()) {
+        config.aoi_radius = env_json["AOI_RADIUS"];
+    }
+
+    if(!(config.aoi_radius > 0) || !isfinite(config.aoi_radius)) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " AOI_RADIUS has to be greater than 0";
+        return {};
+    }
+
+    // optional, position reports accepted per connection and second, the rest are dropped before reaching the world server
+    config.position_updates_per_second = 10;
+    if(env_json.find("POSITION_UPDATES_PER_SECOND") != env_json.end()) {
+        config.position_updates_per_second = env_json["POSITION_UPDATES_PER_SECOND"];
+    }
+
+    if(config.position_updates_per_second == 0 || config.position_updates_per_second > UINT16_MAX) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " POSITION_UPDATES_PER_SECOND has to be between 1 and " << UINT16_MAX;
+        return {};
+    }
+
+    // optional, unacknowledged snapshots kept per stream before a client falls back to full snapshots
+    config.snapshot_delta_history = 8;
+    if(env_json.find("SNAPSHOT_DELTA_HISTORY") != env_json.end()) {
+        config.snapshot_delta_history = env_json["SNAPSHOT_DELTA_HISTORY"];
+    }
+
+    if(config.snapshot_delta_history == 0) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " SNAPSHOT_DELTA_HISTORY has to be greater than 0";
+        return {};
+    }
+
+    // optional, frames for a connection are gathered and written together every interval, 0 sends them right away
+    config.outbound_flush_interval_ms = 0;
+    if(env_json.find("OUTBOUND_FLUSH_INTERVAL_MS") != env_json.end()) {
+        config.outbound_flush_interval_ms = env_json["OUTBOUND_FLUSH_INTERVAL_MS"];
+    }
+
+    // optional, bytes held per connection for each outbound class while coalescing, see outbound_class
+    config.outbound_control_queue_bytes = 1024 * 1024;
+    config.outbound_chat_queue_bytes = 256 * 1024;
+    config.outbound_bulk_queue_bytes = 16 * 1024 * 1024;
+    config.outbound_bulk_bytes_per_flush = 64 * 1024;
+    if(env_json.find("OUTBOUND_CONTROL_QUEUE_BYTES") != env_json.end()) {
+        config.outbound_control_queue_bytes = env_json["OUTBOUND_CONTROL_QUEUE_BYTES"];
+    }
+
+    if(env_json.find("OUTBOUND_CHAT_QUEUE_BYTES") != env_json.end()) {
+        config.outbound_chat_queue_bytes = env_json["OUTBOUND_CHAT_QUEUE_BYTES"];
+    }
+
+    if(env_json.find("OUTBOUND_BULK_QUEUE_BYTES") != env_json.end()) {
+        config.outbound_bulk_queue_bytes = env_json["OUTBOUND_BULK_QUEUE_BYTES"];
+    }
+
+    if(env_json.find("OUTBOUND_BULK_BYTES_PER_FLUSH") != env_json.end()) {
+        config.outbound_bulk_bytes_per_flush = env_json["OUTBOUND_BULK_BYTES_PER_FLUSH"];
+    }
+
+    if(config.outbound_control_queue_bytes == 0 || config.outbound_chat_queue_bytes == 0 || config.outbound_bulk_queue_bytes == 0) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " OUTBOUND_*_QUEUE_BYTES have to be greater than 0";
+        return {};
+    }
+
+    // optional, threads encoding and compressing large responses off the thread delivering kafka messages, 0 encodes inline
+    config.serialization_workers = 0;
+    if(env_json.find("SERIALIZATION_WORKERS") != env_json.end()) {
+        config.serialization_workers = env_json["SERIALIZATION_WORKERS"];
+    }
+
+    if(config.serialization_workers > 0 && config.outbound_flush_interval_ms == 0) {
+        LOG(ERROR) << NAMEOF(parse_env_file) << " SERIALIZATION_WORKERS requires OUTBOUND_FLUSH_INTERVAL_MS, encoded responses are sent on flush";
+        return {};
+    }
+
+    // optional, cpu lists like "0-3,8" to pin the gateway threads to, unpinned when empty
+    if(env_json.find("MAIN_THREAD_CPUS") != env_json.end()) {
+        config.main_thread_cpus = env_json["MAIN_THREAD_CPUS"];
+    }
+
+    if(env_json.find("UWS_THREAD_CPUS") != env_json.end()) {
+        config.uws_thread_cpus = env_json["UWS_THREAD_CPUS"];
+    }
+
+    if(env_json.find("CONSUMER_THREAD_CPUS") != env_json.end()) {
+        config.consumer_thread_cpus = env_json["CONSUMER_THREAD_CPUS"];
+    }
+
+    if(env_json.find("SERIALIZATION_WORKER_CPUS") != env_json.end()) {
+        config.serialization_worker_cpus = env_json["SERIALIZATION_WORKER_CPUS"];
+    }
+
     return config;
 }
 
-unique_ptr<thread> create_uws_thread(Config config, uWS::Hub &h, shared_ptr<ikafka_producer<false>> producer, shared_ptr<cuckoohash_map<string, user_connection>> connections) {
-    if(!producer) {
+string load_compression_dictionary(Config const &config) {
+    if(config.compression_dictionary_file.empty()) {
+        return {};
+    }
+
+    ifstream dictionary_file(config.compression_dictionary_file, ios::binary);
+    if(!dictionary_file) {
+        LOG(WARNING) << NAMEOF(load_compression_dictionary) << " could not open " << config.compression_dictionary_file << ", continuing without dictionary";
+        return {};
+    }
+
+    return string(istreambuf_iterator<char>(dictionary_file), istreambuf_iterator<char>());
+}
+
+vector<string> consumer_topics(Config const &config) {
+    return {server_topic(config.server_id).str(), "chat_messages", "broadcast"};
+}
+
+// finds the connection a backend message is for and hands it to trigger
+template <class F>
+void dispatch_to_connection(connection_registry &connections, uint32_t type, uint64_t id, F &&trigger) {
+    // keeps the connection alive when the uws thread drops it while we're handling the message
+    auto connection = connections.find(id);
+    if (!connection) {
+        // chat is meant for everyone on this gateway, the sender may be connected to another one
+        if(type == gateway_chat_send_handler::message_id) {
+            epoch_guard guard(session_reclaimer());
+            trigger(STD_OPTIONAL<reference_wrapper<user_connection>>{});
+        } else {
+            LOG(DEBUG) << NAMEOF(dispatch_to_connection) << " Got message for client_id " << id << " but no connection found";
+        }
+        return;
+    }
+
+    epoch_guard guard(session_reclaimer());
+    trigger(make_optional(ref(*connection)));
+}
+
+void dispatch_gateway_message(message_dispatcher<false> &dispatcher, connection_registry &connections,
+                              traffic_recorder *recorder, tuple<uint32_t, unique_ptr<message<false> const>> msg) {
+    LOG(INFO) << NAMEOF(dispatch_gateway_message) << " Got message from kafka";
+
+    auto id = get<1>(msg)->sender.client_id;
+    if(unlikely(recorder != nullptr)) {
+        auto serialized = get<1>(msg)->serialize();
+        recorder->record(traffic_record_kind::KAFKA_MESSAGE, id, serialized.data(), static_cast<uint32_t>(serialized.size()));
+    }
+
+    dispatch_to_connection(connections, get<0>(msg), id, [&](STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+        dispatcher.trigger_handler(move(msg), connection);
+    });
+
+    LOG(DEBUG) << NAMEOF(dispatch_gateway_message) << " done handling message";
+}
+
+// like multicast envelopes, views are only recognized when kafka is consumed on the uws loop
+bool dispatch_gateway_view(message_dispatcher<false> &dispatcher, connection_registry &connections, traffic_recorder *recorder,
+                           char const *data, size_t length) {
+    if(!kafka_message_view::is_view(data, length)) {
+        return false;
+    }
+
+    auto view = kafka_message_view::parse(data, length);
+    if(!view) {
+        LOG(ERROR) << NAMEOF(dispatch_gateway_view) << " malformed message view of " << length << " bytes";
+        return true;
+    }
+
+    if(unlikely(recorder != nullptr)) {
+        recorder->record(traffic_record_kind::KAFKA_MESSAGE, view->sender().client_id, data, static_cast<uint32_t>(length));
+    }
+
+    dispatch_to_connection(connections, view->type(), view->sender().client_id, [&](STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+        if(!dispatcher.trigger_view(view->type(), *view, connection)) {
+            LOG(ERROR) << NAMEOF(dispatch_gateway_view) << " no handler reads views of type " << view->type();
+        }
+    });
+    return true;
+}
+
+// multicast records are only recognized when kafka is consumed on the uws loop, the common consumer can't hand out raw records
+bool deliver_multicast(Config const &config, connection_registry const &connections, chat_channel_registry const &channels,
+                       area_of_interest const &aoi, traffic_recorder *recorder, char const *data, size_t length) {
+    if(!config.kafka_multicast_envelopes || !multicast_envelope::is_envelope(data, length)) {
+        return false;
+    }
+
+    if(unlikely(recorder != nullptr)) {
+        recorder->record(traffic_record_kind::KAFKA_MESSAGE, 0, data, static_cast<uint32_t>(length));
+    }
+
+    auto envelope = multicast_envelope::parse(data, length);
+    if(!envelope) {
+        LOG(ERROR) << NAMEOF(deliver_multicast) << " malformed multicast envelope of " << length << " bytes";
+        return true;
+    }
+
+    // shared topics carry the envelopes of every gateway, connection ids are only unique per gateway
+    if(envelope->destination() != config.server_id) {
+        return true;
+    }
+
+    auto sent = envelope->deliver(connections, channels, aoi);
+    LOG(DEBUG) << NAMEOF(deliver_multicast) << " multicast frame delivered to " << sent << " connections";
+    return true;
+}
+
+unique_ptr<thread> create_uws_thread(Config config, uWS::Hub &h, shared_ptr<partitioned_producer> producer, shared_ptr<connection_registry> connections,
+                                     shared_ptr<resume_token_manager> tokens, shared_ptr<payload_compressor> compressor,
+                                     shared_ptr<chat_channel_registry> channels, shared_ptr<local_chat_deliveries> local_deliveries,
+                                     shared_ptr<area_of_interest> aoi, shared_ptr<snapshot_deltas> deltas, shared_ptr<worker_pool> workers,
+                                     shared_ptr<kafka_event_consumer> loop_consumer, shared_ptr<traffic_recorder> recorder) {
+    if(!producer || !connections || !tokens || !compressor || !channels || !local_deliveries || !aoi || !deltas || !workers) {
         LOG(ERROR) << NAMEOF(create_uws_thread) << " one of the arguments are null";
         throw runtime_error("[main:uws] one of the arguments are null");
     }
 
     return make_unique<thread>([=, &h]{
         try {
+            // placed before anything below allocates, so the loop's state lands on the node it runs on
+            place_current_thread("roa-uws", config.uws_thread_cpus);
+
             message_dispatcher<false> client_msg_dispatcher;
 
-            client_msg_dispatcher.register_handler<client_admin_quit_handler>(config, producer);
-            client_msg_dispatcher.register_handler<client_login_handler>(config, producer);
-            client_msg_dispatcher.register_handler<client_register_handler>(config, producer);
-            client_msg_dispatcher.register_handler<client_chat_send_handler>(config, producer);
-            client_msg_dispatcher.register_handler<client_create_character_handler>(config, producer);
-            client_msg_dispatcher.register_handler<client_get_characters_handler>(config, producer);
-            client_msg_dispatcher.register_handler<client_play_character_handler>(config, producer);
+            register_client_handlers(client_msg_dispatcher, config, producer, channels, local_deliveries, aoi);
+
+            client_resume_session_handler resume_handler(config, tokens, channels);
+            client_position_handler position_handler(config, producer, aoi);
+
+            // reused for every frame on this loop, keeps its capacity so steady state frames don't allocate
+            string str;
+            str.reserve(4096);
+            vector<pair<char const *, size_t>> batch;
+
+            auto remove_connection = [&](uWS::WebSocket<uWS::SERVER> *ws) {
+                auto connection_ptr = static_cast<user_connection *>(ws->getUserData());
+                if(connection_ptr == nullptr) {
+                    return;
+                }
+
+                auto connection_id = connection_ptr->connection_id;
+                if(unlikely(recorder != nullptr)) {
+                    recorder->record(traffic_record_kind::DISCONNECT, connection_id);
+                }
+                ws->setUserData(nullptr);
+                channels->unsubscribe_all(*connection_ptr);
+                aoi->remove(connection_id);
+                deltas->remove(connection_id);
+                outbound_frames().remove(connection_id);
+                connections->erase(connection_id);
+            };
+
+            // throws on malformed messages, the caller disconnects
+            auto handle_client_message = [&](char const *data, size_t length, user_connection &connection) {
+                auto type = peek_message_type(data, length);
+                if(unlikely(!type)) {
+                    throw runtime_error("message without type");
+                }
+
+                if(is_gateway_message(type.value())) {
+                    if(type.value() == client_resume_session_handler::message_id) {
+                        str.assign(data, length);
+                        auto resume_msg = resume_session_message::deserialize(json::parse(str));
+                        if(resume_msg) {
+                            resume_handler.handle_message(resume_msg.value(), connection);
+                        }
+                    } else if(type.value() == snapshot_ack_message::id) {
+                        str.assign(data, length);
+                        auto ack_msg = snapshot_ack_message::deserialize(json::parse(str));
+                        if(ack_msg) {
+                            deltas->acknowledge(connection.connection_id, ack_msg->stream, ack_msg->sequence);
+                        }
+                    } else if(type.value() == client_position_handler::message_id) {
+                        str.assign(data, length);
+                        auto position_msg = position_message::deserialize(json::parse(str));
+                        if(position_msg) {
+                            position_handler.handle_message(position_msg.value(), connection);
+                        }
+                    }
+                    return;
+                }
+
+                // unknown types and messages the connection isn't allowed to send yet are dropped before parsing
+                if(!client_msg_dispatcher.admits(type.value(), make_optional(ref(connection)))) {
+                    return;
+                }
+
+                str.assign(data, length);
+                LOG(DEBUG) << NAMEOF(create_uws_thread) << " " << str;
+
+                auto msg = message<true>::deserialize<false>(str);
+                if (get<1>(msg)) {
+                    client_msg_dispatcher.trigger_handler(move(msg), make_optional(ref(connection)));
+                }
+            };
 
             h.onMessage([&](uWS::WebSocket<uWS::SERVER> *ws, char *recv_msg, size_t length, uWS::OpCode opCode) {
                 LOG(DEBUG) << NAMEOF(create_uws_thread) << " Got message from wss";
                 if(opCode == uWS::OpCode::TEXT) {
                     LOG(INFO) << NAMEOF(create_uws_thread) << " Got message from wss";
-                    string str(recv_msg, length);
-                    LOG(DEBUG) << NAMEOF(create_uws_thread) << " " << str;
-                    user_connection connection;
 
-                    string key = user_connection::AddressToString(ws->getAddress());
-
-                    if(unlikely(!connections->find(key, connection))) {
-                        LOG(ERROR) << NAMEOF(create_uws_thread) << " got message from " << key << " without connection";
+                    // owned by the connection table until onDisconnection, which runs on this thread
+                    auto connection_ptr = static_cast<user_connection *>(ws->getUserData());
+                    if(unlikely(connection_ptr == nullptr)) {
+                        LOG(ERROR) << NAMEOF(create_uws_thread) << " got message from " << user_connection::AddressToString(ws->getAddress()) << " without connection";
                         ws->terminate();
                         return;
                     }
 
+                    auto &connection = *connection_ptr;
+                    if(unlikely(recorder != nullptr)) {
+                        recorder->record(traffic_record_kind::WS_FRAME, connection.connection_id, recv_msg, static_cast<uint32_t>(length), static_cast<uint8_t>(opCode));
+                    }
+
+                    epoch_guard guard(session_reclaimer());
+
                     try {
-                        auto msg = message<true>::deserialize<false>(str);
-                        if (get<1>(msg)) {
-                            client_msg_dispatcher.trigger_handler(msg, make_optional(ref(connection)));
+                        // whether uWS checks text frames depends on the version it's built from, the parsers expect UTF-8
+                        if(unlikely(!is_valid_utf8(recv_msg, length))) {
+                            throw runtime_error("invalid utf-8");
+                        }
+
+                        // one pass over a batch frame, each message is gated and dispatched like a frame of its own
+                        auto split = split_message_batch(recv_msg, length, batch);
+                        if(unlikely(split == message_batch::MALFORMED)) {
+                            throw runtime_error("malformed batch");
+                        }
+
+                        if(split == message_batch::BATCH) {
+                            for(auto const &batched : batch) {
+                                handle_client_message(batched.first, batched.second, connection);
+                            }
+                        } else {
+                            handle_client_message(recv_msg, length, connection);
                         }
                     } catch(const std::exception& e) {
                         LOG(ERROR) << NAMEOF(create_uws_thread)
-                                   << " exception when deserializing message, disconnecting " << connection.state
-                                   << ":" << connection.username << ":exception: " << typeid(e).name() << "-" << e.what();
+                                   << " exception when deserializing message, disconnecting " << connection.session()->state
+                                   << ":" << connection.session()->username << ":exception: " << typeid(e).name() << "-" << e.what();
 
-                        connections->erase(key);
+                        remove_connection(ws);
                         ws->terminate();
                     }
                 } else {
@@ -215,21 +640,21 @@ unique_ptr<thread> create_uws_thread(Config config, uWS::Hub &h, shared_ptr<ikaf
                 }
             });
 
-            h.onConnection([&connections](uWS::WebSocket<uWS::SERVER> *ws, uWS::HttpRequest request) {
+            h.onConnection([&connections, &compressor, &deltas, &recorder](uWS::WebSocket<uWS::SERVER> *ws, uWS::HttpRequest request) {
                 LOG(WARNING) << NAMEOF(create_uws_thread) << " Got a connection";
-                string key = user_connection::AddressToString(ws->getAddress());
-                if(connections->contains(key)) {
-                    LOG(WARNING) << NAMEOF(create_uws_thread) << " Connection already present, closing this one";
-                    ws->terminate();
-                    return;
+                auto connection = make_shared<user_connection>(ws);
+                connection->compression = compressor->negotiated_mode(request);
+                ws->setUserData(connection.get());
+                outbound_frames().add(*connection);
+                deltas->add(connection->connection_id);
+                if(unlikely(recorder != nullptr)) {
+                    recorder->record(traffic_record_kind::CONNECT, connection->connection_id);
                 }
-                connections->insert(key, user_connection(ws));
+                connections->insert(move(connection));
             });
 
-            h.onDisconnection([&connections](uWS::WebSocket<uWS::SERVER> *ws, int code, char *message, size_t length) {
-
-                string key = user_connection::AddressToString(ws->getAddress());
-                connections->erase(key);
+            h.onDisconnection([&](uWS::WebSocket<uWS::SERVER> *ws, int code, char *message, size_t length) {
+                remove_connection(ws);
 
                 LOG(WARNING) << NAMEOF(create_uws_thread) << " Got a disconnect, " << connections->size() << " connections remaining";
             });
@@ -245,6 +670,23 @@ unique_ptr<thread> create_uws_thread(Config config, uWS::Hub &h, shared_ptr<ikaf
                 return;
             }
 
+            outbound_frames().start(h.getLoop(), config.outbound_flush_interval_ms, outbound_limits{
+                    {config.outbound_control_queue_bytes, config.outbound_chat_queue_bytes, config.outbound_bulk_queue_bytes},
+                    config.outbound_bulk_bytes_per_flush
+            });
+
+            // only used when kafka is consumed on this loop, handlers then run on the thread owning the sockets
+            message_dispatcher<false> server_gateway_msg_dispatcher;
+            if(loop_consumer) {
+                register_gateway_handlers(server_gateway_msg_dispatcher, config, &quit, tokens, compressor, channels, local_deliveries, deltas, workers);
+                loop_consumer->start(h.getLoop(), [&](tuple<uint32_t, unique_ptr<message<false> const>> msg) {
+                    dispatch_gateway_message(server_gateway_msg_dispatcher, *connections, recorder.get(), move(msg));
+                }, [&](char const *data, size_t length) {
+                    return deliver_multicast(config, *connections, *channels, *aoi, recorder.get(), data, length) ||
+                           dispatch_gateway_view(server_gateway_msg_dispatcher, *connections, recorder.get(), data, length);
+                });
+            }
+
             LOG(INFO) << NAMEOF(create_uws_thread) << " starting create_uws_thread";
 
             h.run();
@@ -256,27 +698,20 @@ unique_ptr<thread> create_uws_thread(Config config, uWS::Hub &h, shared_ptr<ikaf
     });
 }
 
-unique_ptr<thread> create_consumer_thread(Config config, shared_ptr<ikafka_consumer<false>> consumer, shared_ptr<cuckoohash_map<string, user_connection>> connections) {
-    if(!consumer) {
+unique_ptr<thread> create_consumer_thread(Config config, shared_ptr<ikafka_consumer<false>> consumer, shared_ptr<connection_registry> connections,
+                                          shared_ptr<resume_token_manager> tokens, shared_ptr<payload_compressor> compressor,
+                                          shared_ptr<chat_channel_registry> channels, shared_ptr<local_chat_deliveries> local_deliveries,
+                                          shared_ptr<snapshot_deltas> deltas, shared_ptr<worker_pool> workers, shared_ptr<traffic_recorder> recorder) {
+    if(!consumer || !connections || !tokens || !compressor || !channels || !local_deliveries || !deltas || !workers) {
         LOG(ERROR) << NAMEOF(create_consumer_thread) << " one of the arguments are null";
         throw runtime_error("[main:consumer] one of the arguments are null");
     }
 
     return make_unique<thread>([=] {
-        consumer->start(config.broker_list, config.group_id, std::vector<std::string>{
-                "server-" + to_string(config.server_id),
-                "chat_messages",
-                "broadcast"},
-                50);
+        place_current_thread("roa-consumer", config.consumer_thread_cpus);
+        consumer->start(config.broker_list, config.group_id, consumer_topics(config), 50);
         message_dispatcher<false> server_gateway_msg_dispatcher;
-
-        server_gateway_msg_dispatcher.register_handler<gateway_quit_handler>(&quit);
-        server_gateway_msg_dispatcher.register_handler<gateway_login_response_handler>(config);
-        server_gateway_msg_dispatcher.register_handler<gateway_register_response_handler>(config);
-        server_gateway_msg_dispatcher.register_handler<gateway_chat_send_handler>(config, connections);
-        server_gateway_msg_dispatcher.register_handler<gateway_error_response_handler>(config);
-        server_gateway_msg_dispatcher.register_handler<gateway_send_map_handler>(config);
-        server_gateway_msg_dispatcher.register_handler<gateway_get_characters_response_handler>(config);
+        register_gateway_handlers(server_gateway_msg_dispatcher, config, &quit, tokens, compressor, channels, local_deliveries, deltas, workers);
 
         LOG(INFO) << NAMEOF(create_consumer_thread) << " starting consumer thread";
 
@@ -284,24 +719,7 @@ unique_ptr<thread> create_consumer_thread(Config config, shared_ptr<ikafka_consu
             try {
                 auto msg = consumer->try_get_message(50);
                 if (get<1>(msg)) {
-                    LOG(INFO) << NAMEOF(create_consumer_thread) << " Got message from kafka";
-
-                    auto id = get<1>(msg)->sender.client_id;
-                    auto locked_table = (*connections).lock_table();
-                    auto connection = find_if(begin(locked_table), end(locked_table), [id](auto &t) {
-                        return get<1>(t).connection_id == id;
-                    });
-
-                    if (connection == end(locked_table)) {
-                        LOG(DEBUG) << NAMEOF(create_consumer_thread) << " Got message for client_id " << id << " but no connection found";
-                        continue;
-                    }
-
-                    locked_table.unlock();
-
-                    server_gateway_msg_dispatcher.trigger_handler(msg, make_optional(ref(get<1>(*connection))));
-
-                    LOG(DEBUG) << NAMEOF(create_consumer_thread) << " done handling message";
+                    dispatch_gateway_message(server_gateway_msg_dispatcher, *connections, recorder.get(), move(msg));
                 }
             } catch (serialization_exception &e) {
                 LOG(ERROR) << NAMEOF(create_consumer_thread) << " received serialization exception " << e.what();
@@ -312,6 +730,11 @@ unique_ptr<thread> create_consumer_thread(Config config, shared_ptr<ikafka_consu
     });
 }
 
+struct uws_shutdown {
+    uWS::Hub *hub;
+    kafka_event_consumer *loop_consumer;
+};
+
 int main() {
     Config config;
     try {
@@ -330,21 +753,54 @@ int main() {
 
     auto common_injector = create_common_di_injector();
 
-    auto producer = common_injector.create<shared_ptr<ikafka_producer<false>>>();
+    auto producer = make_shared<partitioned_producer>(common_injector.create<shared_ptr<ikafka_producer<false>>>(), config.kafka_partition_keys,
+                                                     config.kafka_packing_linger_ms, config.kafka_packing_max_bytes);
     auto consumer = common_injector.create<shared_ptr<ikafka_consumer<false>>>();
+    shared_ptr<kafka_event_consumer> loop_consumer;
+    if(config.kafka_event_loop_consumer) {
+        loop_consumer = make_shared<kafka_event_consumer>(config.broker_list, config.group_id, consumer_topics(config));
+    }
 
-    auto connections = make_shared<cuckoohash_map<string, user_connection>>();
-    uWS::Hub h;
+    auto connections = make_shared<connection_registry>(config.connection_shards);
+    auto tokens = make_shared<resume_token_manager>(config.resume_token_secret, chrono::seconds(config.resume_token_ttl_seconds));
+    auto compressor = make_shared<payload_compressor>(config.compression_level, config.compression_threshold,
+                                                      load_compression_dictionary(config), config.compression_cache_entries);
+    auto channels = make_shared<chat_channel_registry>();
+    auto local_deliveries = make_shared<local_chat_deliveries>(chrono::seconds(30));
+    auto aoi = make_shared<area_of_interest>(config.aoi_cell_size, config.aoi_radius);
+    auto deltas = make_shared<snapshot_deltas>(config.snapshot_delta_history, vector<uint32_t>{gateway_send_map_handler::message_id});
+    auto workers = make_shared<worker_pool>(config.serialization_workers, config.serialization_worker_cpus);
+    shared_ptr<traffic_recorder> recorder;
+    if(!config.traffic_capture_file.empty()) {
+        try {
+            recorder = make_shared<traffic_recorder>(config.traffic_capture_file, config.traffic_capture_max_bytes);
+        } catch (const runtime_error& e) {
+            return 1;
+        }
+    }
+    uWS::Hub h(compressor->extension_options());
 
     try {
         LOG(INFO) << NAMEOF(main) << " starting main thread";
         producer->start(config.broker_list, 50);
-        auto uws_thread = create_uws_thread(config, h, producer, connections);
-        auto consumer_thread = create_consumer_thread(config, consumer, connections);
+        auto uws_thread = create_uws_thread(config, h, producer, connections, tokens, compressor, channels, local_deliveries, aoi, deltas, workers, loop_consumer, recorder);
+        unique_ptr<thread> consumer_thread;
+        if(!loop_consumer) {
+            consumer_thread = create_consumer_thread(config, consumer, connections, tokens, compressor, channels, local_deliveries, deltas, workers, recorder);
+        }
+        auto next_token_purge = chrono::steady_clock::now() + tokens->ttl();
+
+        // only now, threads created before this, ours and librdkafka's, would otherwise inherit main's cpus
+        place_current_thread("roa-main", config.main_thread_cpus);
 
         while (!quit) {
             try {
                 producer->poll(50);
+
+                if(tokens->enabled() && chrono::steady_clock::now() > next_token_purge) {
+                    tokens->purge_expired();
+                    next_token_purge = chrono::steady_clock::now() + tokens->ttl();
+                }
             } catch (serialization_exception &e) {
                 LOG(ERROR) << NAMEOF(main) << " received exception " << e.what();
             }
@@ -354,16 +810,23 @@ int main() {
 
         auto loop = h.getLoop();
         auto closeLambda = [](Async *as) -> void {
-            uWS::Hub *hub = static_cast<uWS::Hub *>(as->data);
-            hub->getLoop()->destroy();
+            auto shutdown = static_cast<uws_shutdown *>(as->data);
+            if(shutdown->loop_consumer != nullptr) {
+                shutdown->loop_consumer->stop();
+            }
+            outbound_frames().stop();
+            shutdown->hub->getLoop()->destroy();
         };
+        uws_shutdown shutdown{&h, loop_consumer.get()};
         Async async{loop};
-        async.setData(&h);
+        async.setData(&shutdown);
         async.start(closeLambda);
         async.send();
 
         producer->close();
-        consumer->close();
+        if(!loop_consumer) {
+            consumer->close();
+        }
         LOG(INFO) << NAMEOF(main) << " closed kafka connections";
 
         auto now = chrono::system_clock::now().time_since_epoch().count();
@@ -378,8 +841,10 @@ int main() {
         LOG(INFO) << NAMEOF(main) << " closing async";
         async.close();
 
-        LOG(INFO) << NAMEOF(main) << " joining consumer thread";
-        consumer_thread->join();
+        if(consumer_thread) {
+            LOG(INFO) << NAMEOF(main) << " joining consumer thread";
+            consumer_thread->join();
+        }
 
         if(!uwsQuit) {
             LOG(INFO) << NAMEOF(main) << " detaching uws thread";
@@ -23,25 +23,33 @@
 using namespace std;
 using namespace roa;
 
-client_admin_quit_handler::client_admin_quit_handler(Config config, std::shared_ptr<ikafka_producer<false>> producer)
+client_admin_quit_handler::client_admin_quit_handler(Config config, std::shared_ptr<partitioned_producer> producer)
         : _config(config), _producer(producer) {
 
 }
 
-void client_admin_quit_handler::handle_message(const unique_ptr<const binary_message> &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+bool client_admin_quit_handler::admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
-        LOG(ERROR) << NAMEOF(client_admin_quit_handler::handle_message) << " received empty connection";
-        return;
+        LOG(ERROR) << NAMEOF(client_admin_quit_handler::admit) << " received empty connection";
+        return false;
+    }
+
+    if(connection->get().session()->admin_status != 1) {
+        LOG(WARNING) << NAMEOF(client_admin_quit_handler::admit) << " received unauthorized quit message";
+        return false;
     }
 
-    if(connection->get().admin_status != 1) {
-        LOG(WARNING) << NAMEOF(client_admin_quit_handler::handle_message) << " received unauthorized quit message";
+    return true;
+}
+
+void client_admin_quit_handler::handle_message(unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+    if(!admit(connection)) {
         return;
     }
 
     if (auto quit_msg = dynamic_cast<binary_quit_message const *>(msg.get())) {
         LOG(WARNING) << NAMEOF(client_admin_quit_handler::handle_message) << " Got authorized binary_quit_message from wss, sending quit message to kafka";
-        this->_producer->enqueue_message("broadcast", quit_msg);
+        this->_producer->enqueue_message("broadcast", connection->get().session()->user_id, quit_msg);
     }
 }
 
@@ -19,7 +19,7 @@
 #pragma once
 
 #include "../message_dispatcher.h"
-#include <kafka_producer.h>
+#include "src/partitioned_producer.h"
 #include "../../config.h"
 
 #include <admin_messages/admin_quit_message.h>
@@ -27,14 +27,15 @@
 namespace roa {
     class client_admin_quit_handler : public imessage_handler<false> {
     public:
-        explicit client_admin_quit_handler(Config config, std::shared_ptr<ikafka_producer<false>> producer);
+        explicit client_admin_quit_handler(Config config, std::shared_ptr<partitioned_producer> producer);
         ~client_admin_quit_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        bool admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_quit_message::id;
     private:
         Config _config;
-        std::shared_ptr<ikafka_producer<false>> _producer;
+        std::shared_ptr<partitioned_producer> _producer;
     };
 }
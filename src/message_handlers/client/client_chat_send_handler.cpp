@@ -17,52 +17,94 @@
 */
 
 #include "client_chat_send_handler.h"
+#include "src/outbound_coalescer.h"
 #include <macros.h>
 #include <messages/error_response_message.h>
+#include "src/gateway_messages/response_writers.h"
 #include <easylogging++.h>
 
 using namespace std;
 using namespace roa;
 
 client_chat_send_handler::client_chat_send_handler(Config config,
-                                                        shared_ptr<ikafka_producer<false>> producer)
-    : _config(config), _producer(producer) {
-
+                                                        shared_ptr<partitioned_producer> producer,
+                                                        shared_ptr<chat_channel_registry> channels,
+                                                        shared_ptr<local_chat_deliveries> local_deliveries)
+    : _config(config), _producer(producer), _channels(channels), _local_deliveries(local_deliveries) {
+    if(!_channels || !_local_deliveries) {
+        LOG(ERROR) << NAMEOF(client_chat_send_handler::client_chat_send_handler) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
 }
 
-void client_chat_send_handler::handle_message(unique_ptr<binary_message const> const &msg,
-                                                   STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+bool client_chat_send_handler::admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
-        LOG(ERROR) << NAMEOF(client_chat_send_handler::handle_message) << " received empty connection";
-        return;
+        LOG(ERROR) << NAMEOF(client_chat_send_handler::admit) << " received empty connection";
+        return false;
     }
 
-    if(connection->get().state != user_connection_state::LOGGED_IN) {
-        LOG(DEBUG) << NAMEOF(client_chat_send_handler::handle_message) << " not logged in.";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Need to login."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+    auto session = connection->get().session();
+    if(session->state != user_connection_state::LOGGED_IN) {
+        LOG(DEBUG) << NAMEOF(client_chat_send_handler::admit) << " not logged in.";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Need to login."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
+        return false;
+    }
+
+    return true;
+}
+
+void client_chat_send_handler::handle_message(unique_ptr<binary_message> msg,
+                                                   STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+    if(!admit(connection)) {
         return;
     }
 
-    if (auto message = dynamic_cast<binary_chat_send_message const *>(msg.get())) {
+    auto session = connection->get().session();
+
+    if (auto message = dynamic_cast<binary_chat_send_message *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(client_chat_send_handler::handle_message) << " Got binary_chat_send_message message from wss";
-        this->_producer->enqueue_message("chat_messages", binary_chat_send_message {
+
+        // channel and user names are written into a buffer reused per thread instead of concatenated per message
+        thread_local string channel;
+        bool channel_target = chat_channel_registry::is_channel_target(message->target);
+
+        // only "all" is open to everyone, other channels require being subscribed, which keeps non-admins out of the admin channel
+        if(channel_target && message->target != chat_channel_registry::all_channel) {
+            chat_channel_registry::channel_from_target(message->target, channel);
+            if(!_channels->is_subscribed(channel, connection->get().connection_id)) {
+                static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Not a member of that channel."}.serialize();
+                outbound_frames().send(connection->get(), response_str);
+                return;
+            }
+        }
+
+        // whisper to someone on this gateway, deliver right away, kafka still gets it for other gateways and auditing
+        if(_config.local_chat_delivery && !channel_target) {
+            outbound_buffer chat;
+            auto &chat_str = chat.str();
+            write_chat_receive(chat_str, session->username, message->target, message->message);
+            chat_channel_registry::user_channel(message->target, channel);
+            if(_channels->broadcast(channel, chat_str) > 0) {
+                _local_deliveries->mark(session->username, message->target, message->message);
+            }
+        }
+
+        this->_producer->enqueue_message("chat_messages", connection->get().session()->user_id, binary_chat_send_message {
                 {
                         false,
                         connection->get().connection_id,
                         _config.server_id,
                         0 // ANY
                 },
-                connection->get().username,
-                message->target,
-                message->message
+                session->username,
+                move(message->target),
+                move(message->message)
         });
     } else {
         LOG(ERROR) << NAMEOF(client_chat_send_handler::handle_message) << " Couldn't cast message to binary_chat_send_message";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Something went wrong."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
     }
 }
 
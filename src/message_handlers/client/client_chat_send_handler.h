@@ -19,8 +19,10 @@
 #pragma once
 
 #include "../message_dispatcher.h"
-#include <kafka_producer.h>
+#include "src/partitioned_producer.h"
 #include "src/user_connection.h"
+#include "src/chat_channel_registry.h"
+#include "src/local_chat_deliveries.h"
 #include "../../config.h"
 
 #include <messages/chat/chat_send_message.h>
@@ -29,14 +31,19 @@ namespace roa {
     class client_chat_send_handler : public imessage_handler<false> {
     public:
         explicit client_chat_send_handler(Config config,
-                             std::shared_ptr<ikafka_producer<false>> producer);
+                             std::shared_ptr<partitioned_producer> producer,
+                             std::shared_ptr<chat_channel_registry> channels,
+                             std::shared_ptr<local_chat_deliveries> local_deliveries);
         ~client_chat_send_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        bool admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_chat_send_message::id;
     private:
         Config _config;
-        std::shared_ptr<ikafka_producer<false>> _producer;
+        std::shared_ptr<partitioned_producer> _producer;
+        std::shared_ptr<chat_channel_registry> _channels;
+        std::shared_ptr<local_chat_deliveries> _local_deliveries;
     };
 }
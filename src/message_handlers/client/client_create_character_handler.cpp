@@ -17,6 +17,7 @@
 */
 
 #include "client_create_character_handler.h"
+#include "src/outbound_coalescer.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/error_response_message.h>
@@ -25,42 +26,51 @@ using namespace std;
 using namespace roa;
 
 client_create_character_handler::client_create_character_handler(Config config,
-                                           shared_ptr<ikafka_producer<false>> producer)
+                                           shared_ptr<partitioned_producer> producer)
         : _config(config), _producer(producer) {
 
 }
 
-void client_create_character_handler::handle_message(unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+bool client_create_character_handler::admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
-        LOG(ERROR) << NAMEOF(client_create_character_handler::handle_message) << " received empty connection";
-        return;
+        LOG(ERROR) << NAMEOF(client_create_character_handler::admit) << " received empty connection";
+        return false;
+    }
+
+    auto session = connection->get().session();
+    if(session->state != user_connection_state::LOGGED_IN) {
+        LOG(DEBUG) << NAMEOF(client_create_character_handler::admit) << " not logged in.";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Need to login."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
+        return false;
     }
 
-    if(connection->get().state != user_connection_state::LOGGED_IN) {
-        LOG(DEBUG) << NAMEOF(client_create_character_handler::handle_message) << " not logged in.";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Need to login."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+    return true;
+}
+
+void client_create_character_handler::handle_message(unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+    if(!admit(connection)) {
         return;
     }
 
-    if (auto message = dynamic_cast<binary_create_character_message const *>(msg.get())) {
+    auto session = connection->get().session();
+
+    if (auto message = dynamic_cast<binary_create_character_message *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(client_create_character_handler::handle_message) << " Got binary_create_character_message from wss";
-        this->_producer->enqueue_message("backend_messages", binary_create_character_message {
+        this->_producer->enqueue_message("backend_messages", connection->get().session()->user_id, binary_create_character_message {
                 {
                         false,
                         connection->get().connection_id,
                         _config.server_id,
                         0 // ANY
                 },
-                connection->get().user_id,
-                message->player_name
+                session->user_id,
+                move(message->player_name)
         });
     } else {
         LOG(ERROR) << NAMEOF(client_create_character_handler::handle_message) << " Couldn't cast message to binary_create_character_message";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Something went wrong."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
     }
 }
 
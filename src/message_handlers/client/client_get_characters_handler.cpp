@@ -17,6 +17,7 @@
 */
 
 #include "client_get_characters_handler.h"
+#include "src/outbound_coalescer.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/error_response_message.h>
@@ -25,43 +26,54 @@ using namespace std;
 using namespace roa;
 
 client_get_characters_handler::client_get_characters_handler(Config config,
-                                           shared_ptr<ikafka_producer<false>> producer)
+                                           shared_ptr<partitioned_producer> producer)
         : _config(config), _producer(producer) {
 
 }
 
-void client_get_characters_handler::handle_message(unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+bool client_get_characters_handler::admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
-        LOG(ERROR) << NAMEOF(client_get_characters_handler::handle_message) << " received empty connection";
-        return;
+        LOG(ERROR) << NAMEOF(client_get_characters_handler::admit) << " received empty connection";
+        return false;
+    }
+
+    auto session = connection->get().session();
+    if(session->state != user_connection_state::LOGGED_IN) {
+        LOG(DEBUG) << NAMEOF(client_get_characters_handler::admit) << " not logged in.";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Need to login."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
+        return false;
     }
 
-    if(connection->get().state != user_connection_state::LOGGED_IN) {
-        LOG(DEBUG) << NAMEOF(client_get_characters_handler::handle_message) << " not logged in.";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Need to login."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+    return true;
+}
+
+void client_get_characters_handler::handle_message(unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+    if(!admit(connection)) {
         return;
     }
 
+    auto session = connection->get().session();
+
     if (auto message = dynamic_cast<binary_get_characters_message const *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(client_get_characters_handler::handle_message) << " Got binary_get_characters_message from wss";
 
-        connection->get().player_characters.clear();
-        this->_producer->enqueue_message("world_messages", binary_get_characters_message {
+        connection->get().update_session([](session_state &updated) {
+            updated.player_characters.clear();
+        });
+        this->_producer->enqueue_message("world_messages", connection->get().session()->user_id, binary_get_characters_message {
                 {
                         false,
                         connection->get().connection_id,
                         _config.server_id,
                         0 // ANY
                 },
-                connection->get().user_id
+                session->user_id
         });
     } else {
         LOG(ERROR) << NAMEOF(client_get_characters_handler::handle_message) << " Couldn't cast message to binary_get_characters_message";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Something went wrong."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
     }
 }
 
@@ -19,7 +19,7 @@
 #pragma once
 
 #include "../message_dispatcher.h"
-#include <kafka_producer.h>
+#include "src/partitioned_producer.h"
 #include "src/user_connection.h"
 #include "../../config.h"
 
@@ -29,14 +29,15 @@ namespace roa {
     class client_login_handler : public imessage_handler<false> {
     public:
         explicit client_login_handler(Config config,
-                             std::shared_ptr<ikafka_producer<false>> producer);
+                             std::shared_ptr<partitioned_producer> producer);
         ~client_login_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        bool admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_login_message::id;
     private:
         Config _config;
-        std::shared_ptr<ikafka_producer<false>> _producer;
+        std::shared_ptr<partitioned_producer> _producer;
     };
 }
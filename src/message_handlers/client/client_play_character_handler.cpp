@@ -17,6 +17,7 @@
 */
 
 #include "client_play_character_handler.h"
+#include "src/outbound_coalescer.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/error_response_message.h>
@@ -25,59 +26,79 @@ using namespace std;
 using namespace roa;
 
 client_play_character_handler::client_play_character_handler(Config config,
-                                           shared_ptr<ikafka_producer<false>> producer)
-        : _config(config), _producer(producer) {
-
+                                           shared_ptr<partitioned_producer> producer,
+                                           shared_ptr<chat_channel_registry> channels,
+                                           shared_ptr<area_of_interest> aoi)
+        : _config(config), _producer(producer), _channels(channels), _aoi(aoi) {
+    if(!_channels || !_aoi) {
+        LOG(ERROR) << NAMEOF(client_play_character_handler::client_play_character_handler) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
 }
 
-void client_play_character_handler::handle_message(unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+bool client_play_character_handler::admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
-        LOG(ERROR) << NAMEOF(client_play_character_handler::handle_message) << " received empty connection";
-        return;
+        LOG(ERROR) << NAMEOF(client_play_character_handler::admit) << " received empty connection";
+        return false;
+    }
+
+    auto session = connection->get().session();
+    if(session->state != user_connection_state::LOGGED_IN) {
+        LOG(DEBUG) << NAMEOF(client_play_character_handler::admit) << " not logged in.";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Need to login."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
+        return false;
     }
 
-    if(connection->get().state != user_connection_state::LOGGED_IN) {
-        LOG(DEBUG) << NAMEOF(client_play_character_handler::handle_message) << " not logged in.";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Need to login."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+    return true;
+}
+
+void client_play_character_handler::handle_message(unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+    if(!admit(connection)) {
         return;
     }
 
-    if (auto message = dynamic_cast<binary_play_character_message const *>(msg.get())) {
+    auto session = connection->get().session();
 
-        LOG(INFO) << "owned players: " << connection->get().player_characters.size();
-        for(auto& plyr : connection->get().player_characters) {
+    if (auto message = dynamic_cast<binary_play_character_message *>(msg.get())) {
+
+        LOG(INFO) << "owned players: " << session->player_characters.size();
+        for(auto& plyr : session->player_characters) {
             LOG(INFO) << plyr.id << " - " << plyr.player_name;
         }
 
-        auto player = find_if(cbegin(connection->get().player_characters), cend(connection->get().player_characters), [&](auto& t) {
+        auto player = find_if(cbegin(session->player_characters), cend(session->player_characters), [&](auto& t) {
            return t.player_name == message->player_name;
         });
 
-        if(player == cend(connection->get().player_characters)) {
-            json_error_response_message response{{false, 0, 0, 0}, -1, "No player by that name that you own."};
-            auto response_str = response.serialize();
-            connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        if(player == cend(session->player_characters)) {
+            static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "No player by that name that you own."}.serialize();
+            outbound_frames().send(connection->get(), response_str);
             return;
         }
 
         LOG(DEBUG) << NAMEOF(client_play_character_handler::handle_message) << " Got binary_play_character_message from wss";
-        this->_producer->enqueue_message("server-" + to_string(player->server_id), binary_play_character_message {
+        _channels->subscribe_exclusive(chat_channel_registry::map_channel(player->map_name).str(), connection->get());
+        _channels->subscribe_exclusive(chat_channel_registry::world_channel(player->world_name).str(), connection->get());
+        connection->get().update_session([&](session_state &updated) {
+            updated.player_id = player->id;
+        });
+        // the world server owns spawn positions, the connection sits at the map origin until it reports one
+        _aoi->place(connection->get(), player->map_name, 0, 0);
+        this->_producer->enqueue_message(server_topic(player->server_id).str(), connection->get().session()->user_id, binary_play_character_message {
                 {
                         false,
                         connection->get().connection_id,
                         _config.server_id,
                         0 // ANY
                 },
-                connection->get().user_id,
-                message->player_name
+                session->user_id,
+                move(message->player_name)
         });
     } else {
         LOG(ERROR) << NAMEOF(client_play_character_handler::handle_message) << " Couldn't cast message to binary_play_character_message";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Something went wrong."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
     }
 }
 
@@ -19,8 +19,10 @@
 #pragma once
 
 #include "../message_dispatcher.h"
-#include <kafka_producer.h>
+#include "src/partitioned_producer.h"
 #include "src/user_connection.h"
+#include "src/chat_channel_registry.h"
+#include "src/area_of_interest.h"
 #include "../../config.h"
 
 #include <messages/user_access_control/play_character_message.h>
@@ -29,14 +31,19 @@ namespace roa {
     class client_play_character_handler : public imessage_handler<false> {
     public:
         explicit client_play_character_handler(Config config,
-                             std::shared_ptr<ikafka_producer<false>> producer);
+                             std::shared_ptr<partitioned_producer> producer,
+                             std::shared_ptr<chat_channel_registry> channels,
+                             std::shared_ptr<area_of_interest> aoi);
         ~client_play_character_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        bool admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_play_character_message::id;
     private:
         Config _config;
-        std::shared_ptr<ikafka_producer<false>> _producer;
+        std::shared_ptr<partitioned_producer> _producer;
+        std::shared_ptr<chat_channel_registry> _channels;
+        std::shared_ptr<area_of_interest> _aoi;
     };
 }
@@ -0,0 +1,83 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "client_position_handler.h"
+#include "src/kafka_message_view.h"
+#include <macros.h>
+#include <easylogging++.h>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+using namespace roa;
+
+client_position_handler::client_position_handler(Config config, shared_ptr<partitioned_producer> producer, shared_ptr<area_of_interest> aoi)
+        : _config(config), _producer(producer), _aoi(aoi) {
+    if(!_producer || !_aoi) {
+        LOG(ERROR) << NAMEOF(client_position_handler::client_position_handler) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
+}
+
+void client_position_handler::handle_message(position_message const &msg, user_connection &connection) {
+    auto session = connection.session();
+    if(session->state != user_connection_state::LOGGED_IN || session->player_id == 0) {
+        LOG(DEBUG) << NAMEOF(client_position_handler::handle_message) << " Got position_message from wss while not playing";
+        return;
+    }
+
+    if(!within_rate(connection)) {
+        LOG(DEBUG) << NAMEOF(client_position_handler::handle_message) << " connection " << connection.connection_id << " reports positions too often";
+        return;
+    }
+
+    // only connections placed by playing a character are on a map, the map itself never comes from the client
+    if(!_aoi->move(connection, msg.x, msg.y)) {
+        LOG(DEBUG) << NAMEOF(client_position_handler::handle_message) << " position " << msg.x << ", " << msg.y << " rejected";
+        return;
+    }
+
+    auto player = find_if(cbegin(session->player_characters), cend(session->player_characters), [&](player_character const &character) {
+        return character.id == session->player_id;
+    });
+    if(player == cend(session->player_characters)) {
+        return;
+    }
+
+    auto record = position_view::write({false, connection.connection_id, _config.server_id, 0}, session->player_id, msg.x, msg.y);
+    if(!_producer->enqueue_record(server_topic(player->server_id).str(), session->user_id, record)) {
+        LOG(DEBUG) << NAMEOF(client_position_handler::handle_message) << " positions only reach the world server with partition keys";
+    }
+}
+
+bool client_position_handler::within_rate(user_connection &connection) {
+    auto second = static_cast<uint32_t>(chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now().time_since_epoch()).count());
+    if(connection.position_window != second) {
+        connection.position_window = second;
+        connection.positions_in_window = 0;
+    }
+
+    if(connection.positions_in_window >= _config.position_updates_per_second) {
+        return false;
+    }
+
+    connection.positions_in_window++;
+    return true;
+}
+
+uint32_t constexpr client_position_handler::message_id;
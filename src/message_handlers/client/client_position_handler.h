@@ -0,0 +1,45 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "src/user_connection.h"
+#include "src/area_of_interest.h"
+#include "src/partitioned_producer.h"
+#include "src/gateway_messages/position_messages.h"
+#include "../../config.h"
+
+namespace roa {
+    // Positions are reported by the client, so they're never relayed to other clients from here. They move the area the
+    // connection hears about and go to the world server of the character, which validates them and tells the connections
+    // nearby with an area multicast envelope. Reports past position_updates_per_second are dropped.
+    class client_position_handler {
+    public:
+        explicit client_position_handler(Config config, std::shared_ptr<partitioned_producer> producer, std::shared_ptr<area_of_interest> aoi);
+
+        void handle_message(position_message const &msg, user_connection &connection);
+
+        static constexpr uint32_t message_id = position_message::id;
+    private:
+        bool within_rate(user_connection &connection);
+
+        Config _config;
+        std::shared_ptr<partitioned_producer> _producer;
+        std::shared_ptr<area_of_interest> _aoi;
+    };
+}
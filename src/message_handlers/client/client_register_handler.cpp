@@ -17,6 +17,7 @@
 */
 
 #include "client_register_handler.h"
+#include "src/outbound_coalescer.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/error_response_message.h>
@@ -25,52 +26,61 @@ using namespace std;
 using namespace roa;
 
 client_register_handler::client_register_handler(Config config,
-                                                 shared_ptr<ikafka_producer<false>> producer)
+                                                 shared_ptr<partitioned_producer> producer)
     : _config(config), _producer(producer) {
 
 }
 
-void client_register_handler::handle_message(unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+bool client_register_handler::admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
-        LOG(ERROR) << NAMEOF(client_register_handler::handle_message) << " received empty connection";
-        return;
+        LOG(ERROR) << NAMEOF(client_register_handler::admit) << " received empty connection";
+        return false;
     }
 
-    if(connection->get().state != user_connection_state::UNKNOWN) {
-        LOG(DEBUG) << NAMEOF(client_register_handler::handle_message) << " Got binary_register_message from wss while not in unknown connection state";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Already logged in or awaiting response on register request."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
-        return;
+    auto session = connection->get().session();
+    if(session->state != user_connection_state::UNKNOWN) {
+        LOG(DEBUG) << NAMEOF(client_register_handler::admit) << " Got binary_register_message from wss while not in unknown connection state";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Already logged in or awaiting response on register request."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
+        return false;
     }
 
-    if(connection->get().state == user_connection_state::REGISTERING_OR_LOGGING_IN) {
-        LOG(TRACE) << NAMEOF(client_register_handler::handle_message) << " dropping message";
+    if(session->state == user_connection_state::REGISTERING_OR_LOGGING_IN) {
+        LOG(TRACE) << NAMEOF(client_register_handler::admit) << " dropping message";
         // prevent DoS, creating password takes about 1 second
+        return false;
+    }
+
+    return true;
+}
+
+void client_register_handler::handle_message(unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+    if(!admit(connection)) {
         return;
     }
 
-    if (auto message = dynamic_cast<binary_register_message const *>(msg.get())) {
+    if (auto message = dynamic_cast<binary_register_message *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(client_register_handler::handle_message) << " Got binary_register_message from wss";
-        connection->get().username = message->username;
-        connection->get().state = user_connection_state::REGISTERING_OR_LOGGING_IN;
-        this->_producer->enqueue_message("backend_messages", binary_register_message {
+        connection->get().update_session([&](session_state &updated) {
+            updated.username = message->username;
+            updated.state = user_connection_state::REGISTERING_OR_LOGGING_IN;
+        });
+        this->_producer->enqueue_message("backend_messages", connection->get().connection_id, binary_register_message {
                 {
                     false,
                     connection->get().connection_id,
                     _config.server_id,
                     0 // ANY
                 },
-                message->username,
-                message->password,
-                message->email,
-                connection->get().ws->getAddress().address
+                move(message->username),
+                move(message->password),
+                move(message->email),
+                connection->get().remote_address()
         });
     } else {
         LOG(ERROR) << NAMEOF(client_register_handler::handle_message) << " Couldn't cast message to binary_register_message";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Something went wrong."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
     }
 }
 
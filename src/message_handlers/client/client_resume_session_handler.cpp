@@ -0,0 +1,78 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "client_resume_session_handler.h"
+#include "src/outbound_coalescer.h"
+#include <macros.h>
+#include <easylogging++.h>
+#include <messages/error_response_message.h>
+#include "src/gateway_messages/response_writers.h"
+
+using namespace std;
+using namespace roa;
+
+client_resume_session_handler::client_resume_session_handler(Config config,
+                                                             shared_ptr<resume_token_manager> tokens,
+                                                             shared_ptr<chat_channel_registry> channels)
+        : _config(config), _tokens(tokens), _channels(channels) {
+    if(!_tokens || !_channels) {
+        LOG(ERROR) << NAMEOF(client_resume_session_handler::client_resume_session_handler) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
+}
+
+void client_resume_session_handler::handle_message(resume_session_message const &msg, user_connection &connection) {
+    if(connection.session()->state != user_connection_state::UNKNOWN) {
+        LOG(DEBUG) << NAMEOF(client_resume_session_handler::handle_message) << " Got resume_session_message from wss while not in unknown connection state";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Already logged in or awaiting response on register request."}.serialize();
+        outbound_frames().send(connection, response_str);
+        return;
+    }
+
+    auto session = _tokens->redeem(msg.token);
+    if(!session) {
+        LOG(DEBUG) << NAMEOF(client_resume_session_handler::handle_message) << " invalid resume token";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Invalid or expired resume token."}.serialize();
+        outbound_frames().send(connection, response_str);
+        return;
+    }
+
+    LOG(DEBUG) << NAMEOF(client_resume_session_handler::handle_message) << " resuming session for user " << session->user_id;
+
+    // copied, not moved, update_session reruns this when another thread published in between
+    connection.update_session([&](session_state &updated) {
+        updated.state = user_connection_state::LOGGED_IN;
+        updated.admin_status = session->admin_status;
+        updated.user_id = session->user_id;
+        updated.username = session->username;
+        updated.player_characters = session->player_characters;
+    });
+
+    _channels->subscribe_logged_in(connection, *connection.session());
+
+    outbound_buffer response;
+    write_login_response(response.str(), session->admin_status, session->user_id);
+    outbound_frames().send(connection, response.str());
+
+    resume_token_message token_msg{_tokens->issue(*connection.session()), _tokens->ttl().count()};
+    outbound_buffer token;
+    token_msg.serialize(token.str());
+    outbound_frames().send(connection, token.str());
+}
+
+uint32_t constexpr client_resume_session_handler::message_id;
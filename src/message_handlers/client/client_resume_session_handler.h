@@ -0,0 +1,42 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "src/user_connection.h"
+#include "src/resume_token_manager.h"
+#include "src/chat_channel_registry.h"
+#include "src/gateway_messages/resume_session_message.h"
+#include "../../config.h"
+
+namespace roa {
+    class client_resume_session_handler {
+    public:
+        explicit client_resume_session_handler(Config config,
+                             std::shared_ptr<resume_token_manager> tokens,
+                             std::shared_ptr<chat_channel_registry> channels);
+
+        void handle_message(resume_session_message const &msg, user_connection &connection);
+
+        static constexpr uint32_t message_id = resume_session_message::id;
+    private:
+        Config _config;
+        std::shared_ptr<resume_token_manager> _tokens;
+        std::shared_ptr<chat_channel_registry> _channels;
+    };
+}
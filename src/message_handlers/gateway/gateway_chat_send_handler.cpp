@@ -17,6 +17,8 @@
 */
 
 #include "gateway_chat_send_handler.h"
+#include "src/kafka_message_view.h"
+#include "src/gateway_messages/response_writers.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/chat/chat_receive_message.h>
@@ -24,42 +26,74 @@
 using namespace std;
 using namespace roa;
 
-gateway_chat_send_handler::gateway_chat_send_handler(Config config, shared_ptr<cuckoohash_map<string, user_connection>> connections)
-        : _config(config), _connections(connections) {
-    if(!_connections) {
+gateway_chat_send_handler::gateway_chat_send_handler(Config config, shared_ptr<chat_channel_registry> channels,
+                                                     shared_ptr<local_chat_deliveries> local_deliveries)
+        : _config(config), _channels(channels), _local_deliveries(local_deliveries) {
+    if(!_channels || !_local_deliveries) {
         LOG(ERROR) << NAMEOF(gateway_chat_send_handler::handle_message) << " one of the arguments are null";
         throw runtime_error("one of the arguments are null");
     }
 }
 
-void gateway_chat_send_handler::handle_message(std::unique_ptr<binary_message const> const &msg,
+void gateway_chat_send_handler::handle_message(std::unique_ptr<binary_message> msg,
                                                   STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
     if (auto response_msg = dynamic_cast<binary_chat_send_message const *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(gateway_chat_send_handler::handle_message) << " Got response message from backend";
 
-        json_chat_receive_message chat_msg{{false, 0, 0, 0}, response_msg->from_username, response_msg->target, response_msg->message};
-        auto response_str = chat_msg.serialize();
+        if(_config.local_chat_delivery && response_msg->sender.server_origin_id == _config.server_id &&
+           !chat_channel_registry::is_channel_target(response_msg->target) &&
+           _local_deliveries->consume(response_msg->from_username, response_msg->target, response_msg->message)) {
+            LOG(DEBUG) << NAMEOF(gateway_chat_send_handler::handle_message) << " already delivered locally";
+            return;
+        }
 
-        auto locked_table = (*_connections).lock_table();
-        if(response_msg->target == "all") {
-            for(auto const& conn : locked_table) {
-                if(get<1>(conn).state == user_connection_state::LOGGED_IN) {
-                    get<1>(conn).ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
-                }
-            }
-        } else {
-            auto user_connection = find_if(cbegin(locked_table), cend(locked_table), [&](auto& t) {
-                return get<1>(t).username == response_msg->target && get<1>(t).state == user_connection_state ::LOGGED_IN;
-            });
+        outbound_buffer response;
+        auto &response_str = response.str();
+        write_chat_receive(response_str, response_msg->from_username, response_msg->target, response_msg->message);
 
-            if(user_connection != cend(locked_table)) {
-                user_connection->second.ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
-            }
+        thread_local string channel;
+        if(chat_channel_registry::is_channel_target(response_msg->target)) {
+            chat_channel_registry::channel_from_target(response_msg->target, channel);
+        } else {
+            chat_channel_registry::user_channel(response_msg->target, channel);
         }
-        locked_table.unlock();
+
+        auto sent = _channels->broadcast(channel, response_str);
+        LOG(DEBUG) << NAMEOF(gateway_chat_send_handler::handle_message) << " sent to " << sent << " subscribers of " << channel;
     } else {
         LOG(ERROR) << NAMEOF(gateway_chat_send_handler::handle_message) << " Couldn't cast message to chat_send_message";
     }
 }
 
+bool gateway_chat_send_handler::handle_view(kafka_message_view const &view, STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+    auto chat = chat_send_view::from(view);
+    if(!chat) {
+        LOG(ERROR) << NAMEOF(gateway_chat_send_handler::handle_view) << " chat_send view has " << view.field_count() << " fields";
+        return true;
+    }
+
+    bool channel_target = chat_channel_registry::is_channel_target(chat->target);
+    if(_config.local_chat_delivery && view.sender().server_origin_id == _config.server_id && !channel_target &&
+       _local_deliveries->consume(chat->from_username, chat->target, chat->message)) {
+        LOG(DEBUG) << NAMEOF(gateway_chat_send_handler::handle_view) << " already delivered locally";
+        return true;
+    }
+
+    // the frame and channel name are written into buffers reused per thread, nothing is copied out of the record first
+    outbound_buffer response;
+    auto &response_str = response.str();
+    write_chat_receive(response_str, chat->from_username, chat->target, chat->message);
+
+    thread_local string channel;
+    if(channel_target) {
+        chat_channel_registry::channel_from_target(chat->target, channel);
+    } else {
+        chat_channel_registry::user_channel(chat->target, channel);
+    }
+
+    auto sent = _channels->broadcast(channel, response_str);
+    LOG(DEBUG) << NAMEOF(gateway_chat_send_handler::handle_view) << " sent to " << sent << " subscribers of " << channel;
+    return true;
+}
+
 uint32_t constexpr gateway_chat_send_handler::message_id;
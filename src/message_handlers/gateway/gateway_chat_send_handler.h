@@ -20,22 +20,26 @@
 
 #include "../message_dispatcher.h"
 #include "src/user_connection.h"
+#include "src/chat_channel_registry.h"
+#include "src/local_chat_deliveries.h"
 #include "../../config.h"
 
 #include <messages/chat/chat_send_message.h>
-#include <libcuckoo/cuckoohash_map.hh>
 
 namespace roa {
     class gateway_chat_send_handler : public imessage_handler<false> {
     public:
-        explicit gateway_chat_send_handler(Config config, std::shared_ptr<cuckoohash_map<std::string, user_connection>> connections);
+        explicit gateway_chat_send_handler(Config config, std::shared_ptr<chat_channel_registry> channels,
+                                           std::shared_ptr<local_chat_deliveries> local_deliveries);
         ~gateway_chat_send_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        bool handle_view(kafka_message_view const &view, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_chat_send_message::id;
     private:
         Config _config;
-        std::shared_ptr<cuckoohash_map<std::string, user_connection>> _connections;
+        std::shared_ptr<chat_channel_registry> _channels;
+        std::shared_ptr<local_chat_deliveries> _local_deliveries;
     };
 }
@@ -17,6 +17,8 @@
 */
 
 #include "gateway_error_response_handler.h"
+#include "src/outbound_coalescer.h"
+#include "src/gateway_messages/response_writers.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/chat/chat_receive_message.h>
@@ -28,7 +30,7 @@ gateway_error_response_handler::gateway_error_response_handler(Config config)
         : _config(config) {
 }
 
-void gateway_error_response_handler::handle_message(std::unique_ptr<binary_message const> const &msg,
+void gateway_error_response_handler::handle_message(std::unique_ptr<binary_message> msg,
                                                STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
         LOG(ERROR) << NAMEOF(gateway_error_response_handler::handle_message) << " received empty connection";
@@ -38,16 +40,15 @@ void gateway_error_response_handler::handle_message(std::unique_ptr<binary_messa
     if (auto response_msg = dynamic_cast<binary_error_response_message const *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(gateway_error_response_handler::handle_message) << " Got response message from backend";
 
+        outbound_buffer response;
+        auto &response_str = response.str();
+        write_error_response(response_str, response_msg->error_number, response_msg->error_str);
+        outbound_frames().send(connection->get(), response_str);
+
         //BANNED_ERROR_CODE -2
         if(response_msg->error_number == -2) {
-            json_error_response_message response{{false, 0, 0, 0}, response_msg->error_number, response_msg->error_str};
-            auto response_str = response.serialize();
-            connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
-            connection->get().ws->terminate();
-        } else {
-            json_error_response_message response{{false, 0, 0, 0}, response_msg->error_number, response_msg->error_str};
-            auto response_str = response.serialize();
-            connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+            // terminating would drop the error before the client gets to see why it's disconnected
+            outbound_frames().close(connection->get());
         }
     } else {
         LOG(ERROR) << NAMEOF(gateway_error_response_handler::handle_message) << " Couldn't cast message to chat_send_message";
@@ -30,7 +30,7 @@ namespace roa {
         explicit gateway_error_response_handler(Config config);
         ~gateway_error_response_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_error_response_message::id;
     private:
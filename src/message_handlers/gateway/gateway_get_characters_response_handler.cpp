@@ -17,6 +17,9 @@
 */
 
 #include "gateway_get_characters_response_handler.h"
+#include "src/outbound_coalescer.h"
+#include "src/kafka_message_view.h"
+#include "src/gateway_messages/response_writers.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/error_response_message.h>
@@ -24,34 +27,111 @@
 using namespace std;
 using namespace roa;
 
-gateway_get_characters_response_handler::gateway_get_characters_response_handler(Config config)
-        : _config(config) {
+gateway_get_characters_response_handler::gateway_get_characters_response_handler(Config config, shared_ptr<resume_token_manager> tokens,
+                                                                                 shared_ptr<payload_compressor> compressor, shared_ptr<worker_pool> workers)
+        : _config(config), _tokens(tokens), _compressor(compressor), _workers(workers) {
+    if(!_tokens || !_compressor || !_workers) {
+        LOG(ERROR) << NAMEOF(gateway_get_characters_response_handler::gateway_get_characters_response_handler) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
+}
+
+template <class F>
+void gateway_get_characters_response_handler::send_response(user_connection &connection, F serialize) {
+    auto connection_id = connection.connection_id;
+    auto ticket = _workers->size() > 0 ? outbound_frames().reserve(connection_id) : 0;
+    if(ticket == 0) {
+        _compressor->send(connection, serialize());
+        return;
+    }
 
+    _workers->submit([serialize = move(serialize), compressor = _compressor, mode = connection.compression, connection_id, ticket]() mutable {
+        try {
+            auto encoded = compressor->encode(mode, serialize());
+            outbound_frames().fulfill(connection_id, ticket, move(encoded.bytes), encoded.op_code, encoded.compressed);
+        } catch(...) {
+            outbound_frames().abandon(connection_id, ticket);
+            throw;
+        }
+    });
 }
 
-void gateway_get_characters_response_handler::handle_message(std::unique_ptr<binary_message const> const &msg,
+void gateway_get_characters_response_handler::handle_message(std::unique_ptr<binary_message> msg,
                                                        STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
         LOG(ERROR) << NAMEOF(gateway_get_characters_response_handler::handle_message) << " received empty connection";
         return;
     }
 
-    if (auto response_msg = dynamic_cast<binary_get_characters_response_message const *>(msg.get())) {
+    if (auto response_msg = dynamic_cast<binary_get_characters_response_message *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(gateway_get_characters_response_handler::handle_message) << " Got response message from backend";
 
-        for(auto& plyr : response_msg->players) {
-            connection->get().player_characters.push_back({plyr.player_id, response_msg->sender.server_origin_id, plyr.player_name, plyr.map_name, response_msg->world_name});
-        }
+        connection->get().update_session([&](session_state &updated) {
+            // this copy is the one that stays published, don't leave it with growth slack
+            updated.player_characters.reserve(updated.player_characters.size() + response_msg->players.size());
+            auto world_name = location_names().intern(response_msg->world_name);
+            for(auto& plyr : response_msg->players) {
+                updated.player_characters.push_back({plyr.player_id, response_msg->sender.server_origin_id, plyr.player_name,
+                                                     location_names().intern(plyr.map_name), world_name});
+            }
+        });
+        auto session = connection->get().session();
+        _tokens->update_characters(session->user_id, session->player_characters);
 
-        json_get_characters_response_message response{{false, 0, 0, 0}, response_msg->players, response_msg->world_name};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        // the session above is updated in order, only the response is encoded on a worker
+        auto serialize = [players = move(response_msg->players), world_name = move(response_msg->world_name)] {
+            string response_str;
+            write_get_characters_response(response_str, players.size(), [&](size_t i) {
+                return character_fields{players[i].player_id, players[i].player_name, players[i].map_name};
+            }, world_name);
+            return response_str;
+        };
+
+        send_response(connection->get(), move(serialize));
     } else {
         LOG(ERROR) << NAMEOF(gateway_get_characters_response_handler::handle_message) << " Couldn't cast message to get_characters_response_message";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Something went wrong."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
+    }
+}
+
+bool gateway_get_characters_response_handler::handle_view(kafka_message_view const &view, STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+    if(unlikely(!connection)) {
+        LOG(ERROR) << NAMEOF(gateway_get_characters_response_handler::handle_view) << " received empty connection";
+        return true;
+    }
+
+    auto response_view = get_characters_response_view::from(view);
+    if(!response_view) {
+        LOG(ERROR) << NAMEOF(gateway_get_characters_response_handler::handle_view) << " get_characters_response view has " << view.field_count() << " fields";
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
+        return true;
     }
+
+    // the session outlives the record, player names are the only strings copied out of it
+    connection->get().update_session([&](session_state &updated) {
+        updated.player_characters.reserve(updated.player_characters.size() + response_view->player_count);
+        auto world_name = location_names().intern(response_view->world_name);
+        for(uint32_t i = 0; i < response_view->player_count; i++) {
+            updated.player_characters.push_back({response_view->player_id(i), view.sender().server_origin_id, string(response_view->player_name(i)),
+                                                 location_names().intern(response_view->map_name(i)), world_name});
+        }
+    });
+    auto session = connection->get().session();
+    _tokens->update_characters(session->user_id, session->player_characters);
+
+    // written straight from the record, a worker only gets to encode it
+    string response_str;
+    write_get_characters_response(response_str, response_view->player_count, [&](size_t i) {
+        auto index = static_cast<uint32_t>(i);
+        return character_fields{response_view->player_id(index), response_view->player_name(index), response_view->map_name(index)};
+    }, response_view->world_name);
+
+    send_response(connection->get(), [response_str = move(response_str)]() mutable {
+        return move(response_str);
+    });
+    return true;
 }
 
 uint32_t constexpr gateway_get_characters_response_handler::message_id;
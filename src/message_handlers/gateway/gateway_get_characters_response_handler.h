@@ -20,6 +20,9 @@
 
 #include "../message_dispatcher.h"
 #include "src/user_connection.h"
+#include "src/payload_compressor.h"
+#include "src/resume_token_manager.h"
+#include "src/worker_pool.h"
 #include "../../config.h"
 
 #include <messages/user_access_control/get_characters_response_message.h>
@@ -27,13 +30,22 @@
 namespace roa {
     class gateway_get_characters_response_handler : public imessage_handler<false> {
     public:
-        explicit gateway_get_characters_response_handler(Config config);
+        explicit gateway_get_characters_response_handler(Config config, std::shared_ptr<resume_token_manager> tokens, std::shared_ptr<payload_compressor> compressor,
+                                                         std::shared_ptr<worker_pool> workers);
         ~gateway_get_characters_response_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        bool handle_view(kafka_message_view const &view, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_get_characters_response_message::id;
     private:
         Config _config;
+        std::shared_ptr<resume_token_manager> _tokens;
+        std::shared_ptr<payload_compressor> _compressor;
+        std::shared_ptr<worker_pool> _workers;
+
+        // serialize() returns the json response, it runs on a worker when there are any
+        template <class F>
+        void send_response(user_connection &connection, F serialize);
     };
 }
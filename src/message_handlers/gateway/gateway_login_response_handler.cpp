@@ -17,19 +17,25 @@
 */
 
 #include "gateway_login_response_handler.h"
+#include "src/outbound_coalescer.h"
 #include <macros.h>
 #include <easylogging++.h>
 #include <messages/error_response_message.h>
+#include "src/gateway_messages/resume_session_message.h"
+#include "src/gateway_messages/response_writers.h"
 
 using namespace std;
 using namespace roa;
 
-gateway_login_response_handler::gateway_login_response_handler(Config config)
-    : _config(config) {
-
+gateway_login_response_handler::gateway_login_response_handler(Config config, shared_ptr<resume_token_manager> tokens, shared_ptr<chat_channel_registry> channels)
+    : _config(config), _tokens(tokens), _channels(channels) {
+    if(!_tokens || !_channels) {
+        LOG(ERROR) << NAMEOF(gateway_login_response_handler::gateway_login_response_handler) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
 }
 
-void gateway_login_response_handler::handle_message(std::unique_ptr<binary_message const> const &msg,
+void gateway_login_response_handler::handle_message(std::unique_ptr<binary_message> msg,
                                                     STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
         LOG(ERROR) << NAMEOF(gateway_login_response_handler::handle_message) << " received empty connection";
@@ -39,17 +45,26 @@ void gateway_login_response_handler::handle_message(std::unique_ptr<binary_messa
     if (auto response_msg = dynamic_cast<binary_login_response_message const *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(gateway_login_response_handler::handle_message) << " Got response message from backend";
 
-        connection->get().state = user_connection_state::LOGGED_IN;
-        connection->get().admin_status = response_msg->admin_status;
-        connection->get().user_id = response_msg->user_id;
-        json_login_response_message response{{false, 0, 0, 0}, response_msg->admin_status, response_msg->user_id};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        connection->get().update_session([&](session_state &updated) {
+            updated.state = user_connection_state::LOGGED_IN;
+            updated.admin_status = response_msg->admin_status;
+            updated.user_id = response_msg->user_id;
+        });
+        _channels->subscribe_logged_in(connection->get(), *connection->get().session());
+        outbound_buffer response;
+        write_login_response(response.str(), response_msg->admin_status, response_msg->user_id);
+        outbound_frames().send(connection->get(), response.str());
+
+        if(_tokens->enabled()) {
+            resume_token_message token_msg{_tokens->issue(*connection->get().session()), _tokens->ttl().count()};
+            outbound_buffer token;
+            token_msg.serialize(token.str());
+            outbound_frames().send(connection->get(), token.str());
+        }
     } else {
         LOG(ERROR) << NAMEOF(gateway_login_response_handler::handle_message) << " Couldn't cast message to login_response_message";
-        json_error_response_message response{{false, 0, 0, 0}, -1, "Something went wrong."};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        static string const response_str = json_error_response_message{{false, 0, 0, 0}, -1, "Something went wrong."}.serialize();
+        outbound_frames().send(connection->get(), response_str);
     }
 }
 
@@ -20,6 +20,8 @@
 
 #include "../message_dispatcher.h"
 #include "src/user_connection.h"
+#include "src/chat_channel_registry.h"
+#include "src/resume_token_manager.h"
 #include "../../config.h"
 
 #include <messages/user_access_control/login_response_message.h>
@@ -27,13 +29,15 @@
 namespace roa {
     class gateway_login_response_handler : public imessage_handler<false> {
     public:
-        explicit gateway_login_response_handler(Config config);
+        explicit gateway_login_response_handler(Config config, std::shared_ptr<resume_token_manager> tokens, std::shared_ptr<chat_channel_registry> channels);
         ~gateway_login_response_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_login_response_message::id;
     private:
         Config _config;
+        std::shared_ptr<resume_token_manager> _tokens;
+        std::shared_ptr<chat_channel_registry> _channels;
     };
 }
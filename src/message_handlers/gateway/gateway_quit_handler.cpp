@@ -24,7 +24,7 @@ gateway_quit_handler::gateway_quit_handler(std::atomic<bool> *quit) : _quit(quit
 
 }
 
-void gateway_quit_handler::handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+void gateway_quit_handler::handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
     *this->_quit = true;
 }
 
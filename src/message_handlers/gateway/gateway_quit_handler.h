@@ -28,7 +28,7 @@ namespace roa {
         explicit gateway_quit_handler(std::atomic<bool> *quit);
         ~gateway_quit_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_quit_message::id;
     private:
@@ -17,28 +17,56 @@
 */
 
 #include "gateway_send_map_handler.h"
+#include "src/outbound_coalescer.h"
 #include <macros.h>
 #include <easylogging++.h>
 
 using namespace std;
 using namespace roa;
 
-gateway_send_map_handler::gateway_send_map_handler(Config config)
-        : _config(config) {
+gateway_send_map_handler::gateway_send_map_handler(Config config, shared_ptr<payload_compressor> compressor, shared_ptr<snapshot_deltas> deltas,
+                                                   shared_ptr<worker_pool> workers)
+        : _config(config), _compressor(compressor), _deltas(deltas), _workers(workers) {
+    if(!_compressor || !_deltas || !_workers) {
+        LOG(ERROR) << NAMEOF(gateway_send_map_handler::gateway_send_map_handler) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
 }
 
-void gateway_send_map_handler::handle_message(std::unique_ptr<binary_message const> const &msg,
+void gateway_send_map_handler::handle_message(std::unique_ptr<binary_message> msg,
                                                STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
     if(unlikely(!connection)) {
         LOG(ERROR) << NAMEOF(gateway_send_map_handler::handle_message) << " received empty connection";
         return;
     }
 
-    if (auto response_msg = dynamic_cast<binary_send_map_message const *>(msg.get())) {
+    if (auto response_msg = dynamic_cast<binary_send_map_message *>(msg.get())) {
         LOG(DEBUG) << NAMEOF(gateway_send_map_handler::handle_message) << " Got response message from backend";
-        json_send_map_message response{{false, 0, 0, 0}, response_msg->map_data};
-        auto response_str = response.serialize();
-        connection->get().ws->send(response_str.c_str(), response_str.length(), uWS::OpCode::TEXT);
+        auto connection_id = connection->get().connection_id;
+        // taken here so sequences follow the order maps arrive in, whichever worker finishes first
+        auto snapshot = _deltas->reserve(connection_id, message_id);
+        auto serialize = [deltas = _deltas, snapshot = move(snapshot), map_data = move(response_msg->map_data)] {
+            json_send_map_message response{{false, 0, 0, 0}, map_data};
+            auto response_str = response.serialize();
+            return snapshot ? deltas->fulfill(snapshot.value(), response_str) : response_str;
+        };
+
+        // the spot keeps maps in order when a later one is encoded first
+        auto ticket = _workers->size() > 0 ? outbound_frames().reserve(connection_id) : 0;
+        if(ticket == 0) {
+            _compressor->send(connection->get(), serialize());
+            return;
+        }
+
+        _workers->submit([serialize = move(serialize), compressor = _compressor, mode = connection->get().compression, connection_id, ticket] {
+            try {
+                auto encoded = compressor->encode(mode, serialize());
+                outbound_frames().fulfill(connection_id, ticket, move(encoded.bytes), encoded.op_code, encoded.compressed);
+            } catch(...) {
+                outbound_frames().abandon(connection_id, ticket);
+                throw;
+            }
+        });
     } else {
         LOG(ERROR) << NAMEOF(gateway_send_map_handler::handle_message) << " Couldn't cast message to binary_send_map_message";
     }
@@ -20,6 +20,9 @@
 
 #include "../message_dispatcher.h"
 #include "src/user_connection.h"
+#include "src/payload_compressor.h"
+#include "src/snapshot_deltas.h"
+#include "src/worker_pool.h"
 #include "../../config.h"
 
 #include <messages/game/send_map_message.h>
@@ -27,13 +30,17 @@
 namespace roa {
     class gateway_send_map_handler : public imessage_handler<false> {
     public:
-        explicit gateway_send_map_handler(Config config);
+        explicit gateway_send_map_handler(Config config, std::shared_ptr<payload_compressor> compressor, std::shared_ptr<snapshot_deltas> deltas,
+                                          std::shared_ptr<worker_pool> workers);
         ~gateway_send_map_handler() override = default;
 
-        void handle_message(std::unique_ptr<binary_message const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
+        void handle_message(std::unique_ptr<binary_message> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) override;
 
         static constexpr uint32_t message_id = json_send_map_message::id;
     private:
         Config _config;
+        std::shared_ptr<payload_compressor> _compressor;
+        std::shared_ptr<snapshot_deltas> _deltas;
+        std::shared_ptr<worker_pool> _workers;
     };
 }
@@ -0,0 +1,61 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "handler_registration.h"
+#include "client/client_admin_quit_handler.h"
+#include "client/client_login_handler.h"
+#include "client/client_register_handler.h"
+#include "client/client_chat_send_handler.h"
+#include "client/client_create_character_handler.h"
+#include "client/client_get_characters_handler.h"
+#include "client/client_play_character_handler.h"
+#include "gateway/gateway_quit_handler.h"
+#include "gateway/gateway_login_response_handler.h"
+#include "gateway/gateway_register_response_handler.h"
+#include "gateway/gateway_chat_send_handler.h"
+#include "gateway/gateway_error_response_handler.h"
+#include "gateway/gateway_send_map_handler.h"
+#include "gateway/gateway_get_characters_response_handler.h"
+
+using namespace std;
+using namespace roa;
+
+void roa::register_client_handlers(message_dispatcher<false> &dispatcher, Config const &config, shared_ptr<partitioned_producer> const &producer,
+                                   shared_ptr<chat_channel_registry> const &channels, shared_ptr<local_chat_deliveries> const &local_deliveries,
+                                   shared_ptr<area_of_interest> const &aoi) {
+    dispatcher.register_handler<client_admin_quit_handler>(config, producer);
+    dispatcher.register_handler<client_login_handler>(config, producer);
+    dispatcher.register_handler<client_register_handler>(config, producer);
+    dispatcher.register_handler<client_chat_send_handler>(config, producer, channels, local_deliveries);
+    dispatcher.register_handler<client_create_character_handler>(config, producer);
+    dispatcher.register_handler<client_get_characters_handler>(config, producer);
+    dispatcher.register_handler<client_play_character_handler>(config, producer, channels, aoi);
+}
+
+void roa::register_gateway_handlers(message_dispatcher<false> &dispatcher, Config const &config, atomic<bool> *quit,
+                                    shared_ptr<resume_token_manager> const &tokens, shared_ptr<payload_compressor> const &compressor,
+                                    shared_ptr<chat_channel_registry> const &channels, shared_ptr<local_chat_deliveries> const &local_deliveries,
+                                    shared_ptr<snapshot_deltas> const &deltas, shared_ptr<worker_pool> const &workers) {
+    dispatcher.register_handler<gateway_quit_handler>(quit);
+    dispatcher.register_handler<gateway_login_response_handler>(config, tokens, channels);
+    dispatcher.register_handler<gateway_register_response_handler>(config, channels);
+    dispatcher.register_handler<gateway_chat_send_handler>(config, channels, local_deliveries);
+    dispatcher.register_handler<gateway_error_response_handler>(config);
+    dispatcher.register_handler<gateway_send_map_handler>(config, compressor, deltas, workers);
+    dispatcher.register_handler<gateway_get_characters_response_handler>(config, tokens, compressor, workers);
+}
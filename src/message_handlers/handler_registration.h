@@ -0,0 +1,45 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "message_dispatcher.h"
+#include "src/partitioned_producer.h"
+#include "src/resume_token_manager.h"
+#include "src/payload_compressor.h"
+#include "src/chat_channel_registry.h"
+#include "src/local_chat_deliveries.h"
+#include "src/area_of_interest.h"
+#include "src/snapshot_deltas.h"
+#include "src/worker_pool.h"
+#include "../config.h"
+#include <atomic>
+#include <memory>
+
+namespace roa {
+    // The handlers for messages from clients and from the backend, shared by the gateway and the replay tool
+    // so a replayed capture runs through exactly the handlers the gateway runs.
+    void register_client_handlers(message_dispatcher<false> &dispatcher, Config const &config, std::shared_ptr<partitioned_producer> const &producer,
+                                  std::shared_ptr<chat_channel_registry> const &channels, std::shared_ptr<local_chat_deliveries> const &local_deliveries,
+                                  std::shared_ptr<area_of_interest> const &aoi);
+
+    void register_gateway_handlers(message_dispatcher<false> &dispatcher, Config const &config, std::atomic<bool> *quit,
+                                   std::shared_ptr<resume_token_manager> const &tokens, std::shared_ptr<payload_compressor> const &compressor,
+                                   std::shared_ptr<chat_channel_registry> const &channels, std::shared_ptr<local_chat_deliveries> const &local_deliveries,
+                                   std::shared_ptr<snapshot_deltas> const &deltas, std::shared_ptr<worker_pool> const &workers);
+}
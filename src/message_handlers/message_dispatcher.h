@@ -19,18 +19,31 @@
 #pragma once
 
 #include <unordered_map>
-#include <vector>
+#include <memory>
+#include <string>
+#include <stdexcept>
 #include "src/user_connection.h"
 #include <messages/message.h>
 #include <custom_optional.h>
 
 namespace roa {
+    class kafka_message_view;
 
     template <bool UseJson>
     class imessage_handler {
     public:
         virtual ~imessage_handler() = default;
-        virtual void handle_message(std::unique_ptr<message<UseJson> const> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) = 0;
+        // called before the message is deserialized, handlers that reject based on the connection alone do so here
+        // so frames they'd refuse anyway are never parsed
+        virtual bool admit(STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+            return true;
+        }
+        // the handler owns msg, it may move fields out of it when re-wrapping it for kafka instead of copying them
+        virtual void handle_message(std::unique_ptr<message<UseJson>> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) = 0;
+        // hot backend messages may arrive as a view over the kafka record instead, handlers reading them return true
+        virtual bool handle_view(kafka_message_view const &view, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+            return false;
+        }
     };
 
     template <bool UseJson>
@@ -40,28 +53,46 @@ namespace roa {
 
         template <template <bool> class handler, class... Args>
         void register_handler(Args... args) {
-            // https://stackoverflow.com/questions/15783342/should-i-use-c11-emplace-back-with-pointers-containters
-            // We're sticking with push_back(make_unique)
-            _handlers[handler<UseJson>::message_id].push_back(std::make_unique<handler<UseJson>>(args...));
+            add_handler(handler<UseJson>::message_id, std::make_unique<handler<UseJson>>(args...));
         }
 
         template <class handler, class... Args>
         void register_handler(Args... args) {
-            _handlers[handler::message_id].push_back(std::make_unique<handler>(args...));
+            add_handler(handler::message_id, std::make_unique<handler>(args...));
         }
 
-        void trigger_handler(std::tuple<uint32_t, std::unique_ptr<message<UseJson> const>> const &msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+        // false when no handler is registered for the message id or it rejects the connection
+        bool admits(uint32_t message_id, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+            auto iterator = _handlers.find(message_id);
+            return iterator != std::end(_handlers) && iterator->second->admit(connection);
+        }
+
+        // Hands the message over to the handler of its id. deserialize() returns a pointer to const, but each message
+        // is a fresh, non-const heap object that nothing else refers to, so ownership passes on as mutable.
+        void trigger_handler(std::tuple<uint32_t, std::unique_ptr<message<UseJson> const>> msg, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
             auto iterator = _handlers.find(std::get<0>(msg));
 
             if(iterator == std::end(_handlers)) {
                 return;
             }
 
-            for(auto &msg_handler : iterator->second) {
-                msg_handler->handle_message(std::get<1>(msg), connection);
-            }
+            std::unique_ptr<message<UseJson>> owned(const_cast<message<UseJson> *>(std::get<1>(msg).release()));
+            iterator->second->handle_message(std::move(owned), connection);
+        }
+
+        // false when no handler reads views of this type
+        bool trigger_view(uint32_t message_id, kafka_message_view const &view, STD_OPTIONAL<std::reference_wrapper<user_connection>> connection) {
+            auto iterator = _handlers.find(message_id);
+            return iterator != std::end(_handlers) && iterator->second->handle_view(view, connection);
         }
     private:
-        std::unordered_map<uint32_t, std::vector<std::unique_ptr<imessage_handler<UseJson>>>> _handlers;
+        // messages are handed over to their handler, so every id has exactly one
+        void add_handler(uint32_t message_id, std::unique_ptr<imessage_handler<UseJson>> handler) {
+            if(!_handlers.emplace(message_id, std::move(handler)).second) {
+                throw std::runtime_error("message id " + std::to_string(message_id) + " already has a handler");
+            }
+        }
+
+        std::unordered_map<uint32_t, std::unique_ptr<imessage_handler<UseJson>>> _handlers;
     };
 }
\ No newline at end of file
@@ -0,0 +1,145 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "multicast_envelope.h"
+#include <cstring>
+#include "connection_registry.h"
+#include "chat_channel_registry.h"
+#include "area_of_interest.h"
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    template <class T>
+    T load_big_endian(char const *data) noexcept {
+        T value = 0;
+        for(size_t i = 0; i < sizeof(T); i++) {
+            value = static_cast<T>((value << 8) | static_cast<unsigned char>(data[i]));
+        }
+        return value;
+    }
+
+    float load_float(char const *data) noexcept {
+        auto bits = load_big_endian<uint32_t>(data);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // x, y and radius behind the map name of an area
+    constexpr size_t area_spot_size = 3 * sizeof(uint32_t);
+}
+
+bool multicast_envelope::is_envelope(char const *data, size_t length) noexcept {
+    return length >= multicast_envelope_header_size && memcmp(data, multicast_envelope_magic, sizeof(multicast_envelope_magic)) == 0;
+}
+
+STD_OPTIONAL<multicast_envelope> multicast_envelope::parse(char const *data, size_t length) noexcept {
+    if(!is_envelope(data, length)) {
+        return {};
+    }
+
+    auto target = static_cast<uint8_t>(data[4]);
+    auto priority = static_cast<uint8_t>(data[5]);
+    if(target > static_cast<uint8_t>(multicast_target::AREA) || priority >= OUTBOUND_CLASS_COUNT) {
+        return {};
+    }
+
+    multicast_envelope envelope;
+    envelope._target = static_cast<multicast_target>(target);
+    envelope._priority = static_cast<outbound_class>(priority);
+    envelope._destination = load_big_endian<uint32_t>(data + 8);
+    envelope._count = load_big_endian<uint32_t>(data + 12);
+
+    size_t targets_length = envelope._count;
+    if(envelope._target == multicast_target::CONNECTIONS) {
+        targets_length = static_cast<size_t>(envelope._count) * sizeof(uint64_t);
+    } else if(envelope._target == multicast_target::AREA) {
+        targets_length += area_spot_size;
+    }
+    if(targets_length > length - multicast_envelope_header_size) {
+        return {};
+    }
+
+    envelope._targets = data + multicast_envelope_header_size;
+    envelope._x = 0;
+    envelope._y = 0;
+    envelope._radius = 0;
+    if(envelope._target == multicast_target::AREA) {
+        auto spot = envelope._targets + envelope._count;
+        envelope._x = load_float(spot);
+        envelope._y = load_float(spot + sizeof(uint32_t));
+        envelope._radius = load_float(spot + 2 * sizeof(uint32_t));
+    }
+    envelope._frame = envelope._targets + targets_length;
+    envelope._frame_length = length - multicast_envelope_header_size - targets_length;
+    return envelope;
+}
+
+uint64_t multicast_envelope::connection_id(uint32_t index) const noexcept {
+    return load_big_endian<uint64_t>(_targets + static_cast<size_t>(index) * sizeof(uint64_t));
+}
+
+string multicast_envelope::channel() const {
+    if(_target != multicast_target::CHANNEL) {
+        return {};
+    }
+    return string(_targets, _count);
+}
+
+string_view multicast_envelope::map_name() const noexcept {
+    if(_target != multicast_target::AREA) {
+        return {};
+    }
+    return string_view(_targets, _count);
+}
+
+size_t multicast_envelope::deliver(connection_registry const &connections, chat_channel_registry const &channels, area_of_interest const &aoi) const {
+    if(_target == multicast_target::CHANNEL) {
+        return channels.broadcast(channel(), string(_frame, _frame_length), _priority);
+    }
+
+    if(_target == multicast_target::AREA) {
+        // the aoi caps the radius and rejects spots that aren't finite
+        return aoi.broadcast_near(location_names().intern(map_name()), _x, _y, _radius, string(_frame, _frame_length), _priority);
+    }
+
+    size_t sent = 0;
+    if(!outbound_frames().enabled()) {
+        // framed once, every recipient's socket references the same buffer
+        auto prepared = uWS::WebSocket<uWS::SERVER>::prepareMessage(const_cast<char *>(_frame), _frame_length, uWS::OpCode::TEXT, false);
+        for(uint32_t i = 0; i < _count; i++) {
+            connections.find_fn(connection_id(i), [&](user_connection const &connection) {
+                connection.ws->sendPrepared(prepared);
+                sent++;
+            });
+        }
+        uWS::WebSocket<uWS::SERVER>::finalizeMessage(prepared);
+        return sent;
+    }
+
+    string frame(_frame, _frame_length);
+    for(uint32_t i = 0; i < _count; i++) {
+        connections.find_fn(connection_id(i), [&](user_connection const &connection) {
+            outbound_frames().send(connection, frame, _priority);
+            sent++;
+        });
+    }
+    return sent;
+}
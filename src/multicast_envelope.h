@@ -0,0 +1,120 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <custom_optional.h>
+#include "outbound_coalescer.h"
+
+namespace roa {
+    class connection_registry;
+    class chat_channel_registry;
+    class area_of_interest;
+
+    enum class multicast_target : uint8_t {
+        CONNECTIONS = 0,
+        CHANNEL = 1,
+        // everyone near a spot on a map, e.g. an entity the world server moved
+        AREA = 2
+    };
+
+    // Kafka record layout, all integers big endian:
+    //   0  magic "RMC1"
+    //   4  target, multicast_target
+    //   5  priority, outbound_class the frame is sent with
+    //   6  reserved, 2 bytes of 0
+    //   8  destination, uint32, server id of the gateway the recipients are connected to
+    //   12 count, uint32, number of connection ids or length of the channel or map name
+    //   16 count connection ids as uint64, or the channel name, or the map name followed by x, y and radius as float32
+    //   .. the frame to send, as the client receives it, up to the end of the record
+    // The magic never starts a message of the common library, its id would be far out of range.
+    // Envelopes can arrive on topics every gateway reads, a gateway only delivers the ones addressed to its server id.
+    constexpr char multicast_envelope_magic[4] = {'R', 'M', 'C', '1'};
+    constexpr size_t multicast_envelope_header_size = 16;
+
+    // Points into the record it was parsed from, valid as long as that is.
+    class multicast_envelope {
+    public:
+        static bool is_envelope(char const *data, size_t length) noexcept;
+        // nothing when the record is cut short or names an unknown target or priority
+        static STD_OPTIONAL<multicast_envelope> parse(char const *data, size_t length) noexcept;
+
+        multicast_target target() const noexcept {
+            return _target;
+        }
+
+        outbound_class priority() const noexcept {
+            return _priority;
+        }
+
+        uint32_t destination() const noexcept {
+            return _destination;
+        }
+
+        uint32_t connection_count() const noexcept {
+            return _target == multicast_target::CONNECTIONS ? _count : 0;
+        }
+
+        uint64_t connection_id(uint32_t index) const noexcept;
+        std::string channel() const;
+        // empty unless the target is an area
+        std::string_view map_name() const noexcept;
+
+        float x() const noexcept {
+            return _x;
+        }
+
+        float y() const noexcept {
+            return _y;
+        }
+
+        float radius() const noexcept {
+            return _radius;
+        }
+
+        char const *frame() const noexcept {
+            return _frame;
+        }
+
+        size_t frame_length() const noexcept {
+            return _frame_length;
+        }
+
+        // sends the frame to every recipient still connected to this gateway, returns how many it went to
+        // has to be called on the uws thread
+        size_t deliver(connection_registry const &connections, chat_channel_registry const &channels, area_of_interest const &aoi) const;
+
+    private:
+        multicast_envelope() = default;
+
+        multicast_target _target;
+        outbound_class _priority;
+        uint32_t _destination;
+        uint32_t _count;
+        char const *_targets;
+        char const *_frame;
+        size_t _frame_length;
+        float _x;
+        float _y;
+        float _radius;
+    };
+}
@@ -0,0 +1,416 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "outbound_coalescer.h"
+#include <easylogging++.h>
+#include <macros.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    class uws_socket : public outbound_socket {
+    public:
+        void send(uWS::WebSocket<uWS::SERVER> *ws, char const *data, size_t length, uWS::OpCode op_code, bool compressed) override {
+            if(!compressed) {
+                ws->send(data, length, op_code);
+                return;
+            }
+
+            auto prepared = uWS::WebSocket<uWS::SERVER>::prepareMessage(const_cast<char *>(data), length, op_code, true);
+            ws->sendPrepared(prepared);
+            uWS::WebSocket<uWS::SERVER>::finalizeMessage(prepared);
+        }
+
+        void send_batch(uWS::WebSocket<uWS::SERVER> *ws, vector<string> &payloads, uWS::OpCode op_code, bool compressed) override {
+            auto prepared = uWS::WebSocket<uWS::SERVER>::prepareMessageBatch(payloads, _excluded, op_code, compressed);
+            ws->sendPrepared(prepared);
+            uWS::WebSocket<uWS::SERVER>::finalizeMessage(prepared);
+        }
+
+        void close(uWS::WebSocket<uWS::SERVER> *ws) override {
+            ws->close();
+        }
+
+        void terminate(uWS::WebSocket<uWS::SERVER> *ws) override {
+            ws->terminate();
+        }
+
+    private:
+        vector<int> _excluded;
+    };
+}
+
+outbound_coalescer::outbound_coalescer() : outbound_coalescer(make_shared<uws_socket>()) {
+
+}
+
+outbound_coalescer::outbound_coalescer(shared_ptr<outbound_socket> socket) : _socket(move(socket)), _enabled(false), _limits(), _timer(nullptr),
+                                                                              _pending(), _dirty_mutex(), _dirty(), _flushing(), _frames(), _batch(),
+                                                                              _dropped(), _held() {
+    if(!_socket) {
+        LOG(ERROR) << NAMEOF(outbound_coalescer::outbound_coalescer) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
+}
+
+outbound_coalescer::~outbound_coalescer() {
+    stop();
+}
+
+void outbound_coalescer::start(uS::Loop *loop, uint32_t flush_interval_ms, outbound_limits limits) {
+    if(flush_interval_ms == 0 || _timer != nullptr) {
+        return;
+    }
+
+    _limits = limits;
+    _timer = new uS::Timer(loop);
+    _timer->setData(this);
+    _timer->start(&outbound_coalescer::on_timer, static_cast<int>(flush_interval_ms), static_cast<int>(flush_interval_ms));
+    _enabled.store(true, memory_order_release);
+
+    LOG(INFO) << NAMEOF(outbound_coalescer::start) << " coalescing outbound frames every " << flush_interval_ms << " ms";
+}
+
+void outbound_coalescer::stop() {
+    if(_timer == nullptr) {
+        return;
+    }
+
+    _enabled.store(false, memory_order_release);
+    flush();
+    _timer->stop();
+    _timer->close();
+    _timer = nullptr;
+}
+
+bool outbound_coalescer::enabled() const noexcept {
+    return _enabled.load(memory_order_acquire);
+}
+
+void outbound_coalescer::add(user_connection const &connection) {
+    _pending.insert(connection.connection_id, pending_frames{connection.ws, {}, {}, 0, false, false, false});
+}
+
+void outbound_coalescer::remove(uint64_t connection_id) {
+    // whatever is still held is dropped, the socket is going away
+    _pending.erase(connection_id);
+}
+
+void outbound_coalescer::send(user_connection const &connection, string const &payload, outbound_class priority) {
+    send(connection.connection_id, connection.ws, payload, priority);
+}
+
+void outbound_coalescer::send(user_connection const &connection, string &&payload, outbound_class priority) {
+    send(connection.connection_id, connection.ws, move(payload), priority);
+}
+
+void outbound_coalescer::send(uint64_t connection_id, uWS::WebSocket<uWS::SERVER> *ws, string const &payload, outbound_class priority,
+                              uWS::OpCode op_code, bool compressed) {
+    if(!enabled()) {
+        // stand-in connections of the replay and the tests have no socket
+        if(ws != nullptr) {
+            _socket->send(ws, payload.c_str(), payload.length(), op_code, compressed);
+        }
+        return;
+    }
+
+    hold(connection_id, string(payload), priority, op_code, compressed);
+}
+
+void outbound_coalescer::send(uint64_t connection_id, uWS::WebSocket<uWS::SERVER> *ws, string &&payload, outbound_class priority,
+                              uWS::OpCode op_code, bool compressed) {
+    if(!enabled()) {
+        // stand-in connections of the replay and the tests have no socket
+        if(ws != nullptr) {
+            _socket->send(ws, payload.c_str(), payload.length(), op_code, compressed);
+        }
+        return;
+    }
+
+    hold(connection_id, move(payload), priority, op_code, compressed);
+}
+
+void outbound_coalescer::hold(uint64_t connection_id, string &&payload, outbound_class priority, uWS::OpCode op_code, bool compressed) {
+    bool schedule = false;
+    bool dropped = false;
+    auto length = payload.length();
+    auto held = _pending.update_fn(connection_id, [&](pending_frames &pending) {
+        if(pending.queued_bytes[priority] + length > _limits.queue_bytes[priority]) {
+            dropped = true;
+            // losing a response leaves the client waiting forever, better to have it reconnect
+            if(priority != CONTROL) {
+                return;
+            }
+            pending.overflowed = true;
+        } else {
+            pending.queues[priority].push_back(outbound_frame{move(payload), op_code, compressed, 0, true, chrono::steady_clock::now()});
+            pending.queued_bytes[priority] += length;
+        }
+
+        schedule = !pending.scheduled;
+        pending.scheduled = true;
+    });
+
+    if(!held) {
+        LOG(DEBUG) << NAMEOF(outbound_coalescer::send) << " dropping frame for removed connection " << connection_id;
+        return;
+    }
+
+    if(unlikely(dropped)) {
+        if(priority != CONTROL) {
+            count_drop(connection_id, priority);
+            return;
+        }
+        LOG(WARNING) << NAMEOF(outbound_coalescer::send) << " control queue full for connection " << connection_id;
+    }
+
+    if(schedule) {
+        mark_dirty(connection_id);
+    }
+}
+
+void outbound_coalescer::close(user_connection const &connection) {
+    if(!enabled()) {
+        // frames were handed to the socket as they were sent, close only shuts it down after writing those out
+        if(connection.ws != nullptr) {
+            _socket->close(connection.ws);
+        }
+        return;
+    }
+
+    bool schedule = false;
+    _pending.update_fn(connection.connection_id, [&](pending_frames &pending) {
+        pending.closing = true;
+        schedule = !pending.scheduled;
+        pending.scheduled = true;
+    });
+
+    if(schedule) {
+        mark_dirty(connection.connection_id);
+    }
+}
+
+uint64_t outbound_coalescer::reserve(uint64_t connection_id) {
+    if(!enabled()) {
+        return 0;
+    }
+
+    uint64_t ticket = 0;
+    _pending.update_fn(connection_id, [&](pending_frames &pending) {
+        ticket = ++pending.last_ticket;
+        pending.queues[BULK].push_back(outbound_frame{{}, uWS::OpCode::TEXT, false, ticket, false, chrono::steady_clock::now()});
+    });
+    return ticket;
+}
+
+void outbound_coalescer::fulfill(uint64_t connection_id, uint64_t ticket, string payload, uWS::OpCode op_code, bool compressed) {
+    if(settle(connection_id, ticket, &payload, op_code, compressed)) {
+        mark_dirty(connection_id);
+    }
+}
+
+void outbound_coalescer::abandon(uint64_t connection_id, uint64_t ticket) {
+    if(settle(connection_id, ticket, nullptr, uWS::OpCode::TEXT, false)) {
+        mark_dirty(connection_id);
+    }
+}
+
+bool outbound_coalescer::settle(uint64_t connection_id, uint64_t ticket, string *payload, uWS::OpCode op_code, bool compressed) {
+    bool schedule = false;
+    bool dropped = false;
+    _pending.update_fn(connection_id, [&](pending_frames &pending) {
+        auto &bulk = pending.queues[BULK];
+        auto reserved = find_if(begin(bulk), end(bulk), [&](outbound_frame const &frame) {
+            return frame.ticket == ticket;
+        });
+
+        if(reserved == end(bulk)) {
+            return;
+        }
+
+        if(payload == nullptr || pending.queued_bytes[BULK] + payload->length() > _limits.queue_bytes[BULK]) {
+            dropped = payload != nullptr;
+            bulk.erase(reserved);
+        } else {
+            pending.queued_bytes[BULK] += payload->length();
+            *reserved = outbound_frame{move(*payload), op_code, compressed, ticket, true, reserved->queued_at};
+        }
+
+        // frames behind the reserved spot may be waiting on it
+        schedule = !pending.scheduled && !bulk.empty() && bulk.front().ready;
+        pending.scheduled = pending.scheduled || schedule;
+    });
+
+    if(unlikely(dropped)) {
+        count_drop(connection_id, BULK);
+    }
+    return schedule;
+}
+
+void outbound_coalescer::flush() {
+    {
+        lock_guard<mutex> lock(_dirty_mutex);
+        swap(_dirty, _flushing);
+    }
+
+    auto now = chrono::steady_clock::now();
+    for(auto connection_id : _flushing) {
+        uWS::WebSocket<uWS::SERVER> *ws = nullptr;
+        bool overflowed = false;
+        bool closing = false;
+        bool bulk_left = false;
+        _pending.update_fn(connection_id, [&](pending_frames &pending) {
+            ws = pending.ws;
+            overflowed = pending.overflowed;
+            closing = pending.closing;
+            pending.scheduled = false;
+            if(overflowed) {
+                return;
+            }
+
+            for(auto priority : {CONTROL, CHAT}) {
+                for(auto const &frame : pending.queues[priority]) {
+                    count_held(priority, frame.queued_at, now);
+                }
+                move(begin(pending.queues[priority]), end(pending.queues[priority]), back_inserter(_frames));
+                pending.queues[priority].clear();
+                pending.queued_bytes[priority] = 0;
+            }
+
+            // the rest waits for the next flush, so control and chat sent in between go out before it,
+            // a reserved spot that is still being encoded holds back everything behind it
+            size_t budget = 0;
+            auto &bulk = pending.queues[BULK];
+            auto taken = begin(bulk);
+            while(taken != end(bulk) && taken->ready && (budget == 0 || budget + taken->payload.length() <= _limits.bulk_bytes_per_flush)) {
+                budget += taken->payload.length();
+                pending.queued_bytes[BULK] -= taken->payload.length();
+                count_held(BULK, taken->queued_at, now);
+                _frames.push_back(move(*taken));
+                ++taken;
+            }
+            bulk.erase(begin(bulk), taken);
+            bulk_left = !closing && !bulk.empty() && bulk.front().ready;
+            pending.scheduled = bulk_left || closing;
+        });
+
+        if(unlikely(overflowed)) {
+            LOG(WARNING) << NAMEOF(outbound_coalescer::flush) << " disconnecting connection " << connection_id << ", it isn't keeping up with its responses";
+            // runs onDisconnection, which removes the connection from the table
+            if(ws != nullptr) {
+                _socket->terminate(ws);
+            }
+            continue;
+        }
+
+        // stand-in connections of the replay and the benchmarks have no socket, their frames are dropped here
+        if(!_frames.empty() && ws != nullptr) {
+            send_frames(ws);
+        }
+        _frames.clear();
+
+        if(closing) {
+            // runs onDisconnection once the close handshake is done, bulk frames still held are dropped with the connection
+            if(ws != nullptr) {
+                _socket->close(ws);
+            }
+            continue;
+        }
+
+        if(bulk_left) {
+            mark_dirty(connection_id);
+        }
+    }
+
+    _flushing.clear();
+}
+
+void outbound_coalescer::send_frames(uWS::WebSocket<uWS::SERVER> *ws) {
+    // frames of the same kind are framed back to back in one buffer, handed to the socket as a single write
+    auto run_start = begin(_frames);
+    while(run_start != end(_frames)) {
+        auto run_end = find_if(run_start, end(_frames), [&](outbound_frame const &frame) {
+            return frame.op_code != run_start->op_code || frame.compressed != run_start->compressed;
+        });
+
+        if(run_end - run_start == 1) {
+            _socket->send(ws, run_start->payload.c_str(), run_start->payload.length(), run_start->op_code, run_start->compressed);
+        } else {
+            for(auto frame = run_start; frame != run_end; frame++) {
+                _batch.push_back(move(frame->payload));
+            }
+            _socket->send_batch(ws, _batch, run_start->op_code, run_start->compressed);
+            _batch.clear();
+        }
+
+        run_start = run_end;
+    }
+}
+
+uint64_t outbound_coalescer::dropped(outbound_class priority) const noexcept {
+    return _dropped[priority].load(memory_order_relaxed);
+}
+
+uint64_t outbound_coalescer::held_us(outbound_class priority, double fraction) const noexcept {
+    uint64_t total = 0;
+    for(auto const &bucket : _held[priority]) {
+        total += bucket.load(memory_order_relaxed);
+    }
+
+    uint64_t counted = 0;
+    for(size_t i = 0; i < held_buckets; i++) {
+        counted += _held[priority][i].load(memory_order_relaxed);
+        if(counted > 0 && counted >= fraction * total) {
+            return uint64_t{1} << i;
+        }
+    }
+    return 0;
+}
+
+void outbound_coalescer::count_drop(uint64_t connection_id, outbound_class priority) {
+    // one line per full queue would flood the log when a connection stalls, every 1024th drop is logged with the total
+    auto total = _dropped[priority].fetch_add(1, memory_order_relaxed) + 1;
+    if(total == 1 || total % 1024 == 0) {
+        LOG(WARNING) << NAMEOF(outbound_coalescer::send) << " outbound queue " << static_cast<uint32_t>(priority) << " full for connection " << connection_id
+                     << ", " << total << " frames of this class dropped so far";
+    }
+}
+
+void outbound_coalescer::count_held(outbound_class priority, chrono::steady_clock::time_point queued_at, chrono::steady_clock::time_point now) {
+    auto held = static_cast<uint64_t>(max<int64_t>(0, chrono::duration_cast<chrono::microseconds>(now - queued_at).count()));
+    size_t bucket = 0;
+    while(bucket + 1 < held_buckets && (uint64_t{1} << bucket) <= held) {
+        bucket++;
+    }
+    _held[priority][bucket].fetch_add(1, memory_order_relaxed);
+}
+
+void outbound_coalescer::mark_dirty(uint64_t connection_id) {
+    lock_guard<mutex> lock(_dirty_mutex);
+    _dirty.push_back(connection_id);
+}
+
+void outbound_coalescer::on_timer(uS::Timer *timer) {
+    static_cast<outbound_coalescer *>(timer->getData())->flush();
+}
+
+outbound_coalescer &roa::outbound_frames() {
+    static outbound_coalescer coalescer;
+    return coalescer;
+}
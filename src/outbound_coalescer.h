@@ -0,0 +1,160 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <uWS.h>
+#include <string>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <libcuckoo/cuckoohash_map.hh>
+#include "user_connection.h"
+
+namespace roa {
+    // Flushed in this order, a connection's control responses never wait behind its chat or map data.
+    enum outbound_class : uint8_t {
+        // responses to requests and errors, a connection that can't keep up with these is disconnected
+        CONTROL,
+        // chat and other realtime updates, dropped when the queue is full
+        CHAT,
+        // maps and character lists, paced per flush and dropped when the queue is full
+        BULK,
+        OUTBOUND_CLASS_COUNT
+    };
+
+    struct outbound_limits {
+        // bytes held per connection and class before the overflow policy of the class applies
+        std::array<size_t, OUTBOUND_CLASS_COUNT> queue_bytes;
+        // bulk bytes handed to a socket per flush, a larger frame still goes out whole
+        size_t bulk_bytes_per_flush;
+    };
+
+    // Where the coalescer's writes end up, the uws sockets unless a test or benchmark hands it a stand-in.
+    class outbound_socket {
+    public:
+        virtual ~outbound_socket() = default;
+
+        virtual void send(uWS::WebSocket<uWS::SERVER> *ws, char const *data, size_t length, uWS::OpCode op_code, bool compressed) = 0;
+        // payloads of the same kind framed back to back and handed over as one write, payloads may be moved from
+        virtual void send_batch(uWS::WebSocket<uWS::SERVER> *ws, std::vector<std::string> &payloads, uWS::OpCode op_code, bool compressed) = 0;
+        virtual void close(uWS::WebSocket<uWS::SERVER> *ws) = 0;
+        virtual void terminate(uWS::WebSocket<uWS::SERVER> *ws) = 0;
+    };
+
+    // Gathers the frames sent to a connection between two flushes on the uws loop and writes them out together,
+    // so a burst of responses for one client costs one write instead of one per frame.
+    // Frames go out right away, without priorities or limits, until start() is called with a flush interval.
+    class outbound_coalescer {
+    public:
+        outbound_coalescer();
+        explicit outbound_coalescer(std::shared_ptr<outbound_socket> socket);
+        ~outbound_coalescer();
+
+        outbound_coalescer(outbound_coalescer const &) = delete;
+        outbound_coalescer &operator=(outbound_coalescer const &) = delete;
+
+        // has to be called on the thread running the loop, flushing every flush_interval_ms, 0 keeps sending right away
+        void start(uS::Loop *loop, uint32_t flush_interval_ms, outbound_limits limits);
+        void stop();
+        bool enabled() const noexcept;
+
+        // frames for a connection are only held between add and remove, both called on the uws thread
+        void add(user_connection const &connection);
+        void remove(uint64_t connection_id);
+
+        // payloads passed as lvalues are only copied when they're held for the next flush, rvalues are moved
+        void send(user_connection const &connection, std::string const &payload, outbound_class priority = CONTROL);
+        void send(user_connection const &connection, std::string &&payload, outbound_class priority = CONTROL);
+        // compressed is for payloads that are already deflated for permessage-deflate
+        void send(uint64_t connection_id, uWS::WebSocket<uWS::SERVER> *ws, std::string const &payload, outbound_class priority = CONTROL,
+                  uWS::OpCode op_code = uWS::OpCode::TEXT, bool compressed = false);
+        void send(uint64_t connection_id, uWS::WebSocket<uWS::SERVER> *ws, std::string &&payload, outbound_class priority = CONTROL,
+                  uWS::OpCode op_code = uWS::OpCode::TEXT, bool compressed = false);
+
+        // Closes the connection after the control and chat frames sent to it so far are written out, instead of
+        // terminating it with its last frames still held. While coalescing this happens on the next flush.
+        void close(user_connection const &connection);
+
+        // Holds a bulk spot for a payload that is still being encoded, frames behind it wait until it is fulfilled or abandoned.
+        // Returns 0 when frames aren't held, the caller then sends the payload itself once it's encoded.
+        uint64_t reserve(uint64_t connection_id);
+        void fulfill(uint64_t connection_id, uint64_t ticket, std::string payload, uWS::OpCode op_code = uWS::OpCode::TEXT, bool compressed = false);
+        void abandon(uint64_t connection_id, uint64_t ticket);
+
+        // uws thread only, writes out everything held since the previous flush, bulk up to the per flush budget
+        void flush();
+
+        // frames of a class dropped because its queue was full
+        uint64_t dropped(outbound_class priority) const noexcept;
+        // upper bound in microseconds on how long the given fraction of the written frames of a class were held, a power of 2
+        uint64_t held_us(outbound_class priority, double fraction) const noexcept;
+
+    private:
+        struct outbound_frame {
+            std::string payload;
+            uWS::OpCode op_code;
+            bool compressed;
+            uint64_t ticket;
+            bool ready;
+            std::chrono::steady_clock::time_point queued_at;
+        };
+
+        struct pending_frames {
+            uWS::WebSocket<uWS::SERVER> *ws;
+            // vectors rather than deques, an empty deque already allocates and most connections are idle
+            std::array<std::vector<outbound_frame>, OUTBOUND_CLASS_COUNT> queues;
+            std::array<size_t, OUTBOUND_CLASS_COUNT> queued_bytes;
+            uint64_t last_ticket;
+            bool overflowed;
+            bool closing;
+            bool scheduled; // listed for the next flush
+        };
+
+        static void on_timer(uS::Timer *timer);
+        void send_frames(uWS::WebSocket<uWS::SERVER> *ws);
+        void hold(uint64_t connection_id, std::string &&payload, outbound_class priority, uWS::OpCode op_code, bool compressed);
+        bool settle(uint64_t connection_id, uint64_t ticket, std::string *payload, uWS::OpCode op_code, bool compressed);
+        void mark_dirty(uint64_t connection_id);
+        void count_drop(uint64_t connection_id, outbound_class priority);
+        void count_held(outbound_class priority, std::chrono::steady_clock::time_point queued_at, std::chrono::steady_clock::time_point now);
+
+        // bucket i counts frames held for less than 2^i microseconds, the last one everything longer
+        static constexpr size_t held_buckets = 32;
+
+        std::shared_ptr<outbound_socket> _socket;
+        std::atomic<bool> _enabled;
+        outbound_limits _limits;
+        uS::Timer *_timer;
+        cuckoohash_map<uint64_t, pending_frames> _pending;
+        std::mutex _dirty_mutex;
+        std::vector<uint64_t> _dirty; // connections with frames to write out on the next flush
+        std::vector<uint64_t> _flushing;
+        std::vector<outbound_frame> _frames;
+        std::vector<std::string> _batch;
+        std::array<std::atomic<uint64_t>, OUTBOUND_CLASS_COUNT> _dropped;
+        std::array<std::array<std::atomic<uint64_t>, held_buckets>, OUTBOUND_CLASS_COUNT> _held;
+    };
+
+    // Shared by all handlers, started by the uws thread.
+    outbound_coalescer &outbound_frames();
+}
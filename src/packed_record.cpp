@@ -0,0 +1,91 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "packed_record.h"
+#include <cstring>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    void store_big_endian(char *data, uint32_t value) noexcept {
+        for(size_t i = 0; i < sizeof(value); i++) {
+            data[i] = static_cast<char>(value >> (8 * (sizeof(value) - 1 - i)));
+        }
+    }
+
+    uint32_t load_big_endian(char const *data) noexcept {
+        uint32_t value = 0;
+        for(size_t i = 0; i < sizeof(value); i++) {
+            value = (value << 8) | static_cast<unsigned char>(data[i]);
+        }
+        return value;
+    }
+}
+
+packed_record_writer::packed_record_writer() : _buffer(packed_record_magic, sizeof(packed_record_magic)), _count(0) {
+    _buffer.resize(packed_record_header_size);
+}
+
+void packed_record_writer::append(string const &message) {
+    char length[sizeof(uint32_t)];
+    store_big_endian(length, static_cast<uint32_t>(message.size()));
+    _buffer.append(length, sizeof(length));
+    _buffer.append(message);
+    _count++;
+}
+
+string packed_record_writer::take() {
+    store_big_endian(&_buffer[sizeof(packed_record_magic)], _count);
+
+    string record;
+    record.swap(_buffer);
+    _buffer.assign(packed_record_magic, sizeof(packed_record_magic));
+    _buffer.resize(packed_record_header_size);
+    _count = 0;
+    return record;
+}
+
+bool roa::is_packed_record(char const *data, size_t length) noexcept {
+    return length >= packed_record_header_size && memcmp(data, packed_record_magic, sizeof(packed_record_magic)) == 0;
+}
+
+bool roa::split_packed_record(char const *data, size_t length, vector<pair<char const *, size_t>> &messages) {
+    if(!is_packed_record(data, length)) {
+        return false;
+    }
+
+    auto count = load_big_endian(data + sizeof(packed_record_magic));
+    size_t offset = packed_record_header_size;
+    for(uint32_t i = 0; i < count; i++) {
+        if(length - offset < sizeof(uint32_t)) {
+            return false;
+        }
+
+        size_t message_length = load_big_endian(data + offset);
+        offset += sizeof(uint32_t);
+        if(message_length > length - offset) {
+            return false;
+        }
+
+        messages.emplace_back(data + offset, message_length);
+        offset += message_length;
+    }
+
+    return offset == length;
+}
@@ -0,0 +1,73 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+namespace roa {
+    // Kafka record carrying several messages for one partition, all integers big endian:
+    //   0  magic "RPK1"
+    //   4  count, uint32, number of messages
+    //   8  count times a uint32 length followed by that many bytes of serialized message
+    // Like the multicast envelope, the magic never starts a message of the common library.
+    constexpr char packed_record_magic[4] = {'R', 'P', 'K', '1'};
+    constexpr size_t packed_record_header_size = 8;
+
+    class packed_record_writer {
+    public:
+        packed_record_writer();
+
+        void append(std::string const &message);
+
+        // bytes the record has when taken now
+        size_t size() const noexcept {
+            return _buffer.size();
+        }
+
+        // bytes the record would have with message appended
+        size_t size_with(std::string const &message) const noexcept {
+            return _buffer.size() + sizeof(uint32_t) + message.size();
+        }
+
+        uint32_t count() const noexcept {
+            return _count;
+        }
+
+        bool empty() const noexcept {
+            return _count == 0;
+        }
+
+        // hands out the record and starts a new one
+        std::string take();
+
+    private:
+        std::string _buffer;
+        uint32_t _count;
+    };
+
+    bool is_packed_record(char const *data, size_t length) noexcept;
+
+    // Splits a packed record into the messages it carries, pointing into data.
+    // Returns false when the record is cut short, messages then holds the ones before the cut.
+    bool split_packed_record(char const *data, size_t length, std::vector<std::pair<char const *, size_t>> &messages);
+}
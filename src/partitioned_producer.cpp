@@ -0,0 +1,267 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "partitioned_producer.h"
+#include "kafka_settings.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <algorithm>
+#include <array>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    // big endian, so the key hashes the same no matter which service serialized it
+    array<unsigned char, sizeof(uint64_t)> key_bytes(uint64_t key) noexcept {
+        array<unsigned char, sizeof(uint64_t)> bytes;
+        for(size_t i = 0; i < bytes.size(); i++) {
+            bytes[i] = static_cast<unsigned char>(key >> (8 * (bytes.size() - 1 - i)));
+        }
+        return bytes;
+    }
+
+    cuckoohash_map<uint32_t, interned_string> server_topics;
+}
+
+interned_string roa::server_topic(uint32_t server_id) {
+    interned_string topic;
+    if(server_topics.find(server_id, topic)) {
+        return topic;
+    }
+
+    topic = routing_names().intern("server-" + to_string(server_id));
+    server_topics.insert(server_id, topic);
+    return topic;
+}
+
+partitioned_producer::partitioned_producer(shared_ptr<ikafka_producer<false>> producer, bool partition_keys, uint32_t packing_linger_ms,
+                                           size_t packing_max_bytes)
+        : _producer(producer), _partition_keys(partition_keys), _packing_linger(packing_linger_ms), _packing_max_bytes(packing_max_bytes),
+          _rk(nullptr), _topics_mutex(), _topics(), _partition_counts(), _packs_mutex(), _packs() {
+    if(!_producer) {
+        LOG(ERROR) << NAMEOF(partitioned_producer::partitioned_producer) << " one of the arguments are null";
+        throw runtime_error("one of the arguments are null");
+    }
+
+    if(_packing_linger.count() > 0 && !_partition_keys) {
+        LOG(ERROR) << NAMEOF(partitioned_producer::partitioned_producer) << " packing needs partition keys";
+        throw runtime_error("packing needs partition keys");
+    }
+
+    if(_packing_linger.count() > 0 && _packing_max_bytes <= packed_record_header_size) {
+        LOG(ERROR) << NAMEOF(partitioned_producer::partitioned_producer) << " packing max bytes leaves no room for messages";
+        throw runtime_error("packing max bytes leaves no room for messages");
+    }
+}
+
+partitioned_producer::~partitioned_producer() {
+    // the common producer closes itself, only the keyed one is ours
+    if(_rk != nullptr) {
+        close();
+    }
+}
+
+void partitioned_producer::start(string const &broker_list, uint32_t ack_timeout_ms) {
+    if(!_partition_keys) {
+        _producer->start(broker_list, ack_timeout_ms);
+        return;
+    }
+
+    // started with the same broker list and ack timeout as the common producer, with the Java client's partitioner
+    auto conf = kafka_producer_conf(broker_list, ack_timeout_ms);
+    set_kafka_setting(conf, "partitioner", "murmur2_random");
+
+    char errstr[512];
+    _rk = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+    if(_rk == nullptr) {
+        // only taken over by librdkafka when the producer is created
+        rd_kafka_conf_destroy(conf);
+        LOG(ERROR) << NAMEOF(partitioned_producer::start) << " " << errstr;
+        throw runtime_error(errstr);
+    }
+
+    if(_packing_linger.count() > 0) {
+        fetch_partition_counts();
+    }
+
+    LOG(INFO) << NAMEOF(partitioned_producer::start) << " producing with partition keys, packing linger " << _packing_linger.count() << " ms";
+}
+
+void partitioned_producer::fetch_partition_counts() {
+    // one request for all topics, server-<id> topics aren't known up front
+    rd_kafka_metadata_t const *metadata = nullptr;
+    auto err = rd_kafka_metadata(_rk, 1, nullptr, &metadata, 5000);
+    if(err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        LOG(WARNING) << NAMEOF(partitioned_producer::fetch_partition_counts) << " fetching metadata failed, producing unpacked: " << rd_kafka_err2str(err);
+        return;
+    }
+
+    for(int i = 0; i < metadata->topic_cnt; i++) {
+        auto const &topic = metadata->topics[i];
+        if(topic.err == RD_KAFKA_RESP_ERR_NO_ERROR && topic.partition_cnt > 0) {
+            _partition_counts.emplace(topic.topic, topic.partition_cnt);
+        }
+    }
+    rd_kafka_metadata_destroy(metadata);
+
+    LOG(INFO) << NAMEOF(partitioned_producer::fetch_partition_counts) << " packing for " << _partition_counts.size() << " topics";
+}
+
+void partitioned_producer::poll(uint32_t ms_to_wait) {
+    if(_rk == nullptr) {
+        _producer->poll(ms_to_wait);
+        return;
+    }
+
+    if(_packing_linger.count() > 0) {
+        flush_packs(false);
+        ms_to_wait = min(ms_to_wait, static_cast<uint32_t>(_packing_linger.count()));
+    }
+
+    rd_kafka_poll(_rk, static_cast<int>(ms_to_wait));
+}
+
+void partitioned_producer::close() {
+    if(_rk == nullptr) {
+        if(!_partition_keys) {
+            _producer->close();
+        }
+        return;
+    }
+
+    flush_packs(true);
+    rd_kafka_flush(_rk, 1000);
+
+    {
+        lock_guard<mutex> lock(_topics_mutex);
+        for(auto &topic : _topics) {
+            rd_kafka_topic_destroy(topic.second.handle);
+        }
+        _topics.clear();
+    }
+
+    rd_kafka_destroy(_rk);
+    _rk = nullptr;
+}
+
+bool partitioned_producer::enqueue_record(string const &topic, uint64_t key, string const &record) {
+    if(_rk == nullptr) {
+        return false;
+    }
+
+    produce(topic, key, record);
+    return true;
+}
+
+void partitioned_producer::produce(string const &topic, uint64_t key, string const &payload) {
+    auto state = find_topic(topic);
+    if(unlikely(state == nullptr)) {
+        return;
+    }
+
+    if(_packing_linger.count() == 0 || state->partition_count == 0) {
+        produce_unpacked(topic, state->handle, RD_KAFKA_PARTITION_UA, key, payload);
+        return;
+    }
+
+    // the same partition the partitioner picks for the key unpacked, so a user's messages stay in order either way
+    auto bytes = key_bytes(key);
+    auto partition = rd_kafka_msg_partitioner_murmur2(state->handle, bytes.data(), bytes.size(), state->partition_count, nullptr, nullptr);
+    auto pack_key = make_pair(topic, partition);
+
+    lock_guard<mutex> lock(_packs_mutex);
+    auto existing = _packs.find(pack_key);
+    if(existing != end(_packs) && existing->second.record.size_with(payload) > _packing_max_bytes) {
+        produce_packed(topic, partition, existing->second);
+        _packs.erase(existing);
+    }
+
+    // too large to pack even alone, sent behind whatever was packed for the partition so it still keeps its place
+    if(packed_record_header_size + sizeof(uint32_t) + payload.size() > _packing_max_bytes) {
+        produce_unpacked(topic, state->handle, partition, key, payload);
+        return;
+    }
+
+    auto &pack = _packs[pack_key];
+    if(pack.record.empty()) {
+        pack.handle = state->handle;
+        pack.key = key;
+        pack.deadline = chrono::steady_clock::now() + _packing_linger;
+    }
+
+    pack.record.append(payload);
+}
+
+void partitioned_producer::produce_unpacked(string const &topic, rd_kafka_topic_t *handle, int32_t partition, uint64_t key, string const &payload) {
+    auto bytes = key_bytes(key);
+    if(rd_kafka_produce(handle, partition, RD_KAFKA_MSG_F_COPY, const_cast<char *>(payload.data()), payload.size(), bytes.data(), bytes.size(), nullptr) != 0) {
+        LOG(ERROR) << NAMEOF(partitioned_producer::produce_unpacked) << " producing to " << topic << " failed: " << rd_kafka_err2str(rd_kafka_last_error());
+    }
+}
+
+void partitioned_producer::produce_packed(string const &topic, int32_t partition, pending_pack &pack) {
+    auto count = pack.record.count();
+    auto record = pack.record.take();
+    auto bytes = key_bytes(pack.key);
+
+    if(rd_kafka_produce(pack.handle, partition, RD_KAFKA_MSG_F_COPY, const_cast<char *>(record.data()), record.size(), bytes.data(), bytes.size(), nullptr) != 0) {
+        LOG(ERROR) << NAMEOF(partitioned_producer::produce_packed) << " producing " << count << " packed messages to " << topic << "[" << partition
+                   << "] failed: " << rd_kafka_err2str(rd_kafka_last_error());
+    }
+}
+void partitioned_producer::flush_packs(bool all) {
+    auto now = chrono::steady_clock::now();
+
+    lock_guard<mutex> lock(_packs_mutex);
+    for(auto it = begin(_packs); it != end(_packs);) {
+        if(!all && it->second.deadline > now) {
+            ++it;
+            continue;
+        }
+
+        produce_packed(it->first.first, it->first.second, it->second);
+        it = _packs.erase(it);
+    }
+}
+
+partitioned_producer::topic_state *partitioned_producer::find_topic(string const &topic) {
+    lock_guard<mutex> lock(_topics_mutex);
+    auto existing = _topics.find(topic);
+    if(existing != end(_topics)) {
+        return &existing->second;
+    }
+
+    auto handle = rd_kafka_topic_new(_rk, topic.c_str(), nullptr);
+    if(handle == nullptr) {
+        LOG(ERROR) << NAMEOF(partitioned_producer::find_topic) << " creating topic " << topic << " failed: " << rd_kafka_err2str(rd_kafka_last_error());
+        return nullptr;
+    }
+
+    int32_t partition_count = 0;
+    if(_packing_linger.count() > 0) {
+        auto known = _partition_counts.find(topic);
+        if(known != end(_partition_counts)) {
+            partition_count = known->second;
+        } else {
+            LOG(WARNING) << NAMEOF(partitioned_producer::find_topic) << " no partitions known for " << topic << ", producing it unpacked";
+        }
+    }
+
+    return &_topics.emplace(topic, topic_state{handle, partition_count}).first->second;
+}
@@ -0,0 +1,124 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <rdkafka.h>
+#include <kafka_producer.h>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <map>
+#include <chrono>
+#include <messages/message.h>
+#include "packed_record.h"
+#include "string_interner.h"
+
+namespace roa {
+    // Produces client messages keyed on the user, or the connection before login, so every user's messages land on
+    // one partition in the order the gateway sent them and backends can consume partitions in parallel.
+    // Login and register are the only messages keyed on the connection, there is no user id yet. Switching keys doesn't
+    // reorder anything: handlers only accept the keyed-on-user messages once the login or register response arrived,
+    // so nothing keyed on the connection is still in flight by then.
+    // Partitions are picked with murmur2 like the Java client, so services on other clients agree on where a key lands.
+    // Without partition keys messages go through the common producer unkeyed, like before.
+    // With a packing linger, messages for the same topic and partition are held back up to that long and sent as one
+    // packed record, fewer and larger records instead of one per client action. Backends have to unpack them, and so do
+    // gateways for broadcast and chat_messages, only the kafka_event_consumer does.
+    // A packed record is keyed like its first message and never grows beyond the packing max bytes, a message too large
+    // to fit on its own is produced unpacked after what was packed for its partition.
+    // "server-<id>", the topic the world server with that id consumes, interned in routing_names()
+    interned_string server_topic(uint32_t server_id);
+
+    class partitioned_producer {
+    public:
+        // packing needs partition keys, the partition a message lands on has to be known before it is produced
+        explicit partitioned_producer(std::shared_ptr<ikafka_producer<false>> producer, bool partition_keys,
+                                      uint32_t packing_linger_ms = 0, size_t packing_max_bytes = 0);
+        ~partitioned_producer();
+
+        partitioned_producer(partitioned_producer const &) = delete;
+        partitioned_producer &operator=(partitioned_producer const &) = delete;
+
+        // ack_timeout_ms applies to the keyed producer as well, see kafka_producer_conf
+        // When packing, fetches the partition counts of every topic here instead of blocking the first producer of each.
+        // Topics created later are produced unpacked until the next restart.
+        void start(std::string const &broker_list, uint32_t ack_timeout_ms);
+        // also sends the packed records whose linger ran out, waits no longer than the linger when packing
+        void poll(uint32_t ms_to_wait);
+        // sends whatever is still packed before flushing
+        void close();
+
+        template <class T>
+        void enqueue_message(std::string const &topic, uint64_t key, T const &msg) {
+            if(_rk == nullptr) {
+                _producer->enqueue_message(topic, msg);
+                return;
+            }
+
+            produce(topic, key, serialize(msg));
+        }
+
+        // Produces a record the common library doesn't serialize, like a message view. Only the keyed producer
+        // sends raw records, false without partition keys.
+        bool enqueue_record(std::string const &topic, uint64_t key, std::string const &record);
+
+    private:
+        static std::string serialize(message<false> const &msg) {
+            return msg.serialize();
+        }
+
+        static std::string serialize(message<false> const *msg) {
+            return msg->serialize();
+        }
+
+        struct topic_state {
+            rd_kafka_topic_t *handle;
+            // 0 when the metadata couldn't be fetched, messages for the topic are then produced unpacked
+            int32_t partition_count;
+        };
+
+        struct pending_pack {
+            rd_kafka_topic_t *handle;
+            uint64_t key;
+            packed_record_writer record;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        void fetch_partition_counts();
+        void produce(std::string const &topic, uint64_t key, std::string const &payload);
+        void produce_unpacked(std::string const &topic, rd_kafka_topic_t *handle, int32_t partition, uint64_t key, std::string const &payload);
+        void produce_packed(std::string const &topic, int32_t partition, pending_pack &pack);
+        // sends every pack whose linger ran out, or all of them
+        void flush_packs(bool all);
+        topic_state *find_topic(std::string const &topic);
+
+        std::shared_ptr<ikafka_producer<false>> _producer;
+        bool _partition_keys;
+        std::chrono::milliseconds _packing_linger;
+        size_t _packing_max_bytes;
+        rd_kafka_t *_rk;
+        std::mutex _topics_mutex;
+        std::unordered_map<std::string, topic_state> _topics;
+        // filled once in start, read without a lock afterwards
+        std::unordered_map<std::string, int32_t> _partition_counts;
+        std::mutex _packs_mutex;
+        std::map<std::pair<std::string, int32_t>, pending_pack> _packs;
+    };
+}
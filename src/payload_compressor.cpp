@@ -0,0 +1,284 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "payload_compressor.h"
+#include "user_connection.h"
+#include "outbound_coalescer.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <algorithm>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    // true when the comma separated header value lists token on its own, not as part of another token
+    bool has_token(string const &value, char const *token) {
+        size_t start = 0;
+        while(start <= value.length()) {
+            auto end = min(value.find(',', start), value.length());
+            auto first = start;
+            auto last = end;
+            while(first < last && (value[first] == ' ' || value[first] == '\t')) {
+                first++;
+            }
+            while(last > first && (value[last - 1] == ' ' || value[last - 1] == '\t')) {
+                last--;
+            }
+
+            if(value.compare(first, last - first, token) == 0) {
+                return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+}
+
+payload_compressor::payload_compressor(int level, size_t threshold, string dictionary, size_t cache_entries)
+        : _level(level), _threshold(threshold), _dictionary(move(dictionary)), _cache_entries(max<size_t>(cache_entries, 1)), _streams_mutex(),
+          _idle_streams(), _mutex(), _cache(), _use_counter(0) {
+    if(_threshold == 0) {
+        return;
+    }
+
+    // more streams are created when several threads deflate at once
+    auto streams = acquire_streams();
+    if(!streams) {
+        LOG(ERROR) << NAMEOF(payload_compressor::payload_compressor) << " deflateInit2 failed, compression disabled";
+        _threshold = 0;
+        return;
+    }
+    release_streams(move(streams));
+
+    _cache.reserve(_cache_entries);
+}
+
+payload_compressor::~payload_compressor() {
+    for(auto &entry : _cache) {
+        uWS::WebSocket<uWS::SERVER>::finalizeMessage(entry.prepared);
+    }
+
+    for(auto &streams : _idle_streams) {
+        deflateEnd(&streams->raw);
+        deflateEnd(&streams->dictionary);
+    }
+}
+
+bool payload_compressor::enabled() const noexcept {
+    return _threshold > 0;
+}
+
+bool payload_compressor::has_dictionary() const noexcept {
+    return enabled() && !_dictionary.empty();
+}
+
+void payload_compressor::send(user_connection const &connection, string const &payload) {
+    auto mode = connection.compression;
+    if(!compresses(mode, payload)) {
+        outbound_frames().send(connection, payload, BULK);
+        return;
+    }
+
+    if(outbound_frames().enabled()) {
+        auto encoded = encode(mode, payload);
+        outbound_frames().send(connection.connection_id, connection.ws, move(encoded.bytes), BULK, encoded.op_code, encoded.compressed);
+        return;
+    }
+
+    unique_lock<mutex> lock(_mutex);
+    auto entry = cached(payload, mode, lock);
+    if(entry == nullptr) {
+        lock.unlock();
+        outbound_frames().send(connection, payload, BULK);
+        return;
+    }
+
+    connection.ws->sendPrepared(entry->prepared);
+}
+
+encoded_payload payload_compressor::encode(compression_mode mode, string const &payload) {
+    if(!compresses(mode, payload)) {
+        return encoded_payload{payload, uWS::OpCode::TEXT, false};
+    }
+
+    unique_lock<mutex> lock(_mutex);
+    auto entry = cached(payload, mode, lock);
+    if(entry == nullptr) {
+        return encoded_payload{payload, uWS::OpCode::TEXT, false};
+    }
+
+    return encoded_payload{entry->compressed, mode == PERMESSAGE_DEFLATE ? uWS::OpCode::TEXT : uWS::OpCode::BINARY, mode == PERMESSAGE_DEFLATE};
+}
+
+int payload_compressor::extension_options() const noexcept {
+    return enabled() ? uWS::PERMESSAGE_DEFLATE | uWS::SERVER_NO_CONTEXT_TAKEOVER : uWS::NO_OPTIONS;
+}
+
+compression_mode payload_compressor::negotiated_mode(uWS::HttpRequest &request) const {
+    if(!enabled()) {
+        return NO_COMPRESSION;
+    }
+
+    auto protocol = request.getHeader("sec-websocket-protocol");
+    if(has_dictionary() && protocol && has_token(protocol.toString(), "roa-deflate-dictionary")) {
+        return PRESET_DICTIONARY;
+    }
+
+    auto extensions = request.getHeader("sec-websocket-extensions");
+    if(!extensions) {
+        return NO_COMPRESSION;
+    }
+
+    // the same negotiation the hub runs for the upgrade response, so only clients that got permessage-deflate back get deflated frames
+    uWS::ExtensionsNegotiator<uWS::SERVER> negotiator(extension_options());
+    negotiator.readOffer(extensions.toString());
+    return (negotiator.getNegotiatedOptions() & uWS::PERMESSAGE_DEFLATE) != 0 ? PERMESSAGE_DEFLATE : NO_COMPRESSION;
+}
+
+bool payload_compressor::compresses(compression_mode mode, string const &payload) const noexcept {
+    return mode != NO_COMPRESSION && enabled() && payload.length() >= _threshold && (mode != PRESET_DICTIONARY || !_dictionary.empty());
+}
+
+payload_compressor::cache_entry *payload_compressor::cached(string const &payload, compression_mode mode, unique_lock<mutex> &lock) {
+    auto hash = std::hash<string>{}(payload);
+    auto entry = find_entry(hash, mode, payload);
+    if(entry != nullptr) {
+        return entry;
+    }
+
+    lock.unlock();
+    string compressed;
+    auto deflated = deflate_payload(payload, mode, compressed);
+    lock.lock();
+
+    if(!deflated) {
+        return nullptr;
+    }
+
+    // another thread may have cached the same payload while this one was deflating
+    entry = find_entry(hash, mode, payload);
+    if(entry != nullptr) {
+        return entry;
+    }
+
+    return insert(payload, hash, mode, move(compressed));
+}
+
+payload_compressor::cache_entry *payload_compressor::find_entry(size_t hash, compression_mode mode, string const &payload) {
+    auto entry = find_if(begin(_cache), end(_cache), [&](cache_entry const &e) {
+        return e.hash == hash && e.mode == mode && e.payload == payload;
+    });
+
+    if(entry == end(_cache)) {
+        return nullptr;
+    }
+
+    entry->last_used = ++_use_counter;
+    return &*entry;
+}
+
+payload_compressor::cache_entry *payload_compressor::insert(string const &payload, size_t hash, compression_mode mode, string compressed) {
+    LOG(DEBUG) << NAMEOF(payload_compressor::insert) << " compressed " << payload.length() << " bytes to " << compressed.length();
+
+    auto prepared = mode == PERMESSAGE_DEFLATE ?
+                    uWS::WebSocket<uWS::SERVER>::prepareMessage(&compressed[0], compressed.length(), uWS::OpCode::TEXT, true) :
+                    uWS::WebSocket<uWS::SERVER>::prepareMessage(&compressed[0], compressed.length(), uWS::OpCode::BINARY, false);
+
+    if(_cache.size() >= _cache_entries) {
+        auto oldest = min_element(begin(_cache), end(_cache), [](cache_entry const &a, cache_entry const &b) {
+            return a.last_used < b.last_used;
+        });
+        uWS::WebSocket<uWS::SERVER>::finalizeMessage(oldest->prepared);
+        _cache.erase(oldest);
+    }
+
+    _cache.push_back(cache_entry{hash, mode, payload, move(compressed), prepared, ++_use_counter});
+    return &_cache.back();
+}
+
+bool payload_compressor::deflate_payload(string const &payload, compression_mode mode, string &out) {
+    auto streams = acquire_streams();
+    if(!streams) {
+        LOG(ERROR) << NAMEOF(payload_compressor::deflate_payload) << " deflateInit2 failed";
+        return false;
+    }
+
+    auto deflated = deflate_with(mode == PERMESSAGE_DEFLATE ? streams->raw : streams->dictionary, payload, mode, out);
+    release_streams(move(streams));
+    return deflated;
+}
+
+bool payload_compressor::deflate_with(z_stream &stream, string const &payload, compression_mode mode, string &out) {
+    deflateReset(&stream);
+    if(mode == PRESET_DICTIONARY &&
+       deflateSetDictionary(&stream, reinterpret_cast<Bytef const *>(_dictionary.data()), static_cast<uInt>(_dictionary.length())) != Z_OK) {
+        LOG(ERROR) << NAMEOF(payload_compressor::deflate_with) << " deflateSetDictionary failed";
+        return false;
+    }
+
+    out.resize(deflateBound(&stream, payload.length()) + 6);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(payload.data()));
+    stream.avail_in = static_cast<uInt>(payload.length());
+    stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.length());
+
+    auto ret = deflate(&stream, mode == PERMESSAGE_DEFLATE ? Z_SYNC_FLUSH : Z_FINISH);
+    if((mode == PERMESSAGE_DEFLATE && ret != Z_OK) || (mode == PRESET_DICTIONARY && ret != Z_STREAM_END)) {
+        LOG(ERROR) << NAMEOF(payload_compressor::deflate_with) << " deflate failed with " << ret;
+        return false;
+    }
+
+    out.resize(out.length() - stream.avail_out);
+
+    // RFC 7692 7.2.1, the trailing 00 00 ff ff of the sync flush is implied
+    if(mode == PERMESSAGE_DEFLATE && out.length() >= 4) {
+        out.resize(out.length() - 4);
+    }
+
+    return true;
+}
+
+unique_ptr<payload_compressor::deflate_streams> payload_compressor::acquire_streams() {
+    {
+        lock_guard<mutex> lock(_streams_mutex);
+        if(!_idle_streams.empty()) {
+            auto streams = move(_idle_streams.back());
+            _idle_streams.pop_back();
+            return streams;
+        }
+    }
+
+    auto streams = make_unique<deflate_streams>();
+    // negative window bits produce raw deflate, which is what permessage-deflate expects
+    if(deflateInit2(&streams->raw, _level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nullptr;
+    }
+
+    if(deflateInit2(&streams->dictionary, _level, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        deflateEnd(&streams->raw);
+        return nullptr;
+    }
+
+    return streams;
+}
+
+void payload_compressor::release_streams(unique_ptr<deflate_streams> streams) {
+    lock_guard<mutex> lock(_streams_mutex);
+    _idle_streams.push_back(move(streams));
+}
@@ -0,0 +1,108 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <uWS.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace roa {
+    struct user_connection;
+
+    enum compression_mode : uint8_t {
+        NO_COMPRESSION,
+        // negotiated permessage-deflate (RFC 7692), raw deflate frames with RSV1 set
+        PERMESSAGE_DEFLATE,
+        // opted in through the roa-deflate-dictionary sub-protocol, zlib streams using our preset dictionary in BINARY frames
+        PRESET_DICTIONARY
+    };
+
+    // A payload as it goes on the wire, compressed for a connection or as it was.
+    struct encoded_payload {
+        std::string bytes;
+        uWS::OpCode op_code;
+        // deflated for permessage-deflate, the frame needs RSV1 set
+        bool compressed;
+    };
+
+    // Compresses large outbound payloads once and keeps the framed result around, so the same map or
+    // character list sent to many clients is only deflated once.
+    class payload_compressor {
+    public:
+        explicit payload_compressor(int level, size_t threshold, std::string dictionary, size_t cache_entries);
+        ~payload_compressor();
+
+        payload_compressor(payload_compressor const &) = delete;
+        payload_compressor &operator=(payload_compressor const &) = delete;
+
+        bool enabled() const noexcept;
+        bool has_dictionary() const noexcept;
+
+        // payloads go through outbound_frames() as bulk, compressed or not
+        void send(user_connection const &connection, std::string const &payload);
+        // safe to call from several threads at once, different payloads are deflated in parallel
+        encoded_payload encode(compression_mode mode, std::string const &payload);
+
+        // what the hub has to be created with, negotiated_mode() relies on it
+        int extension_options() const noexcept;
+        // the mode uWS agreed on with the client during the upgrade of request
+        compression_mode negotiated_mode(uWS::HttpRequest &request) const;
+
+    private:
+        using prepared_message = uWS::WebSocket<uWS::SERVER>::PreparedMessage;
+
+        struct cache_entry {
+            size_t hash;
+            compression_mode mode;
+            std::string payload;
+            // kept next to the framed copy, the outbound queue needs the bytes to outlive an eviction
+            std::string compressed;
+            prepared_message *prepared;
+            uint64_t last_used;
+        };
+
+        struct deflate_streams {
+            z_stream raw;
+            z_stream dictionary;
+        };
+
+        bool compresses(compression_mode mode, std::string const &payload) const noexcept;
+        // the entry for payload, deflated without holding lock when it isn't cached yet, nullptr when deflating failed
+        cache_entry *cached(std::string const &payload, compression_mode mode, std::unique_lock<std::mutex> &lock);
+        cache_entry *find_entry(size_t hash, compression_mode mode, std::string const &payload);
+        cache_entry *insert(std::string const &payload, size_t hash, compression_mode mode, std::string compressed);
+        bool deflate_payload(std::string const &payload, compression_mode mode, std::string &out);
+        bool deflate_with(z_stream &stream, std::string const &payload, compression_mode mode, std::string &out);
+        std::unique_ptr<deflate_streams> acquire_streams();
+        void release_streams(std::unique_ptr<deflate_streams> streams);
+
+        int _level;
+        size_t _threshold;
+        std::string _dictionary;
+        size_t _cache_entries;
+        std::mutex _streams_mutex;
+        std::vector<std::unique_ptr<deflate_streams>> _idle_streams;
+        std::mutex _mutex;
+        std::vector<cache_entry> _cache;
+        uint64_t _use_counter;
+    };
+}
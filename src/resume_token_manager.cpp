@@ -0,0 +1,210 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resume_token_manager.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    int64_t now_in_seconds() {
+        return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    string to_hex(unsigned char const *data, size_t length) {
+        static char const digits[] = "0123456789abcdef";
+        string ret;
+        ret.reserve(length * 2);
+        for(size_t i = 0; i < length; i++) {
+            ret.push_back(digits[data[i] >> 4]);
+            ret.push_back(digits[data[i] & 0x0F]);
+        }
+        return ret;
+    }
+
+    STD_OPTIONAL<string> from_hex(string const &hex) {
+        if(hex.length() % 2 != 0) {
+            return {};
+        }
+
+        auto nibble = [](char c) -> int {
+            if(c >= '0' && c <= '9') return c - '0';
+            if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+            return -1;
+        };
+
+        string ret;
+        ret.reserve(hex.length() / 2);
+        for(size_t i = 0; i < hex.length(); i += 2) {
+            int high = nibble(hex[i]);
+            int low = nibble(hex[i + 1]);
+            if(high < 0 || low < 0) {
+                return {};
+            }
+            ret.push_back(static_cast<char>((high << 4) | low));
+        }
+        return ret;
+    }
+}
+
+resume_token_manager::resume_token_manager(string secret, chrono::seconds ttl)
+        : _secret(move(secret)), _ttl(ttl), _sessions() {
+    if(!_secret.empty() && _secret.length() < 32) {
+        LOG(WARNING) << NAMEOF(resume_token_manager::resume_token_manager) << " resume token secret is shorter than 32 characters";
+    }
+}
+
+bool resume_token_manager::enabled() const noexcept {
+    return !_secret.empty() && _ttl.count() > 0;
+}
+
+chrono::seconds resume_token_manager::ttl() const noexcept {
+    return _ttl;
+}
+
+string resume_token_manager::issue(session_state const &session) {
+    if(!enabled()) {
+        return {};
+    }
+
+    uint64_t nonce;
+    if(RAND_bytes(reinterpret_cast<unsigned char *>(&nonce), sizeof(nonce)) != 1) {
+        LOG(ERROR) << NAMEOF(resume_token_manager::issue) << " RAND_bytes failed, not issuing token";
+        return {};
+    }
+
+    int64_t expires_at = now_in_seconds() + _ttl.count();
+    // username goes last, it's the only field that can contain the separator
+    string payload = to_string(session.user_id) + ":" + to_string(session.admin_status) + ":" +
+                     to_string(expires_at) + ":" + to_string(nonce) + ":" + session.username;
+
+    cached_session cached{nonce, expires_at, session.player_characters};
+    _sessions.upsert(session.user_id, [&](cached_session &existing) {
+        existing = cached;
+    }, cached);
+
+    return to_hex(reinterpret_cast<unsigned char const *>(payload.data()), payload.length()) + "." + sign(payload);
+}
+
+void resume_token_manager::update_characters(uint64_t user_id, vector<player_character> const &player_characters) {
+    if(!enabled()) {
+        return;
+    }
+
+    _sessions.update_fn(user_id, [&](cached_session &session) {
+        session.player_characters = player_characters;
+    });
+}
+
+STD_OPTIONAL<resumable_session> resume_token_manager::redeem(string const &token) {
+    if(!enabled()) {
+        return {};
+    }
+
+    auto separator = token.find('.');
+    if(separator == string::npos) {
+        return {};
+    }
+
+    auto payload = from_hex(token.substr(0, separator));
+    if(!payload) {
+        return {};
+    }
+
+    auto expected_signature = sign(payload.value());
+    auto signature = token.substr(separator + 1);
+    if(signature.length() != expected_signature.length() ||
+       CRYPTO_memcmp(signature.data(), expected_signature.data(), signature.length()) != 0) {
+        LOG(WARNING) << NAMEOF(resume_token_manager::redeem) << " token with invalid signature";
+        return {};
+    }
+
+    size_t fields[4];
+    size_t position = 0;
+    for(auto &field : fields) {
+        field = payload->find(':', position);
+        if(field == string::npos) {
+            return {};
+        }
+        position = field + 1;
+    }
+
+    resumable_session session;
+    session.user_id = stoull(payload->substr(0, fields[0]));
+    session.admin_status = static_cast<int8_t>(stoi(payload->substr(fields[0] + 1, fields[1] - fields[0] - 1)));
+    int64_t expires_at = stoll(payload->substr(fields[1] + 1, fields[2] - fields[1] - 1));
+    uint64_t nonce = stoull(payload->substr(fields[2] + 1, fields[3] - fields[2] - 1));
+    session.username = payload->substr(fields[3] + 1);
+
+    if(expires_at < now_in_seconds()) {
+        LOG(DEBUG) << NAMEOF(resume_token_manager::redeem) << " expired token for user " << session.user_id;
+        return {};
+    }
+
+    // tokens are single use, the cached session is what makes one redeemable and a newer token replaces it
+    bool redeemed = false;
+    _sessions.erase_fn(session.user_id, [&](cached_session &cached) {
+        if(cached.nonce != nonce) {
+            return false;
+        }
+        session.player_characters = move(cached.player_characters);
+        redeemed = true;
+        return true;
+    });
+
+    if(!redeemed) {
+        LOG(WARNING) << NAMEOF(resume_token_manager::redeem) << " token for user " << session.user_id << " was already redeemed, superseded or issued elsewhere";
+        return {};
+    }
+
+    return session;
+}
+
+void resume_token_manager::purge_expired() {
+    auto now = now_in_seconds();
+    vector<uint64_t> expired;
+
+    {
+        auto locked_table = _sessions.lock_table();
+        for(auto const &session : locked_table) {
+            if(session.second.expires_at < now) {
+                expired.push_back(session.first);
+            }
+        }
+    }
+
+    for(auto user_id : expired) {
+        _sessions.erase_fn(user_id, [now](cached_session &session) {
+            return session.expires_at < now;
+        });
+    }
+}
+
+string resume_token_manager::sign(string const &payload) const {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_length = 0;
+    HMAC(EVP_sha256(), _secret.data(), static_cast<int>(_secret.length()),
+         reinterpret_cast<unsigned char const *>(payload.data()), payload.length(), digest, &digest_length);
+    return to_hex(digest, digest_length);
+}
@@ -0,0 +1,64 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <custom_optional.h>
+#include <libcuckoo/cuckoohash_map.hh>
+#include "user_connection.h"
+
+namespace roa {
+    struct resumable_session {
+        uint64_t user_id;
+        int8_t admin_status;
+        std::string username;
+        std::vector<player_character> player_characters;
+    };
+
+    // Issues short-lived, HMAC signed tokens that let a client restore its login on a new socket.
+    // A token is redeemed once, on the gateway that issued it and only while that gateway keeps the cached session.
+    // After a restart or on another gateway the client logs in again.
+    class resume_token_manager {
+    public:
+        explicit resume_token_manager(std::string secret, std::chrono::seconds ttl);
+
+        bool enabled() const noexcept;
+        std::chrono::seconds ttl() const noexcept;
+
+        std::string issue(session_state const &session);
+        void update_characters(uint64_t user_id, std::vector<player_character> const &player_characters);
+        STD_OPTIONAL<resumable_session> redeem(std::string const &token);
+        void purge_expired();
+
+    private:
+        struct cached_session {
+            uint64_t nonce;
+            int64_t expires_at;
+            std::vector<player_character> player_characters;
+        };
+
+        std::string sign(std::string const &payload) const;
+
+        std::string _secret;
+        std::chrono::seconds _ttl;
+        cuckoohash_map<uint64_t, cached_session> _sessions;
+    };
+}
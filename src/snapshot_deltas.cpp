@@ -0,0 +1,144 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "snapshot_deltas.h"
+#include <algorithm>
+#include <easylogging++.h>
+#include <macros.h>
+#include "gateway_messages/snapshot_messages.h"
+
+using namespace std;
+using namespace roa;
+using json = nlohmann::json;
+
+struct snapshot_deltas::sent_snapshot {
+    // written by the encoding thread, read by whoever encodes against it once acknowledged, through atomic_load/atomic_store
+    shared_ptr<string const> text;
+};
+
+snapshot_deltas::snapshot_deltas(size_t history, vector<uint32_t> streams) : _history(history), _streams(move(streams)), _connections() {
+    if(history == 0) {
+        LOG(ERROR) << NAMEOF(snapshot_deltas::snapshot_deltas) << " history has to be greater than 0";
+        throw runtime_error("[snapshot_deltas] history has to be greater than 0");
+    }
+}
+
+void snapshot_deltas::add(uint64_t connection_id) {
+    _connections.insert(connection_id, connection_streams{});
+}
+
+void snapshot_deltas::acknowledge(uint64_t connection_id, uint32_t stream, uint64_t sequence) {
+    if(find(begin(_streams), end(_streams), stream) == end(_streams)) {
+        return;
+    }
+
+    // update_fn never inserts, a late acknowledgement can't bring back a removed connection
+    _connections.update_fn(connection_id, [&](connection_streams &streams) {
+        auto state = find_stream(streams, stream);
+        if(state == nullptr) {
+            // opting in
+            streams.push_back(stream_state{stream, 0, 0, {}, {}, {}});
+            return;
+        }
+
+        auto acknowledged = find_if(begin(state->unacknowledged), end(state->unacknowledged), [&](auto const &sent) {
+            return sent.first == sequence;
+        });
+
+        // duplicate, stale or never sent
+        if(acknowledged == end(state->unacknowledged)) {
+            return;
+        }
+
+        state->baseline_sequence = acknowledged->first;
+        state->baseline = move(acknowledged->second);
+        state->baseline_document.reset();
+        state->unacknowledged.erase(begin(state->unacknowledged), acknowledged + 1);
+    });
+}
+
+STD_OPTIONAL<snapshot_deltas::reservation> snapshot_deltas::reserve(uint64_t connection_id, uint32_t stream) {
+    STD_OPTIONAL<reservation> reserved;
+    _connections.update_fn(connection_id, [&](connection_streams &streams) {
+        auto state = find_stream(streams, stream);
+        if(state == nullptr) {
+            return;
+        }
+
+        auto sent = make_shared<sent_snapshot>();
+        reserved = reservation{connection_id, stream, ++state->last_sequence, state->baseline_sequence, state->baseline, state->baseline_document, sent};
+        state->unacknowledged.emplace_back(reserved->sequence, move(sent));
+
+        if(state->unacknowledged.size() > _history) {
+            // the client stopped acknowledging, frames may be getting lost, start over from a full snapshot
+            state->unacknowledged.pop_front();
+            state->baseline_sequence = 0;
+            state->baseline.reset();
+            state->baseline_document.reset();
+        }
+    });
+    return reserved;
+}
+
+string snapshot_deltas::fulfill(reservation const &reserved, string const &snapshot) {
+    // stored before the frame goes out, so it's there when the client acknowledges it
+    atomic_store(&reserved.sent->text, make_shared<string const>(snapshot));
+
+    // a baseline without text was acknowledged before it was sent, or its encoding failed
+    auto baseline = reserved.baseline ? atomic_load(&reserved.baseline->text) : shared_ptr<string const>{};
+    if(baseline) {
+        auto baseline_document = reserved.baseline_document;
+        if(!baseline_document) {
+            baseline_document = make_shared<json const>(json::parse(*baseline));
+            _connections.update_fn(reserved.connection_id, [&](connection_streams &streams) {
+                auto state = find_stream(streams, reserved.stream);
+                if(state != nullptr && state->baseline == reserved.baseline && !state->baseline_document) {
+                    state->baseline_document = baseline_document;
+                }
+            });
+        }
+
+        auto patch = json::diff(*baseline_document, json::parse(snapshot)).dump();
+        if(patch.size() < snapshot.size()) {
+            return snapshot_message{reserved.stream, reserved.sequence, reserved.baseline_sequence, patch}.serialize();
+        }
+    }
+
+    return snapshot_message{reserved.stream, reserved.sequence, {}, snapshot}.serialize();
+}
+
+STD_OPTIONAL<string> snapshot_deltas::encode(uint64_t connection_id, uint32_t stream, string const &snapshot) {
+    auto reserved = reserve(connection_id, stream);
+    if(!reserved) {
+        return {};
+    }
+    return fulfill(reserved.value(), snapshot);
+}
+
+void snapshot_deltas::remove(uint64_t connection_id) {
+    _connections.erase(connection_id);
+}
+
+snapshot_deltas::stream_state *snapshot_deltas::find_stream(connection_streams &streams, uint32_t stream) noexcept {
+    for(auto &state : streams) {
+        if(state.stream == stream) {
+            return &state;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,88 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <json.hpp>
+#include <custom_optional.h>
+#include <libcuckoo/cuckoohash_map.hh>
+
+namespace roa {
+    // Per connection baselines for snapshot streams. Connections that opted in with a snapshot_ack_message get
+    // snapshot_message frames carrying a JSON Patch against the last snapshot they acknowledged, or the full
+    // snapshot when they have no baseline yet, the patch isn't smaller or they stopped acknowledging.
+    // Clients keep an acknowledged snapshot until a frame references a newer baseline.
+    class snapshot_deltas {
+    public:
+        // what was sent for a sequence, filled in once the snapshot is encoded
+        struct sent_snapshot;
+        using sent_ptr = std::shared_ptr<sent_snapshot>;
+        using document_ptr = std::shared_ptr<nlohmann::json const>;
+
+        // the sequence and baseline of a snapshot that is still being encoded
+        struct reservation {
+            uint64_t connection_id;
+            uint32_t stream;
+            uint64_t sequence;
+            uint64_t baseline_sequence;
+            sent_ptr baseline;
+            document_ptr baseline_document;
+            sent_ptr sent;
+        };
+
+        // history is the number of unacknowledged snapshots kept per stream before falling back to full snapshots,
+        // streams are the only streams connections can opt into
+        explicit snapshot_deltas(size_t history, std::vector<uint32_t> streams);
+
+        // connections have to be added before they can opt in, acknowledgements for unknown connections are ignored
+        void add(uint64_t connection_id);
+        void acknowledge(uint64_t connection_id, uint32_t stream, uint64_t sequence);
+        // Takes the next sequence and the current baseline, in the order snapshots are sent to the connection.
+        // Nothing when the connection didn't opt in for this stream.
+        STD_OPTIONAL<reservation> reserve(uint64_t connection_id, uint32_t stream);
+        // the frame to send instead of snapshot, safe to call from another thread than reserve and in any order
+        std::string fulfill(reservation const &reserved, std::string const &snapshot);
+        // reserve and fulfill in one go
+        STD_OPTIONAL<std::string> encode(uint64_t connection_id, uint32_t stream, std::string const &snapshot);
+        void remove(uint64_t connection_id);
+
+    private:
+        struct stream_state {
+            uint32_t stream;
+            uint64_t last_sequence;
+            uint64_t baseline_sequence;
+            sent_ptr baseline;
+            // parsed on the first diff against the baseline and reused until the next acknowledgement
+            document_ptr baseline_document;
+            std::deque<std::pair<uint64_t, sent_ptr>> unacknowledged;
+        };
+
+        // one entry per opted in stream, there are only a handful of streams
+        using connection_streams = std::vector<stream_state>;
+
+        static stream_state *find_stream(connection_streams &streams, uint32_t stream) noexcept;
+
+        size_t _history;
+        std::vector<uint32_t> _streams;
+        cuckoohash_map<uint64_t, connection_streams> _connections;
+    };
+}
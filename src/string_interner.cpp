@@ -0,0 +1,67 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "string_interner.h"
+
+using namespace std;
+using namespace roa;
+
+static string const empty_string;
+
+interned_string::interned_string() noexcept : _id(0), _value(&empty_string) {
+
+}
+
+string_interner::string_interner() : _handles(), _insert_mutex(), _values() {
+    // id 0 is the empty string, matching default constructed handles
+    _values.emplace_back();
+    _handles.insert(string(), interned_string());
+}
+
+interned_string string_interner::intern(string const &value) {
+    interned_string handle;
+    if(_handles.find(value, handle)) {
+        return handle;
+    }
+
+    lock_guard<mutex> lock(_insert_mutex);
+    if(_handles.find(value, handle)) {
+        return handle;
+    }
+
+    _values.push_back(value);
+    handle = interned_string(static_cast<uint32_t>(_values.size() - 1), &_values.back());
+    _handles.insert(value, handle);
+    return handle;
+}
+
+interned_string string_interner::intern(string_view value) {
+    thread_local string key;
+    key.assign(value.data(), value.size());
+    return intern(key);
+}
+
+string_interner &roa::location_names() {
+    static string_interner interner;
+    return interner;
+}
+
+string_interner &roa::routing_names() {
+    static string_interner interner;
+    return interner;
+}
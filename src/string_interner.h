@@ -0,0 +1,80 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+#include <libcuckoo/cuckoohash_map.hh>
+
+namespace roa {
+    // Handle to a string owned by a string_interner. Equal strings from the same interner share an id,
+    // so comparing handles is an integer compare and copying one never allocates.
+    class interned_string {
+    public:
+        interned_string() noexcept;
+
+        uint32_t id() const noexcept {
+            return _id;
+        }
+
+        std::string const &str() const noexcept {
+            return *_value;
+        }
+
+        bool operator==(interned_string const &other) const noexcept {
+            return _id == other._id;
+        }
+
+        bool operator!=(interned_string const &other) const noexcept {
+            return _id != other._id;
+        }
+
+    private:
+        friend class string_interner;
+        interned_string(uint32_t id, std::string const *value) noexcept : _id(id), _value(value) {}
+
+        uint32_t _id;
+        std::string const *_value;
+    };
+
+    // Strings are never removed, handles stay valid for the lifetime of the interner.
+    // Meant for small vocabularies like map and world names. Lookups of known strings don't take the insert mutex,
+    // only the lock of the cuckoohash buckets they land in, so they don't wait on each other or on inserts of other strings.
+    class string_interner {
+    public:
+        string_interner();
+
+        interned_string intern(std::string const &value);
+        // looks the value up through a buffer reused per thread, so only strings seen for the first time allocate
+        interned_string intern(std::string_view value);
+
+    private:
+        cuckoohash_map<std::string, interned_string> _handles;
+        std::mutex _insert_mutex;
+        std::deque<std::string> _values; // deque keeps addresses stable while growing
+    };
+
+    // Map and world names of every connection on this gateway.
+    string_interner &location_names();
+    // Chat channels and kafka topics derived from map, world and server names, built once instead of per message.
+    string_interner &routing_names();
+}
@@ -0,0 +1,130 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "thread_placement.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cstdlib>
+#include <cctype>
+
+using namespace std;
+using namespace roa;
+
+// what the process may run on before any thread is pinned, read during static initialization on the main thread
+static cpu_set_t read_process_affinity() noexcept {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) != 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return set;
+}
+
+static cpu_set_t const process_affinity = read_process_affinity();
+
+// strtol also takes leading whitespace and signs, a cpu number starts with a digit
+static bool starts_cpu_number(char const *it) noexcept {
+    return isdigit(static_cast<unsigned char>(*it)) != 0;
+}
+
+STD_OPTIONAL<vector<int>> roa::parse_cpu_list(string const &cpu_list) {
+    vector<int> cpus;
+    char const *it = cpu_list.c_str();
+
+    while(*it != '\0') {
+        if(!starts_cpu_number(it)) {
+            return {};
+        }
+
+        char *end;
+        long first = strtol(it, &end, 10);
+        if(end == it || first < 0 || first >= CPU_SETSIZE) {
+            return {};
+        }
+        long last = first;
+        it = end;
+
+        if(*it == '-') {
+            it++;
+            if(!starts_cpu_number(it)) {
+                return {};
+            }
+
+            last = strtol(it, &end, 10);
+            if(end == it || last < first || last >= CPU_SETSIZE) {
+                return {};
+            }
+            it = end;
+        }
+
+        for(long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+
+        if(*it == ',') {
+            it++;
+            if(*it == '\0') {
+                return {};
+            }
+        } else if(*it != '\0') {
+            return {};
+        }
+    }
+
+    return cpus;
+}
+
+bool roa::place_current_thread(string const &name, string const &cpu_list) {
+    // linux limits thread names to 15 characters
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+    // threads inherit the mask of the thread that created them, undo whatever their creator was pinned to
+    if(cpu_list.empty()) {
+        auto ret = pthread_setaffinity_np(pthread_self(), sizeof(process_affinity), &process_affinity);
+        if(ret != 0) {
+            LOG(WARNING) << NAMEOF(place_current_thread) << " could not reset the affinity of " << name << ", error " << ret;
+            return false;
+        }
+        return true;
+    }
+
+    auto cpus = parse_cpu_list(cpu_list);
+    if(!cpus || cpus->empty()) {
+        LOG(WARNING) << NAMEOF(place_current_thread) << " malformed cpu list \"" << cpu_list << "\" for " << name << ", not pinning";
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(auto cpu : cpus.value()) {
+        CPU_SET(cpu, &set);
+    }
+
+    auto ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(ret != 0) {
+        LOG(WARNING) << NAMEOF(place_current_thread) << " could not pin " << name << " to " << cpu_list << ", error " << ret;
+        return false;
+    }
+
+    LOG(INFO) << NAMEOF(place_current_thread) << " pinned " << name << " to " << cpu_list;
+    return true;
+}
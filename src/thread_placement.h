@@ -0,0 +1,33 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <custom_optional.h>
+
+namespace roa {
+    // Parses a cpu list like "0-3,8", digits only. Returns nothing when the list is malformed.
+    STD_OPTIONAL<std::vector<int>> parse_cpu_list(std::string const &cpu_list);
+
+    // Names the calling thread and pins it to the cpus in cpu_list, or to every cpu the process started with when
+    // cpu_list is empty, so a thread never keeps the pinning it inherited from the thread that created it.
+    // Call this before allocating state the thread owns, the kernel places pages on the node that first touches them.
+    bool place_current_thread(std::string const &name, std::string const &cpu_list);
+}
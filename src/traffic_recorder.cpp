@@ -0,0 +1,106 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "traffic_recorder.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <stdexcept>
+#include <cstring>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace roa;
+
+static uint64_t padded(uint64_t length) noexcept {
+    return (length + 7) & ~static_cast<uint64_t>(7);
+}
+
+traffic_recorder::traffic_recorder(string const &file, uint64_t max_bytes)
+        : _fd(-1), _mapping(nullptr), _capacity(padded(max_bytes)), _offset(sizeof(traffic_capture_magic) + sizeof(uint64_t)), _dropped(0),
+          _start(chrono::steady_clock::now()) {
+    if(_capacity < _offset) {
+        LOG(ERROR) << NAMEOF(traffic_recorder::traffic_recorder) << " max_bytes too small";
+        throw runtime_error("[traffic_recorder] max_bytes too small");
+    }
+
+    _fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(_fd < 0) {
+        LOG(ERROR) << NAMEOF(traffic_recorder::traffic_recorder) << " could not open " << file;
+        throw runtime_error("[traffic_recorder] could not open capture file");
+    }
+
+    // sparse file, pages are only backed once they are written
+    if(ftruncate(_fd, static_cast<off_t>(_capacity)) != 0) {
+        close(_fd);
+        LOG(ERROR) << NAMEOF(traffic_recorder::traffic_recorder) << " could not size " << file;
+        throw runtime_error("[traffic_recorder] could not size capture file");
+    }
+
+    auto mapping = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if(mapping == MAP_FAILED) {
+        close(_fd);
+        LOG(ERROR) << NAMEOF(traffic_recorder::traffic_recorder) << " could not map " << file;
+        throw runtime_error("[traffic_recorder] could not map capture file");
+    }
+    _mapping = static_cast<char *>(mapping);
+
+    uint64_t start_time = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    memcpy(_mapping, traffic_capture_magic, sizeof(traffic_capture_magic));
+    memcpy(_mapping + sizeof(traffic_capture_magic), &start_time, sizeof(start_time));
+
+    LOG(INFO) << NAMEOF(traffic_recorder::traffic_recorder) << " capturing traffic to " << file;
+}
+
+traffic_recorder::~traffic_recorder() {
+    auto written = min(_offset.load(memory_order_acquire), _capacity);
+    munmap(_mapping, _capacity);
+    if(ftruncate(_fd, static_cast<off_t>(written)) != 0) {
+        LOG(WARNING) << NAMEOF(traffic_recorder::~traffic_recorder) << " could not truncate capture file";
+    }
+    close(_fd);
+
+    LOG(INFO) << NAMEOF(traffic_recorder::~traffic_recorder) << " captured " << written << " bytes, dropped " << _dropped.load() << " records";
+}
+
+void traffic_recorder::record(traffic_record_kind kind, uint64_t connection_id, char const *data, uint32_t length, uint8_t opcode) noexcept {
+    traffic_record_header header{};
+    header.timestamp_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - _start).count();
+
+    uint64_t size = sizeof(traffic_record_header) + padded(length);
+    auto offset = _offset.fetch_add(size, memory_order_relaxed);
+    if(unlikely(offset + size > _capacity)) {
+        _dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    header.connection_id = connection_id;
+    header.length = length;
+    header.kind = kind;
+    header.opcode = opcode;
+
+    memcpy(_mapping + offset, &header, sizeof(header));
+    if(length > 0) {
+        memcpy(_mapping + offset + sizeof(header), data, length);
+    }
+}
+
+uint64_t traffic_recorder::dropped() const noexcept {
+    return _dropped.load(memory_order_relaxed);
+}
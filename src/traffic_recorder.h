@@ -0,0 +1,72 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace roa {
+    enum class traffic_record_kind : uint8_t {
+        END = 0,
+        CONNECT,
+        DISCONNECT,
+        WS_FRAME,
+        KAFKA_MESSAGE
+    };
+
+    // on disk layout, every record is followed by length bytes of payload, padded to 8 bytes
+    struct traffic_record_header {
+        uint64_t timestamp_ns; // since the start of the capture
+        uint64_t connection_id;
+        uint32_t length;
+        traffic_record_kind kind;
+        uint8_t opcode;
+        uint16_t padding;
+    };
+
+    static_assert(sizeof(traffic_record_header) == 24, "traffic_record_header is part of the capture format");
+
+    constexpr char traffic_capture_magic[8] = {'R', 'O', 'A', 'T', 'R', 'A', 'F', '1'};
+
+    // Append-only capture of gateway traffic into a memory-mapped file. Writers reserve space with a single atomic
+    // add and copy into the mapping, so recording can be called from the uws and consumer threads concurrently.
+    // Records that don't fit in max_bytes are dropped.
+    class traffic_recorder {
+    public:
+        traffic_recorder(std::string const &file, uint64_t max_bytes);
+        ~traffic_recorder();
+
+        traffic_recorder(traffic_recorder const &) = delete;
+        traffic_recorder &operator=(traffic_recorder const &) = delete;
+
+        void record(traffic_record_kind kind, uint64_t connection_id, char const *data = nullptr, uint32_t length = 0, uint8_t opcode = 0) noexcept;
+
+        uint64_t dropped() const noexcept;
+
+    private:
+        int _fd;
+        char *_mapping;
+        uint64_t _capacity;
+        std::atomic<uint64_t> _offset;
+        std::atomic<uint64_t> _dropped;
+        std::chrono::steady_clock::time_point _start;
+    };
+}
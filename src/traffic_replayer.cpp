@@ -0,0 +1,102 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "traffic_replayer.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace roa;
+
+traffic_replayer::traffic_replayer(string const &file) : _fd(-1), _mapping(nullptr), _size(0) {
+    _fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if(_fd < 0) {
+        LOG(ERROR) << NAMEOF(traffic_replayer::traffic_replayer) << " could not open " << file;
+        throw runtime_error("[traffic_replayer] could not open capture file");
+    }
+
+    struct stat st{};
+    if(fstat(_fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(traffic_capture_magic) + sizeof(uint64_t)) {
+        close(_fd);
+        LOG(ERROR) << NAMEOF(traffic_replayer::traffic_replayer) << " " << file << " is not a capture";
+        throw runtime_error("[traffic_replayer] not a capture file");
+    }
+    _size = static_cast<uint64_t>(st.st_size);
+
+    auto mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if(mapping == MAP_FAILED) {
+        close(_fd);
+        LOG(ERROR) << NAMEOF(traffic_replayer::traffic_replayer) << " could not map " << file;
+        throw runtime_error("[traffic_replayer] could not map capture file");
+    }
+    _mapping = static_cast<char const *>(mapping);
+    madvise(mapping, _size, MADV_SEQUENTIAL);
+
+    if(memcmp(_mapping, traffic_capture_magic, sizeof(traffic_capture_magic)) != 0) {
+        munmap(mapping, _size);
+        close(_fd);
+        LOG(ERROR) << NAMEOF(traffic_replayer::traffic_replayer) << " " << file << " is not a capture";
+        throw runtime_error("[traffic_replayer] not a capture file");
+    }
+}
+
+traffic_replayer::~traffic_replayer() {
+    munmap(const_cast<char *>(_mapping), _size);
+    close(_fd);
+}
+
+uint64_t traffic_replayer::replay(double speed, function<void(traffic_record const &)> const &callback) const {
+    uint64_t offset = sizeof(traffic_capture_magic) + sizeof(uint64_t);
+    uint64_t count = 0;
+    auto start = chrono::steady_clock::now();
+
+    while(offset + sizeof(traffic_record_header) <= _size) {
+        traffic_record_header header;
+        memcpy(&header, _mapping + offset, sizeof(header));
+
+        // records reserved but never written by a writer that was cut off end the capture as well
+        if(header.kind == traffic_record_kind::END) {
+            break;
+        }
+
+        auto payload_offset = offset + sizeof(traffic_record_header);
+        if(payload_offset + header.length > _size) {
+            LOG(WARNING) << NAMEOF(traffic_replayer::replay) << " truncated record at offset " << offset;
+            break;
+        }
+
+        if(speed > 0) {
+            auto due = start + chrono::nanoseconds(static_cast<uint64_t>(header.timestamp_ns / speed));
+            this_thread::sleep_until(due);
+        }
+
+        callback(traffic_record{header.kind, header.opcode, header.connection_id, header.timestamp_ns, _mapping + payload_offset, header.length});
+        count++;
+
+        offset = payload_offset + ((header.length + 7) & ~static_cast<uint64_t>(7));
+    }
+
+    return count;
+}
@@ -0,0 +1,53 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <cstdint>
+#include "traffic_recorder.h"
+
+namespace roa {
+    struct traffic_record {
+        traffic_record_kind kind;
+        uint8_t opcode;
+        uint64_t connection_id;
+        uint64_t timestamp_ns;
+        char const *data; // points into the mapping, valid for the duration of the callback
+        uint32_t length;
+    };
+
+    // Reads a capture written by traffic_recorder and hands the records back in order, paced by their timestamps.
+    class traffic_replayer {
+    public:
+        explicit traffic_replayer(std::string const &file);
+        ~traffic_replayer();
+
+        traffic_replayer(traffic_replayer const &) = delete;
+        traffic_replayer &operator=(traffic_replayer const &) = delete;
+
+        // speed 1 replays in real time, 2 twice as fast, 0 as fast as possible. Returns the number of records replayed.
+        uint64_t replay(double speed, std::function<void(traffic_record const &)> const &callback) const;
+
+    private:
+        int _fd;
+        char const *_mapping;
+        uint64_t _size;
+    };
+}
@@ -25,18 +25,40 @@ using namespace roa;
 
 atomic<uint64_t> user_connection::idCounter;
 
-user_connection::user_connection()
-        : state(UNKNOWN), admin_status(0), ws(nullptr), connection_id(0), username(), user_id(), player_id(), player_characters() {
+user_connection::user_connection(uWS::WebSocket<uWS::SERVER> *ws)
+        : ws(ws), connection_id(idCounter.fetch_add(1, std::memory_order_relaxed)), compression(NO_COMPRESSION),
+          closed(false), positions_in_window(0), position_window(0), _session(initial_session()) {
     LOG(DEBUG) << NAMEOF(user_connection::user_connection) << " new connection " << connection_id;
 }
 
-user_connection::user_connection(uWS::WebSocket<uWS::SERVER> *ws)
-        : state(UNKNOWN), admin_status(0), ws(ws), connection_id(idCounter.fetch_add(1, std::memory_order_relaxed)), username(), user_id(), player_id(), player_characters() {
-    LOG(DEBUG) << NAMEOF(user_connection::user_connection) << " new connection " << connection_id;
+user_connection::user_connection(uWS::WebSocket<uWS::SERVER> *ws, uint64_t connection_id)
+        : ws(ws), connection_id(connection_id), compression(NO_COMPRESSION), closed(false), positions_in_window(0), position_window(0),
+          _session(initial_session()) {
+
+}
+
+user_connection::~user_connection() {
+    // the consumer thread may still be reading the last session
+    retire_session(_session.load(std::memory_order_acquire));
 }
 
-user_connection::user_connection(user_connection const &conn)
-        : state(conn.state), admin_status(conn.admin_status), ws(conn.ws), connection_id(conn.connection_id), username(conn.username), user_id(conn.user_id), player_id(conn.player_id), player_characters(conn.player_characters) {
+session_state const *roa::initial_session() noexcept {
+    static session_state const initial{UNKNOWN, 0, {}, 0, 0, {}};
+    return &initial;
+}
+
+void user_connection::retire_session(session_state const *session) {
+    if(session != initial_session()) {
+        session_reclaimer().retire(session);
+    }
+}
+
+std::string user_connection::remote_address() const {
+    if(ws == nullptr) {
+        return {};
+    }
+
+    return ws->getAddress().address;
 }
 
 std::string user_connection::AddressToString(uS::Socket::Address &&a) {
@@ -21,6 +21,10 @@
 #include <uWS.h>
 #include <string>
 #include <atomic>
+#include <vector>
+#include "payload_compressor.h"
+#include "epoch_reclaimer.h"
+#include "string_interner.h"
 
 namespace roa {
     enum user_connection_state {
@@ -33,25 +37,76 @@ namespace roa {
         uint64_t id;
         uint32_t server_id;
         std::string player_name;
-        std::string map_name;
-        std::string world_name;
+        // shared by all characters on the same map and world, see location_names()
+        interned_string map_name;
+        interned_string world_name;
     };
 
-    struct user_connection {
+    // Immutable once published, writers copy the current version, modify the copy and publish it.
+    struct session_state {
         user_connection_state state;
         int8_t admin_status;
-        uWS::WebSocket<uWS::SERVER> *ws;
-        uint64_t connection_id;
         std::string username;
         uint64_t user_id;
         uint64_t player_id;
         std::vector<player_character> player_characters;
+    };
+
+    // Shared by every connection until its first session update, so connections that never log in allocate no session.
+    session_state const *initial_session() noexcept;
+
+    // The fields touched for every frame, aligned so they always share a single cache line.
+    struct alignas(32) user_connection {
+        uWS::WebSocket<uWS::SERVER> * const ws;
+        uint64_t const connection_id;
+        compression_mode compression;
+        // set once the connection left every chat channel on disconnect, see chat_channel_registry::unsubscribe_all
+        std::atomic<bool> closed;
+        // position reports accepted in the current second and which second that is, uws thread only, see client_position_handler
+        uint16_t positions_in_window;
+        uint32_t position_window;
         static std::atomic<uint64_t> idCounter;
 
-        explicit user_connection();
         explicit user_connection(uWS::WebSocket<uWS::SERVER> *ws);
-        user_connection(user_connection const &conn);
+        // for connections replayed from a capture, which have no socket and keep the id they were captured with
+        user_connection(uWS::WebSocket<uWS::SERVER> *ws, uint64_t connection_id);
+        ~user_connection();
+        user_connection(user_connection const &conn) = delete;
+        user_connection &operator=(user_connection const &conn) = delete;
+
+        // Lock free, the returned snapshot stays valid while the calling thread holds an epoch_guard on session_reclaimer().
+        session_state const *session() const noexcept {
+            return _session.load(std::memory_order_acquire);
+        }
+
+        // Publishes a modified copy of the current session, retrying when another thread published in between.
+        // modify may run more than once, so it must not move out of anything it captures.
+        template <class F>
+        void update_session(F &&modify) {
+            // current is copied below, another writer may retire it meanwhile
+            epoch_guard guard(session_reclaimer());
+            auto current = _session.load(std::memory_order_acquire);
+            while(true) {
+                auto next = new session_state(*current);
+                modify(*next);
+                if(_session.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                    retire_session(current);
+                    return;
+                }
+                delete next;
+            }
+        }
+
+        // empty for connections without a socket
+        std::string remote_address() const;
 
         static std::string AddressToString(uS::Socket::Address &&a);
+
+    private:
+        static void retire_session(session_state const *session);
+
+        std::atomic<session_state const *> _session;
     };
+
+    static_assert(sizeof(user_connection) == 32, "keep user_connection within half a cache line");
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "worker_pool.h"
+#include <easylogging++.h>
+#include <macros.h>
+#include "thread_placement.h"
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    thread_local worker_pool const *current_pool = nullptr;
+    thread_local size_t current_index = 0;
+}
+
+worker_pool::worker_pool(size_t workers, string cpus) : _cpus(move(cpus)), _queues(), _threads(), _next_queue(0), _queued(0), _stopping(false),
+                                                         _sleep_mutex(), _wakeup() {
+    _queues.reserve(workers);
+    for(size_t i = 0; i < workers; i++) {
+        _queues.push_back(make_unique<worker_queue>());
+    }
+
+    _threads.reserve(workers);
+    for(size_t i = 0; i < workers; i++) {
+        _threads.emplace_back([this, i] {
+            run(i);
+        });
+    }
+}
+
+worker_pool::~worker_pool() {
+    {
+        lock_guard<mutex> lock(_sleep_mutex);
+        _stopping = true;
+    }
+    _wakeup.notify_all();
+
+    for(auto &worker : _threads) {
+        worker.join();
+    }
+}
+
+size_t worker_pool::size() const noexcept {
+    return _threads.size();
+}
+
+void worker_pool::submit(task work) {
+    if(_threads.empty()) {
+        work();
+        return;
+    }
+
+    auto index = current_pool == this ? current_index : _next_queue.fetch_add(1, memory_order_relaxed) % _queues.size();
+    {
+        lock_guard<mutex> lock(_queues[index]->mutex);
+        _queues[index]->tasks.push_back(move(work));
+    }
+    _queued.fetch_add(1, memory_order_release);
+
+    // taking the lock orders the increment before a worker that is about to sleep checks it
+    {
+        lock_guard<mutex> lock(_sleep_mutex);
+    }
+    _wakeup.notify_one();
+}
+
+void worker_pool::run(size_t index) {
+    place_current_thread("roa-worker", _cpus);
+    current_pool = this;
+    current_index = index;
+
+    while(true) {
+        task work;
+        if(try_take(index, work)) {
+            _queued.fetch_sub(1, memory_order_acq_rel);
+            try {
+                work();
+            } catch(exception &e) {
+                LOG(ERROR) << NAMEOF(worker_pool::run) << " task threw " << typeid(e).name() << "-" << e.what();
+            } catch(...) {
+                // anything escaping the thread function would terminate the gateway
+                LOG(ERROR) << NAMEOF(worker_pool::run) << " task threw something that isn't an exception";
+            }
+            continue;
+        }
+
+        unique_lock<mutex> lock(_sleep_mutex);
+        _wakeup.wait(lock, [this] {
+            return _stopping || _queued.load(memory_order_acquire) > 0;
+        });
+
+        // queued tasks are still run when stopping, they hold responses clients are waiting for
+        if(_stopping && _queued.load(memory_order_acquire) <= 0) {
+            return;
+        }
+    }
+}
+
+bool worker_pool::try_take(size_t index, task &work) {
+    {
+        auto &own = *_queues[index];
+        lock_guard<mutex> lock(own.mutex);
+        if(!own.tasks.empty()) {
+            work = move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for(size_t i = 1; i < _queues.size(); i++) {
+        auto &victim = *_queues[(index + i) % _queues.size()];
+        lock_guard<mutex> lock(victim.mutex);
+        if(!victim.tasks.empty()) {
+            work = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
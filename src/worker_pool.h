@@ -0,0 +1,67 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace roa {
+    // Small work stealing pool for CPU heavy encoding that shouldn't hold up the thread delivering kafka messages.
+    // Workers take their own newest task first and steal the oldest task of another worker when they run dry.
+    class worker_pool {
+    public:
+        using task = std::function<void()>;
+
+        // 0 workers runs every task inline on the submitting thread
+        explicit worker_pool(size_t workers, std::string cpus);
+        ~worker_pool();
+
+        worker_pool(worker_pool const &) = delete;
+        worker_pool &operator=(worker_pool const &) = delete;
+
+        size_t size() const noexcept;
+        // tasks submitted from a worker stay on its own queue, others are spread round robin
+        void submit(task work);
+
+    private:
+        struct worker_queue {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        void run(size_t index);
+        bool try_take(size_t index, task &work);
+
+        std::string _cpus;
+        std::vector<std::unique_ptr<worker_queue>> _queues;
+        std::vector<std::thread> _threads;
+        std::atomic<size_t> _next_queue;
+        std::atomic<int64_t> _queued;
+        std::atomic<bool> _stopping;
+        std::mutex _sleep_mutex;
+        std::condition_variable _wakeup;
+    };
+}
@@ -0,0 +1,126 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+#include <src/area_of_interest.h>
+#include <src/gateway_messages/position_messages.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    set<uint64_t> visited_near(area_of_interest const &aoi, interned_string map, float x, float y, float radius) {
+        set<uint64_t> visited;
+        aoi.visit_near(map.id(), x, y, radius, [&](aoi_member const &member) {
+            visited.insert(member.connection_id);
+        });
+        return visited;
+    }
+}
+
+ROA_TEST(visit_near_finds_exactly_the_connections_within_the_radius) {
+    area_of_interest aoi(32, 200);
+    auto map = location_names().intern(string("aoi test map"));
+    auto other_map = location_names().intern(string("aoi other map"));
+    mt19937 random(7);
+    uniform_real_distribution<float> coordinate(-1000, 1000);
+
+    vector<unique_ptr<user_connection>> connections;
+    vector<pair<float, float>> positions;
+    for(uint64_t id = 1; id <= 2000; id++) {
+        connections.push_back(make_unique<user_connection>(nullptr, id));
+        positions.emplace_back(coordinate(random), coordinate(random));
+        ROA_CHECK(aoi.place(*connections.back(), id % 5 == 0 ? other_map : map, positions.back().first, positions.back().second));
+    }
+
+    // moves some across cell borders, so stale cells would show up as extra or missing members
+    for(size_t i = 0; i < connections.size(); i += 3) {
+        positions[i] = {coordinate(random), coordinate(random)};
+        if(connections[i]->connection_id % 5 != 0) {
+            ROA_CHECK(aoi.move(*connections[i], positions[i].first, positions[i].second));
+        } else {
+            ROA_CHECK(aoi.place(*connections[i], other_map, positions[i].first, positions[i].second));
+        }
+    }
+
+    for(uint32_t query = 0; query < 200; query++) {
+        float x = coordinate(random), y = coordinate(random), radius = static_cast<float>(query % 150);
+        set<uint64_t> expected;
+        for(size_t i = 0; i < connections.size(); i++) {
+            float dx = positions[i].first - x, dy = positions[i].second - y;
+            if(connections[i]->connection_id % 5 != 0 && dx * dx + dy * dy <= radius * radius) {
+                expected.insert(connections[i]->connection_id);
+            }
+        }
+        ROA_CHECK(visited_near(aoi, map, x, y, radius) == expected);
+    }
+
+    for(auto &connection : connections) {
+        aoi.remove(connection->connection_id);
+    }
+    ROA_CHECK(visited_near(aoi, map, 0, 0, 200).empty());
+}
+
+ROA_TEST(positions_that_arent_finite_or_too_far_out_are_rejected) {
+    area_of_interest aoi(1, 10);
+    auto map = location_names().intern(string("aoi test map"));
+    user_connection connection(nullptr, 1);
+    float const limit = static_cast<float>(area_of_interest::max_cell_coordinate);
+
+    ROA_CHECK(!aoi.move(connection, 0, 0));
+    for(float bad : {numeric_limits<float>::quiet_NaN(), numeric_limits<float>::infinity(), -numeric_limits<float>::infinity(), 1e30f,
+                     limit + 2, -limit - 2}) {
+        ROA_CHECK(!aoi.place(connection, map, bad, 0));
+        ROA_CHECK(!aoi.place(connection, map, 0, bad));
+    }
+
+    // cells a full key width apart used to share a key, the far one is now refused instead
+    ROA_CHECK(aoi.place(connection, map, limit, limit));
+    user_connection origin(nullptr, 2);
+    ROA_CHECK(aoi.place(origin, map, 0, 0));
+    ROA_CHECK(visited_near(aoi, map, 0, 0, 10) == set<uint64_t>{2});
+    ROA_CHECK(visited_near(aoi, map, limit, limit, 10) == set<uint64_t>{1});
+}
+
+ROA_TEST(query_radius_is_clamped_and_validated) {
+    area_of_interest aoi(1, 10);
+    auto map = location_names().intern(string("aoi test map"));
+    user_connection near(nullptr, 1), far(nullptr, 2);
+    ROA_CHECK(aoi.place(near, map, 5, 0));
+    ROA_CHECK(aoi.place(far, map, 50, 0));
+
+    // a huge radius only looks as far as the maximum, so it visits a bounded number of cells
+    ROA_CHECK(visited_near(aoi, map, 0, 0, 1e30f) == set<uint64_t>{1});
+    ROA_CHECK(visited_near(aoi, map, 0, 0, numeric_limits<float>::infinity()) == set<uint64_t>{1});
+    ROA_CHECK(visited_near(aoi, map, 0, 0, numeric_limits<float>::quiet_NaN()).empty());
+    ROA_CHECK(visited_near(aoi, map, 0, 0, -1).empty());
+    ROA_CHECK(visited_near(aoi, map, numeric_limits<float>::quiet_NaN(), 0, 5).empty());
+}
+
+ROA_TEST(position_message_rejects_coordinates_that_arent_finite_floats) {
+    ROA_CHECK(position_message::deserialize(nlohmann::json::parse(R"({"type": 10004, "x": 1.5, "y": -3})")));
+    for(auto text : {R"({"type": 10004, "x": 1e300, "y": 0})", R"({"type": 10004, "x": "1", "y": 0})", R"({"type": 10004, "x": 1})"}) {
+        ROA_CHECK(!position_message::deserialize(nlohmann::json::parse(text)));
+    }
+}
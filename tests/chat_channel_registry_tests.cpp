@@ -0,0 +1,151 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <src/chat_channel_registry.h>
+
+using namespace std;
+using namespace roa;
+
+// the connections have no socket, frames sent to them are dropped by the coalescer
+
+ROA_TEST(subscribe_and_unsubscribe_track_each_connection) {
+    chat_channel_registry registry;
+    user_connection first(nullptr, 1);
+    user_connection second(nullptr, 2);
+
+    registry.subscribe("guild:7", first);
+    registry.subscribe("guild:7", second);
+    registry.subscribe("guild:7", first);
+    ROA_CHECK(registry.is_subscribed("guild:7", 1));
+    ROA_CHECK(registry.is_subscribed("guild:7", 2));
+    ROA_CHECK(!registry.is_subscribed("guild:8", 1));
+
+    registry.unsubscribe("guild:7", 1);
+    ROA_CHECK(!registry.is_subscribed("guild:7", 1));
+    ROA_CHECK(registry.is_subscribed("guild:7", 2));
+
+    registry.unsubscribe("guild:7", 2);
+    ROA_CHECK(!registry.is_subscribed("guild:7", 2));
+    ROA_CHECK(registry.broadcast("guild:7", "hello") == 0);
+}
+
+ROA_TEST(subscribe_exclusive_leaves_the_previous_map_and_world) {
+    chat_channel_registry registry;
+    user_connection connection(nullptr, 1);
+
+    registry.subscribe(chat_channel_registry::all_channel, connection);
+    registry.subscribe_exclusive(chat_channel_registry::map_channel("forest"), connection);
+    registry.subscribe_exclusive(chat_channel_registry::world_channel("midgard"), connection);
+    registry.subscribe_exclusive(chat_channel_registry::map_channel("cave"), connection);
+    registry.subscribe_exclusive(chat_channel_registry::world_channel("asgard"), connection);
+
+    ROA_CHECK(!registry.is_subscribed("map:forest", 1));
+    ROA_CHECK(registry.is_subscribed("map:cave", 1));
+    ROA_CHECK(!registry.is_subscribed("world:midgard", 1));
+    ROA_CHECK(registry.is_subscribed("world:asgard", 1));
+    ROA_CHECK(registry.is_subscribed(chat_channel_registry::all_channel, 1));
+
+    // joining the same map again keeps the subscription
+    registry.subscribe_exclusive("map:cave", connection);
+    ROA_CHECK(registry.is_subscribed("map:cave", 1));
+}
+
+ROA_TEST(location_channels_are_interned_once_per_name) {
+    auto forest = location_names().intern(string("forest"));
+    auto map = chat_channel_registry::map_channel(forest);
+    ROA_CHECK(map.str() == "map:forest");
+    ROA_CHECK(chat_channel_registry::map_channel(forest) == map);
+    ROA_CHECK(map.str() == chat_channel_registry::map_channel(forest.str()));
+
+    auto world = chat_channel_registry::world_channel(forest);
+    ROA_CHECK(world.str() == "world:forest");
+    ROA_CHECK(world != map);
+    ROA_CHECK(&chat_channel_registry::world_channel(forest).str() == &world.str());
+}
+
+ROA_TEST(broadcast_counts_the_subscribers_of_the_channel) {
+    chat_channel_registry registry;
+    vector<unique_ptr<user_connection>> connections;
+    for(uint64_t id = 1; id <= 5; id++) {
+        connections.push_back(make_unique<user_connection>(nullptr, id));
+        registry.subscribe(chat_channel_registry::all_channel, *connections.back());
+        if(id % 2 == 1) {
+            registry.subscribe("map:cave", *connections.back());
+        }
+    }
+
+    ROA_CHECK(registry.broadcast(chat_channel_registry::all_channel, "hello") == 5);
+    ROA_CHECK(registry.broadcast("map:cave", "hello") == 3);
+    ROA_CHECK(registry.broadcast("map:forest", "hello") == 0);
+
+    registry.unsubscribe_all(*connections[0]);
+    ROA_CHECK(registry.broadcast(chat_channel_registry::all_channel, "hello") == 4);
+    ROA_CHECK(registry.broadcast("map:cave", "hello") == 2);
+}
+
+ROA_TEST(logged_in_connections_join_all_their_own_channel_and_admin) {
+    chat_channel_registry registry;
+    user_connection player(nullptr, 1);
+    user_connection admin(nullptr, 2);
+
+    session_state session{LOGGED_IN, 0, "player", 10, 0, {}};
+    registry.subscribe_logged_in(player, session);
+    session.admin_status = 1;
+    session.username = "admin";
+    registry.subscribe_logged_in(admin, session);
+
+    ROA_CHECK(registry.is_subscribed(chat_channel_registry::all_channel, 1));
+    ROA_CHECK(registry.is_subscribed("user:player", 1));
+    ROA_CHECK(!registry.is_subscribed(chat_channel_registry::admin_channel, 1));
+    ROA_CHECK(registry.is_subscribed("user:admin", 2));
+    ROA_CHECK(registry.is_subscribed(chat_channel_registry::admin_channel, 2));
+}
+
+ROA_TEST(subscribes_racing_unsubscribe_all_leave_nothing_behind) {
+    constexpr uint64_t rounds = 2000;
+    chat_channel_registry registry;
+
+    for(uint64_t round = 0; round < rounds; round++) {
+        user_connection connection(nullptr, round + 1);
+        atomic<bool> go{false};
+
+        // a consumer thread joining channels while the uws thread handles the disconnect
+        thread subscriber([&] {
+            while(!go.load()) {
+            }
+            registry.subscribe("guild:1", connection);
+            registry.subscribe_exclusive("map:cave", connection);
+        });
+
+        go.store(true);
+        registry.unsubscribe_all(connection);
+        subscriber.join();
+
+        ROA_CHECK(connection.closed.load());
+        ROA_CHECK(!registry.is_subscribed("guild:1", connection.connection_id));
+        ROA_CHECK(!registry.is_subscribed("map:cave", connection.connection_id));
+    }
+
+    ROA_CHECK(registry.broadcast("guild:1", "hello") == 0);
+    ROA_CHECK(registry.broadcast("map:cave", "hello") == 0);
+}
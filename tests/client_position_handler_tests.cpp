@@ -0,0 +1,102 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <roa_di.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <src/message_handlers/client/client_position_handler.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    uint32_t current_second() {
+        return static_cast<uint32_t>(chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    float position_in(area_of_interest const &aoi, interned_string map) {
+        float x = -1;
+        aoi.visit_near(map.id(), 0, 0, 1000, [&](aoi_member const &member) {
+            x = member.x;
+        });
+        return x;
+    }
+}
+
+ROA_TEST(position_reports_past_the_rate_are_dropped) {
+    Config config{};
+    config.server_id = 1;
+    config.position_updates_per_second = 10;
+    auto common_injector = create_common_di_injector();
+    // never started, so nothing is forwarded and only the aoi shows what was accepted
+    auto producer = make_shared<partitioned_producer>(common_injector.create<shared_ptr<ikafka_producer<false>>>(), true);
+    auto aoi = make_shared<area_of_interest>(32, 1000);
+    client_position_handler handler(config, producer, aoi);
+
+    auto map = location_names().intern(string("position test map"));
+    user_connection connection(nullptr, 1);
+    connection.update_session([&](session_state &session) {
+        session.state = LOGGED_IN;
+        session.user_id = 10;
+        session.player_id = 100;
+        session.player_characters = {player_character{100, 2, "player", map, interned_string()}};
+    });
+    aoi->place(connection, map, 0, 0);
+
+    // a report past the limit only gets through when the second rolled over in between, retried until it didn't
+    bool checked = false;
+    for(uint32_t attempt = 0; attempt < 3 && !checked; attempt++) {
+        auto second = current_second();
+        while(current_second() == second) {
+        }
+
+        second = current_second();
+        for(uint32_t i = 1; i <= 15; i++) {
+            handler.handle_message(position_message{static_cast<float>(i), 0}, connection);
+        }
+        if(current_second() == second) {
+            ROA_CHECK(position_in(*aoi, map) == 10);
+            checked = true;
+        }
+    }
+    ROA_CHECK(checked);
+
+    // the next second takes reports again
+    auto second = current_second();
+    while(current_second() == second) {
+    }
+    handler.handle_message(position_message{20, 0}, connection);
+    ROA_CHECK(position_in(*aoi, map) == 20);
+}
+
+ROA_TEST(positions_of_connections_not_playing_are_ignored) {
+    Config config{};
+    config.position_updates_per_second = 10;
+    auto common_injector = create_common_di_injector();
+    auto producer = make_shared<partitioned_producer>(common_injector.create<shared_ptr<ikafka_producer<false>>>(), true);
+    auto aoi = make_shared<area_of_interest>(32, 1000);
+    client_position_handler handler(config, producer, aoi);
+
+    auto map = location_names().intern(string("position test map"));
+    user_connection connection(nullptr, 2);
+    aoi->place(connection, map, 5, 0);
+    handler.handle_message(position_message{6, 0}, connection);
+    ROA_CHECK(position_in(*aoi, map) == 5);
+}
@@ -0,0 +1,56 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <string>
+#include <vector>
+#include <src/compression_dictionary.h>
+
+using namespace std;
+using namespace roa;
+
+ROA_TEST(compression_dictionary_keeps_repeated_fragments_best_last) {
+    vector<string> samples;
+    for(int i = 0; i < 10; i++) {
+        samples.push_back("{\"type\":5,\"world_name\":\"bench_world\",\"unique\":\"" + to_string(i) + "\"}");
+    }
+    samples.push_back("{\"type\":5,\"rare_key\":1,\"rare_key\":1,\"other\":2}");
+
+    auto dictionary = build_compression_dictionary(samples);
+    ROA_CHECK(dictionary.find("\"world_name\":\"bench_world\",") != string::npos);
+    ROA_CHECK(dictionary.find("{\"type\":5,") != string::npos);
+    ROA_CHECK(dictionary.find("\"unique\":") != string::npos);
+    // values seen once save nothing
+    ROA_CHECK(dictionary.find("\"unique\":\"3\"") == string::npos);
+    ROA_CHECK(dictionary.find("\"other\":2") == string::npos);
+
+    // the fragment saving the most, 10 times 27 bytes, ends the dictionary
+    string best = "\"world_name\":\"bench_world\",";
+    ROA_CHECK(dictionary.size() >= best.size() && dictionary.compare(dictionary.size() - best.size(), best.size(), best) == 0);
+}
+
+ROA_TEST(compression_dictionary_stays_within_max_bytes) {
+    vector<string> samples;
+    for(int i = 0; i < 200; i++) {
+        samples.push_back("{\"key_" + to_string(i % 50) + "\":\"value_" + to_string(i % 50) + "\",\"x\":1}");
+    }
+
+    ROA_CHECK(build_compression_dictionary(samples, 64).size() <= 64);
+    ROA_CHECK(build_compression_dictionary(samples).size() <= compression_dictionary_max_bytes);
+    ROA_CHECK(build_compression_dictionary({}).empty());
+}
@@ -0,0 +1,119 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <src/connection_registry.h>
+
+using namespace std;
+using namespace roa;
+
+ROA_TEST(connections_are_found_and_erased_across_shards) {
+    connection_registry connections(4);
+    for(uint64_t id = 1; id <= 40; id++) {
+        connections.insert(make_shared<user_connection>(nullptr, id));
+    }
+    ROA_CHECK(connections.size() == 40);
+
+    for(uint64_t id = 1; id <= 40; id++) {
+        auto connection = connections.find(id);
+        ROA_CHECK(connection && connection->connection_id == id);
+        ROA_CHECK(connections.find_fn(id, [&](user_connection &found) {
+            ROA_CHECK(found.connection_id == id);
+        }));
+    }
+    ROA_CHECK(!connections.find(41));
+    ROA_CHECK(!connections.find_fn(41, [](user_connection &) {}));
+
+    // every other id, so each shard loses some
+    for(uint64_t id = 1; id <= 40; id += 2) {
+        auto erased = connections.erase(id);
+        ROA_CHECK(erased && erased->connection_id == id);
+        ROA_CHECK(!connections.erase(id));
+    }
+    ROA_CHECK(connections.size() == 20);
+    for(uint64_t id = 1; id <= 40; id++) {
+        ROA_CHECK(static_cast<bool>(connections.find(id)) == (id % 2 == 0));
+    }
+}
+
+ROA_TEST(for_each_visits_every_connection_once) {
+    connection_registry connections(8);
+    for(uint64_t id = 1; id <= 100; id++) {
+        connections.insert(make_shared<user_connection>(nullptr, id));
+    }
+
+    vector<uint32_t> visits(101);
+    connections.for_each([&](user_connection &connection) {
+        visits[connection.connection_id]++;
+    });
+    for(uint64_t id = 1; id <= 100; id++) {
+        ROA_CHECK(visits[id] == 1);
+    }
+}
+
+ROA_TEST(for_each_runs_while_other_threads_connect_and_disconnect) {
+    constexpr uint64_t stable = 200;
+    constexpr uint32_t churners = 3;
+    connection_registry connections(8);
+    for(uint64_t id = 1; id <= stable; id++) {
+        connections.insert(make_shared<user_connection>(nullptr, id));
+    }
+
+    atomic<bool> done{false};
+    atomic<bool> lost{false};
+    vector<thread> threads;
+    for(uint32_t t = 0; t < churners; t++) {
+        threads.emplace_back([&, t] {
+            // ids of their own per thread, each connects and disconnects again
+            uint64_t next = 1000000 * (t + 1);
+            while(!done.load()) {
+                connections.insert(make_shared<user_connection>(nullptr, next));
+                if(!connections.erase(next)) {
+                    lost = true;
+                }
+                next++;
+            }
+        });
+    }
+
+    bool missed = false;
+    for(uint32_t round = 0; round < 200; round++) {
+        vector<uint32_t> visits(stable + 1);
+        connections.for_each([&](user_connection &connection) {
+            if(connection.connection_id <= stable) {
+                visits[connection.connection_id]++;
+            }
+        });
+        for(uint64_t id = 1; id <= stable; id++) {
+            missed = missed || visits[id] != 1;
+        }
+    }
+
+    done.store(true);
+    for(auto &t : threads) {
+        t.join();
+    }
+
+    ROA_CHECK(!missed);
+    ROA_CHECK(!lost.load());
+    ROA_CHECK(connections.size() == stable);
+}
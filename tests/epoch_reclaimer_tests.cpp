@@ -0,0 +1,97 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <src/epoch_reclaimer.h>
+
+using namespace std;
+using namespace roa;
+
+ROA_TEST(exited_threads_give_their_slot_back) {
+    epoch_reclaimer reclaimer;
+
+    // more threads over time than there are slots, only a few alive at once like the worker pools restarting
+    for(size_t round = 0; round < epoch_reclaimer::max_threads * 4; round += 4) {
+        vector<thread> threads;
+        for(size_t i = 0; i < 4; i++) {
+            threads.emplace_back([&] {
+                epoch_guard guard(reclaimer);
+            });
+        }
+        for(auto &t : threads) {
+            t.join();
+        }
+    }
+
+    // every slot taken at once still works after the earlier threads are gone
+    atomic<size_t> entered{0};
+    atomic<bool> leave{false};
+    vector<thread> threads;
+    for(size_t i = 0; i < epoch_reclaimer::max_threads - 1; i++) {
+        threads.emplace_back([&] {
+            epoch_guard guard(reclaimer);
+            entered.fetch_add(1);
+            while(!leave.load()) {
+                this_thread::yield();
+            }
+        });
+    }
+    while(entered.load() < threads.size()) {
+        this_thread::yield();
+    }
+
+    {
+        epoch_guard guard(reclaimer);
+    }
+    leave.store(true);
+    for(auto &t : threads) {
+        t.join();
+    }
+}
+
+ROA_TEST(threads_outliving_a_reclaimer_leave_its_memory_alone) {
+    auto reclaimer = make_unique<epoch_reclaimer>();
+    atomic<bool> used{false};
+    atomic<bool> destroyed{false};
+
+    thread outliving([&] {
+        {
+            epoch_guard guard(*reclaimer);
+        }
+        used.store(true);
+        while(!destroyed.load()) {
+            this_thread::yield();
+        }
+    });
+
+    while(!used.load()) {
+        this_thread::yield();
+    }
+    reclaimer.reset();
+    // a reclaimer at the same address must hand out fresh slots rather than the stale cached one
+    reclaimer = make_unique<epoch_reclaimer>();
+    {
+        epoch_guard guard(*reclaimer);
+    }
+    destroyed.store(true);
+    outliving.join();
+}
@@ -0,0 +1,89 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <string>
+#include <utility>
+#include <vector>
+#include <src/gateway_messages/gateway_message.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    message_batch split(string const &frame, vector<string> &messages) {
+        vector<pair<char const *, size_t>> batch;
+        auto result = split_message_batch(frame.data(), frame.size(), batch);
+        messages.clear();
+        for(auto const &message : batch) {
+            messages.emplace_back(message.first, message.second);
+        }
+        return result;
+    }
+
+    string batch_of(size_t count) {
+        string frame = "[";
+        for(size_t i = 0; i < count; i++) {
+            frame += i > 0 ? ",{\"type\":1}" : "{\"type\":1}";
+        }
+        return frame + "]";
+    }
+}
+
+ROA_TEST(split_message_batch_returns_the_raw_objects) {
+    vector<string> messages;
+    ROA_CHECK(split(" [{\"type\":1,\"a\":\"]}\"}, {\"type\":2,\"b\":[{}]}]\r\n", messages) == message_batch::BATCH);
+    ROA_CHECK(messages.size() == 2);
+    ROA_CHECK(messages[0] == "{\"type\":1,\"a\":\"]}\"}");
+    ROA_CHECK(messages[1] == "{\"type\":2,\"b\":[{}]}");
+
+    ROA_CHECK(split("{\"type\":1}", messages) == message_batch::NOT_A_BATCH);
+    ROA_CHECK(split("[]", messages) == message_batch::BATCH && messages.empty());
+}
+
+ROA_TEST(split_message_batch_rejects_anything_after_the_array) {
+    vector<string> messages;
+    ROA_CHECK(split("[{\"type\":1}] {\"type\":2}", messages) == message_batch::MALFORMED);
+    ROA_CHECK(split("[{\"type\":1}]]", messages) == message_batch::MALFORMED);
+    ROA_CHECK(split("[{\"type\":1}] x", messages) == message_batch::MALFORMED);
+    ROA_CHECK(split("[{\"type\":1}", messages) == message_batch::MALFORMED);
+    ROA_CHECK(split("[{\"type\":1},[]]", messages) == message_batch::MALFORMED);
+    ROA_CHECK(split("[\"type\"]", messages) == message_batch::MALFORMED);
+}
+
+ROA_TEST(split_message_batch_rejects_elements_that_arent_objects) {
+    vector<string> messages;
+    for(string const frame : {"[{\"type\":1}, 5]", "[5, {\"type\":1}]", "[{\"type\":1}, true]", "[null]", "[-1]",
+                              "[{\"type\":1} {\"type\":2}]", "[{\"type\":1},]", "[,{\"type\":1}]", "[,]", "[{\"type\":1},,{\"type\":2}]"}) {
+        ROA_CHECK(split(frame, messages) == message_batch::MALFORMED);
+    }
+
+    ROA_CHECK(split("[ {\"type\":1} ,\n{\"type\":2} ]", messages) == message_batch::BATCH);
+    ROA_CHECK(messages.size() == 2);
+}
+
+ROA_TEST(split_message_batch_stops_at_the_message_cap) {
+    vector<string> messages;
+    ROA_CHECK(split(batch_of(max_batched_messages), messages) == message_batch::BATCH);
+    ROA_CHECK(messages.size() == max_batched_messages);
+
+    ROA_CHECK(split(batch_of(max_batched_messages + 1), messages) == message_batch::MALFORMED);
+    ROA_CHECK(messages.size() == max_batched_messages);
+    ROA_CHECK(split(batch_of(100000), messages) == message_batch::MALFORMED);
+    ROA_CHECK(messages.size() == max_batched_messages);
+}
@@ -0,0 +1,106 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <src/json_scanner.h>
+#include <src/gateway_messages/gateway_message.h>
+
+using namespace std;
+using namespace roa;
+
+// lengths and offsets around the 16 and 32 byte strides, so the vector loops and their scalar tails are both covered
+ROA_TEST(find_json_structural_matches_a_byte_at_a_time_scan) {
+    mt19937 random(42);
+    string const alphabet = "abc \"\\{}[]:,0\x80\xff";
+
+    for(size_t length = 0; length < 100; length++) {
+        for(uint32_t round = 0; round < 20; round++) {
+            string data(length, 'x');
+            // mostly filler, so matches land anywhere in a chunk
+            for(auto &c : data) {
+                if(random() % 8 == 0) {
+                    c = alphabet[random() % alphabet.size()];
+                }
+            }
+
+            for(size_t offset = 0; offset <= min<size_t>(length, 3); offset++) {
+                auto expected = data.data() + offset;
+                while(expected < data.data() + length && string("\"\\{}[]").find(*expected) == string::npos) {
+                    expected++;
+                }
+                ROA_CHECK(find_json_structural(data.data() + offset, data.data() + length) == expected);
+            }
+        }
+    }
+}
+
+ROA_TEST(is_valid_utf8_accepts_well_formed_text) {
+    ROA_CHECK(is_valid_utf8("", 0));
+    for(string const text : {"plain ascii", "caf\xc3\xa9", "\xe2\x82\xac 5", "\xf0\x9f\x98\x80", "\xed\x9f\xbf", "\xf4\x8f\xbf\xbf"}) {
+        ROA_CHECK(is_valid_utf8(text.data(), text.size()));
+    }
+}
+
+ROA_TEST(is_valid_utf8_rejects_malformed_text) {
+    for(string const text : {
+            "\x80",                 // continuation without a lead byte
+            "\xc3",                 // truncated
+            "\xc0\xaf",             // overlong '/'
+            "\xe0\x80\xaf",         // overlong '/' in three bytes
+            "\xed\xa0\x80",         // surrogate
+            "\xf4\x90\x80\x80",     // past U+10FFFF
+            "\xf8\x88\x80\x80\x80", // five byte form
+            "\xe2\x28\xa1"          // continuation replaced by ascii
+    }) {
+        ROA_CHECK(!is_valid_utf8(text.data(), text.size()));
+    }
+}
+
+ROA_TEST(is_valid_utf8_finds_bad_bytes_anywhere_in_long_ascii_runs) {
+    for(size_t length = 1; length < 100; length++) {
+        for(size_t position = 0; position < length; position++) {
+            string data(length, 'a');
+            ROA_CHECK(is_valid_utf8(data.data(), data.size()));
+            data[position] = '\xff';
+            ROA_CHECK(!is_valid_utf8(data.data(), data.size()));
+            // a valid two byte sequence at the same spot
+            if(position + 1 < length) {
+                data[position] = '\xc3';
+                data[position + 1] = '\xa9';
+                ROA_CHECK(is_valid_utf8(data.data(), data.size()));
+            }
+        }
+    }
+}
+
+// the vector scan skips whole chunks without structural characters, a scalar inside one still has to break the batch
+ROA_TEST(split_message_batch_finds_scalars_the_vector_scan_skips) {
+    vector<pair<char const *, size_t>> messages;
+    for(size_t padding = 0; padding < 70; padding++) {
+        string frame = "[{\"type\":1}," + string(padding, ' ') + "5" + string(padding, ' ') + "]";
+        ROA_CHECK(split_message_batch(frame.data(), frame.size(), messages) == message_batch::MALFORMED);
+
+        frame = "[{\"type\":1}," + string(padding, ' ') + "{\"type\":2}" + string(padding, ' ') + "]";
+        ROA_CHECK(split_message_batch(frame.data(), frame.size(), messages) == message_batch::BATCH);
+        ROA_CHECK(messages.size() == 2);
+    }
+}
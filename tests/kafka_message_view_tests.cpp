@@ -0,0 +1,106 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <string>
+#include <vector>
+#include <messages/chat/chat_send_message.h>
+#include <src/kafka_message_view.h>
+#include <src/gateway_messages/position_messages.h>
+
+using namespace std;
+using namespace roa;
+
+// Views only change how the gateway reads a record, the frames it writes from them go through the same writers as
+// deserialized messages, tests/response_writers_tests.cpp keeps those equal to the common serialization.
+
+ROA_TEST(chat_send_view_round_trips_through_the_writer) {
+    auto record = chat_send_view::write({true, 42, 3, 7}, "someone", "#world", string("quote \" nul ") + '\0');
+    ROA_CHECK(kafka_message_view::is_view(record.data(), record.size()));
+
+    auto view = kafka_message_view::parse(record.data(), record.size());
+    ROA_CHECK(view);
+    ROA_CHECK(view->type() == binary_chat_send_message::id);
+    ROA_CHECK(view->sender().client_id == 42);
+    ROA_CHECK(view->sender().server_origin_id == 3);
+    ROA_CHECK(view->sender().server_destination_id == 7);
+
+    auto chat = chat_send_view::from(*view);
+    ROA_CHECK(chat);
+    ROA_CHECK(chat->from_username == "someone");
+    ROA_CHECK(chat->target == "#world");
+    ROA_CHECK(chat->message == string("quote \" nul ") + '\0');
+
+    // a chat view read as the wrong type has the wrong number of fields
+    ROA_CHECK(!get_characters_response_view::from(*view));
+}
+
+ROA_TEST(get_characters_response_view_round_trips_through_the_writer) {
+    vector<message_player> players;
+    for(uint32_t count = 0; count < 4; count++) {
+        auto record = get_characters_response_view::write({true, 9, 1, 0}, players, "world one");
+        auto view = kafka_message_view::parse(record.data(), record.size());
+        ROA_CHECK(view);
+        if(!view) {
+            continue;
+        }
+        ROA_CHECK(view->type() == binary_get_characters_response_message::id);
+
+        auto response = get_characters_response_view::from(*view);
+        ROA_CHECK(response);
+        ROA_CHECK(response->world_name == "world one");
+        ROA_CHECK(response->player_count == players.size());
+        for(uint32_t i = 0; response && i < response->player_count; i++) {
+            ROA_CHECK(response->player_id(i) == players[i].player_id);
+            ROA_CHECK(response->player_name(i) == players[i].player_name);
+            ROA_CHECK(response->map_name(i) == players[i].map_name);
+        }
+
+        players.push_back({count + 1000 + (uint64_t{1} << 40), "player " + to_string(count), "map " + to_string(count)});
+    }
+}
+
+ROA_TEST(position_view_round_trips_through_the_writer) {
+    auto record = position_view::write({false, 42, 3, 0}, 1000, 12.5f, -0.1f);
+    auto view = kafka_message_view::parse(record.data(), record.size());
+    ROA_CHECK(view);
+    ROA_CHECK(view->type() == position_message::id);
+    ROA_CHECK(view->sender().client_id == 42);
+
+    auto position = position_view::from(*view);
+    ROA_CHECK(position);
+    ROA_CHECK(position->player_id == 1000);
+    ROA_CHECK(position->x == 12.5f);
+    ROA_CHECK(position->y == -0.1f);
+    ROA_CHECK(!get_characters_response_view::from(*view));
+}
+
+ROA_TEST(kafka_message_view_rejects_fields_past_the_end) {
+    auto record = chat_send_view::write({true, 1, 0, 0}, "someone", "target", "message");
+    ROA_CHECK(!kafka_message_view::parse(record.data(), record.size() - 1));
+    ROA_CHECK(!kafka_message_view::parse(record.data(), kafka_message_view_header_size - 1));
+
+    // a table claiming more fields than the record has room for
+    auto header_only = kafka_message_view_writer(binary_chat_send_message::id, {true, 1, 0, 0}).finish();
+    header_only[27] = 1;
+    ROA_CHECK(!kafka_message_view::parse(header_only.data(), header_only.size()));
+
+    auto empty = kafka_message_view_writer(binary_chat_send_message::id, {true, 1, 0, 0}).finish();
+    auto view = kafka_message_view::parse(empty.data(), empty.size());
+    ROA_CHECK(view && view->field_count() == 0 && !chat_send_view::from(*view));
+}
@@ -0,0 +1,63 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <thread>
+#include <src/local_chat_deliveries.h>
+
+using namespace std;
+using namespace roa;
+
+ROA_TEST(a_marked_message_suppresses_exactly_one_echo) {
+    local_chat_deliveries deliveries(chrono::seconds(60));
+
+    deliveries.mark("alice", "bob", "hi");
+    ROA_CHECK(deliveries.consume("alice", "bob", "hi"));
+    ROA_CHECK(!deliveries.consume("alice", "bob", "hi"));
+
+    // the same message sent twice in a row is marked twice
+    deliveries.mark("alice", "bob", "hi");
+    deliveries.mark("alice", "bob", "hi");
+    ROA_CHECK(deliveries.consume("alice", "bob", "hi"));
+    ROA_CHECK(deliveries.consume("alice", "bob", "hi"));
+    ROA_CHECK(!deliveries.consume("alice", "bob", "hi"));
+}
+
+ROA_TEST(unmarked_messages_pass_through) {
+    local_chat_deliveries deliveries(chrono::seconds(60));
+
+    ROA_CHECK(!deliveries.consume("alice", "bob", "hi"));
+
+    deliveries.mark("alice", "bob", "hi");
+    ROA_CHECK(!deliveries.consume("bob", "alice", "hi"));
+    ROA_CHECK(!deliveries.consume("alice", "carol", "hi"));
+    ROA_CHECK(!deliveries.consume("alice", "bob", "hello"));
+    ROA_CHECK(deliveries.consume("alice", "bob", "hi"));
+}
+
+ROA_TEST(marks_whose_echo_never_came_expire) {
+    // no retention, so the next mark sweeps every earlier one
+    local_chat_deliveries deliveries(chrono::seconds(0));
+
+    deliveries.mark("alice", "bob", "lost");
+    this_thread::sleep_for(chrono::milliseconds(2));
+    deliveries.mark("alice", "bob", "hi");
+
+    ROA_CHECK(!deliveries.consume("alice", "bob", "lost"));
+    ROA_CHECK(deliveries.consume("alice", "bob", "hi"));
+}
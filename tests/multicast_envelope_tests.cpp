@@ -0,0 +1,170 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <src/multicast_envelope.h>
+#include <src/area_of_interest.h>
+#include <src/chat_channel_registry.h>
+#include <src/connection_registry.h>
+#include <src/gateway_messages/position_messages.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    void append_big_endian(string &record, uint64_t value, size_t bytes) {
+        for(size_t i = bytes; i > 0; i--) {
+            record.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xFF));
+        }
+    }
+
+    string envelope_header(multicast_target target, outbound_class priority, uint32_t destination, uint32_t count) {
+        string record(multicast_envelope_magic, sizeof(multicast_envelope_magic));
+        record.push_back(static_cast<char>(target));
+        record.push_back(static_cast<char>(priority));
+        append_big_endian(record, 0, 2);
+        append_big_endian(record, destination, 4);
+        append_big_endian(record, count, 4);
+        return record;
+    }
+
+    uint32_t float_bits(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    string area_envelope(string const &map_name, float x, float y, float radius, string const &frame) {
+        auto record = envelope_header(multicast_target::AREA, CHAT, 3, static_cast<uint32_t>(map_name.size()));
+        record += map_name;
+        append_big_endian(record, float_bits(x), 4);
+        append_big_endian(record, float_bits(y), 4);
+        append_big_endian(record, float_bits(radius), 4);
+        record += frame;
+        return record;
+    }
+}
+
+ROA_TEST(multicast_envelope_reads_destination_connections_and_frame) {
+    auto record = envelope_header(multicast_target::CONNECTIONS, CHAT, 7, 2);
+    append_big_endian(record, 11, 8);
+    append_big_endian(record, 0x0102030405060708ULL, 8);
+    record += "{\"type\":1}";
+
+    auto envelope = multicast_envelope::parse(record.data(), record.size());
+    ROA_CHECK(envelope);
+    ROA_CHECK(envelope->target() == multicast_target::CONNECTIONS);
+    ROA_CHECK(envelope->priority() == CHAT);
+    ROA_CHECK(envelope->destination() == 7);
+    ROA_CHECK(envelope->connection_count() == 2);
+    ROA_CHECK(envelope->connection_id(0) == 11);
+    ROA_CHECK(envelope->connection_id(1) == 0x0102030405060708ULL);
+    ROA_CHECK(string(envelope->frame(), envelope->frame_length()) == "{\"type\":1}");
+}
+
+ROA_TEST(multicast_envelope_reads_channel) {
+    auto record = envelope_header(multicast_target::CHANNEL, BULK, 3, 5);
+    record += "world";
+    record += "frame";
+
+    auto envelope = multicast_envelope::parse(record.data(), record.size());
+    ROA_CHECK(envelope);
+    ROA_CHECK(envelope->destination() == 3);
+    ROA_CHECK(envelope->connection_count() == 0);
+    ROA_CHECK(envelope->channel() == "world");
+    ROA_CHECK(string(envelope->frame(), envelope->frame_length()) == "frame");
+}
+
+ROA_TEST(multicast_envelope_reads_area) {
+    auto record = area_envelope("cave", 12.5f, -3, 40, "frame");
+
+    auto envelope = multicast_envelope::parse(record.data(), record.size());
+    ROA_CHECK(envelope);
+    ROA_CHECK(envelope->target() == multicast_target::AREA);
+    ROA_CHECK(envelope->connection_count() == 0);
+    ROA_CHECK(envelope->channel().empty());
+    ROA_CHECK(envelope->map_name() == "cave");
+    ROA_CHECK(envelope->x() == 12.5f);
+    ROA_CHECK(envelope->y() == -3);
+    ROA_CHECK(envelope->radius() == 40);
+    ROA_CHECK(string(envelope->frame(), envelope->frame_length()) == "frame");
+}
+
+ROA_TEST(area_envelopes_reach_the_connections_near_the_spot) {
+    connection_registry connections(4);
+    chat_channel_registry channels;
+    area_of_interest aoi(32, 100);
+    auto map = location_names().intern(string("envelope test map"));
+    auto other_map = location_names().intern(string("envelope other map"));
+
+    // the connections have no socket, frames sent to them are dropped by the coalescer
+    vector<unique_ptr<user_connection>> placed;
+    for(uint64_t id = 1; id <= 6; id++) {
+        placed.push_back(make_unique<user_connection>(nullptr, id));
+        aoi.place(*placed.back(), id <= 4 ? map : other_map, static_cast<float>(id) * 20, 0);
+    }
+
+    string frame;
+    nearby_position_message{42, 30, 0}.serialize(frame);
+
+    // 20, 40 and 60 are within 30 of 30, 80 isn't and the last two are on another map
+    auto record = area_envelope(map.str(), 30, 0, 30, frame);
+    auto envelope = multicast_envelope::parse(record.data(), record.size());
+    ROA_CHECK(envelope);
+    ROA_CHECK(envelope->deliver(connections, channels, aoi) == 3);
+
+    // the radius is capped by the aoi, a spot that isn't finite reaches nobody
+    record = area_envelope(map.str(), 0, 0, 1000, frame);
+    ROA_CHECK(multicast_envelope::parse(record.data(), record.size())->deliver(connections, channels, aoi) == 4);
+    record = area_envelope(map.str(), NAN, 0, 30, frame);
+    ROA_CHECK(multicast_envelope::parse(record.data(), record.size())->deliver(connections, channels, aoi) == 0);
+    record = area_envelope("envelope unknown map", 30, 0, 30, frame);
+    ROA_CHECK(multicast_envelope::parse(record.data(), record.size())->deliver(connections, channels, aoi) == 0);
+}
+
+ROA_TEST(multicast_envelope_rejects_short_and_unknown_records) {
+    auto header = envelope_header(multicast_target::CONNECTIONS, CHAT, 1, 0);
+    ROA_CHECK(!multicast_envelope::is_envelope(header.data(), header.size() - 1));
+    ROA_CHECK(!multicast_envelope::parse(header.data(), header.size() - 1));
+    ROA_CHECK(multicast_envelope::parse(header.data(), header.size()));
+
+    auto cut_short = envelope_header(multicast_target::CONNECTIONS, CHAT, 1, 2);
+    append_big_endian(cut_short, 11, 8);
+    ROA_CHECK(!multicast_envelope::parse(cut_short.data(), cut_short.size()));
+
+    // an area needs its spot behind the map name
+    auto area_cut_short = envelope_header(multicast_target::AREA, CHAT, 1, 4);
+    area_cut_short += "cave";
+    append_big_endian(area_cut_short, float_bits(1), 4);
+    append_big_endian(area_cut_short, float_bits(2), 4);
+    ROA_CHECK(!multicast_envelope::parse(area_cut_short.data(), area_cut_short.size()));
+
+    auto unknown_target = envelope_header(static_cast<multicast_target>(3), CHAT, 1, 0);
+    ROA_CHECK(!multicast_envelope::parse(unknown_target.data(), unknown_target.size()));
+
+    auto unknown_priority = envelope_header(multicast_target::CHANNEL, static_cast<outbound_class>(OUTBOUND_CLASS_COUNT), 1, 0);
+    ROA_CHECK(!multicast_envelope::parse(unknown_priority.data(), unknown_priority.size()));
+
+    string not_an_envelope = "{\"type\":1,\"padding\":\"........\"}";
+    ROA_CHECK(!multicast_envelope::is_envelope(not_an_envelope.data(), not_an_envelope.size()));
+}
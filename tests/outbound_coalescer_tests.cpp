@@ -0,0 +1,419 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <src/outbound_coalescer.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    struct socket_write {
+        uWS::WebSocket<uWS::SERVER> *ws;
+        string kind;
+        vector<string> payloads;
+    };
+
+    // writes down what the coalescer hands over instead of touching a socket
+    class recording_socket : public outbound_socket {
+    public:
+        void send(uWS::WebSocket<uWS::SERVER> *ws, char const *data, size_t length, uWS::OpCode, bool) override {
+            writes.push_back(socket_write{ws, "send", {string(data, length)}});
+        }
+
+        void send_batch(uWS::WebSocket<uWS::SERVER> *ws, vector<string> &payloads, uWS::OpCode, bool) override {
+            writes.push_back(socket_write{ws, "batch", payloads});
+        }
+
+        void close(uWS::WebSocket<uWS::SERVER> *ws) override {
+            writes.push_back(socket_write{ws, "close", {}});
+        }
+
+        void terminate(uWS::WebSocket<uWS::SERVER> *ws) override {
+            writes.push_back(socket_write{ws, "terminate", {}});
+        }
+
+        // payloads in the order they were written, closes and terminates left out
+        vector<string> payloads() const {
+            vector<string> all;
+            for(auto const &write : writes) {
+                all.insert(end(all), begin(write.payloads), end(write.payloads));
+            }
+            return all;
+        }
+
+        vector<socket_write> writes;
+    };
+
+    // the socket is only ever handed back to the stub, never dereferenced
+    uWS::WebSocket<uWS::SERVER> *fake_socket(uint64_t &storage) {
+        return reinterpret_cast<uWS::WebSocket<uWS::SERVER> *>(&storage);
+    }
+
+    outbound_limits test_limits() {
+        return outbound_limits{{1024, 1024, 1024}, 1024};
+    }
+}
+
+ROA_TEST(coalescer_sends_right_away_until_started) {
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("a"), BULK);
+    coalescer.send(connection, string("b"), CONTROL);
+    ROA_CHECK(socket->writes.size() == 2);
+    ROA_CHECK(socket->payloads() == (vector<string>{"a", "b"}));
+    ROA_CHECK(coalescer.reserve(1) == 0);
+
+    coalescer.close(connection);
+    ROA_CHECK(socket->writes.back().kind == "close");
+}
+
+ROA_TEST(coalescer_flushes_control_then_chat_then_bulk_in_one_write) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("bulk"), BULK);
+    coalescer.send(connection, string("chat 1"), CHAT);
+    coalescer.send(connection, string("control"), CONTROL);
+    coalescer.send(connection, string("chat 2"), CHAT);
+    ROA_CHECK(socket->writes.empty());
+
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 1);
+    ROA_CHECK(socket->writes[0].kind == "batch");
+    ROA_CHECK(socket->writes[0].ws == connection.ws);
+    ROA_CHECK(socket->payloads() == (vector<string>{"control", "chat 1", "chat 2", "bulk"}));
+
+    // nothing left, so the next flush doesn't write
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 1);
+}
+
+ROA_TEST(coalescer_writes_a_lone_frame_without_batching) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("only"), CHAT);
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 1);
+    ROA_CHECK(socket->writes[0].kind == "send");
+    ROA_CHECK(socket->payloads() == (vector<string>{"only"}));
+}
+
+ROA_TEST(coalescer_drops_chat_past_the_byte_limit) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, outbound_limits{{1024, 10, 1024}, 1024});
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("1234"), CHAT);
+    coalescer.send(connection, string("5678"), CHAT);
+    coalescer.send(connection, string("9abc"), CHAT);
+    ROA_CHECK(coalescer.dropped(CHAT) == 1);
+
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"1234", "5678"}));
+
+    // the flush emptied the queue, so there's room again
+    coalescer.send(connection, string("def0"), CHAT);
+    coalescer.flush();
+    ROA_CHECK(socket->payloads().back() == "def0");
+    ROA_CHECK(coalescer.dropped(CHAT) == 1);
+}
+
+ROA_TEST(coalescer_paces_bulk_per_flush) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, outbound_limits{{1024, 1024, 1024}, 10});
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("map 1"), BULK);
+    coalescer.send(connection, string("map 2"), BULK);
+    coalescer.send(connection, string("a map past the budget"), BULK);
+    coalescer.send(connection, string("map 3"), BULK);
+
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"map 1", "map 2"}));
+
+    // control sent in between goes out ahead of the bulk still held, a frame larger than the budget still goes out whole
+    coalescer.send(connection, string("control"), CONTROL);
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"map 1", "map 2", "control", "a map past the budget"}));
+
+    coalescer.flush();
+    ROA_CHECK(socket->payloads().back() == "map 3");
+    ROA_CHECK(socket->writes.size() == 3);
+
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 3);
+}
+
+ROA_TEST(coalescer_closes_after_writing_what_was_sent) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("before"), CONTROL);
+    coalescer.flush();
+    coalescer.send(connection, string("error"), CONTROL);
+    coalescer.send(connection, string("chat"), CHAT);
+    coalescer.close(connection);
+    ROA_CHECK(socket->writes.size() == 1);
+
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 3);
+    ROA_CHECK(socket->writes[1].kind == "batch");
+    ROA_CHECK(socket->writes[1].payloads == (vector<string>{"error", "chat"}));
+    ROA_CHECK(socket->writes[2].kind == "close");
+
+    // closed once, later flushes leave the socket alone until onDisconnection removes the connection
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 3);
+    coalescer.remove(connection.connection_id);
+}
+
+ROA_TEST(coalescer_holds_frames_behind_a_reserved_spot) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    auto ticket = coalescer.reserve(connection.connection_id);
+    ROA_CHECK(ticket != 0);
+    coalescer.send(connection, string("behind"), BULK);
+    coalescer.send(connection, string("control"), CONTROL);
+
+    // control doesn't wait for the reserved spot, the bulk frame behind it does
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"control"}));
+
+    coalescer.fulfill(connection.connection_id, ticket, "reserved");
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"control", "reserved", "behind"}));
+
+    // settling a ticket twice or one that was never handed out changes nothing
+    coalescer.fulfill(connection.connection_id, ticket, "again");
+    coalescer.abandon(connection.connection_id, ticket + 10);
+    coalescer.flush();
+    ROA_CHECK(socket->payloads().size() == 3);
+}
+
+ROA_TEST(coalescer_drops_frames_for_removed_connections) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("held"), CONTROL);
+    coalescer.remove(connection.connection_id);
+    coalescer.send(connection, string("late"), CONTROL);
+    coalescer.flush();
+    ROA_CHECK(socket->writes.empty());
+}
+
+ROA_TEST(coalescer_drops_bulk_past_the_byte_limit_and_keeps_the_rest) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, outbound_limits{{1024, 1024, 10}, 1024});
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    coalescer.send(connection, string("map 1"), BULK);
+    coalescer.send(connection, string("a map over the limit"), BULK);
+    coalescer.send(connection, string("map 2"), BULK);
+    coalescer.send(connection, string("chat"), CHAT);
+    ROA_CHECK(coalescer.dropped(BULK) == 1);
+    ROA_CHECK(coalescer.dropped(CHAT) == 0);
+
+    // an encoded payload that no longer fits is dropped as well
+    auto ticket = coalescer.reserve(connection.connection_id);
+    coalescer.fulfill(connection.connection_id, ticket, "encoded map");
+    ROA_CHECK(coalescer.dropped(BULK) == 2);
+
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"chat", "map 1", "map 2"}));
+    ROA_CHECK(socket->writes.back().kind != "terminate");
+}
+
+ROA_TEST(coalescer_drops_chat_without_touching_control) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, outbound_limits{{1024, 4, 1024}, 1024});
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    for(int i = 0; i < 100; i++) {
+        coalescer.send(connection, string("chat"), CHAT);
+    }
+    coalescer.send(connection, string("response"), CONTROL);
+    ROA_CHECK(coalescer.dropped(CHAT) == 99);
+    ROA_CHECK(coalescer.dropped(CONTROL) == 0);
+
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"response", "chat"}));
+}
+
+ROA_TEST(coalescer_terminates_connections_overflowing_control) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, outbound_limits{{10, 1024, 1024}, 1024});
+    uint64_t storage = 0;
+    uint64_t other_storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    user_connection other(fake_socket(other_storage), 2);
+    coalescer.add(connection);
+    coalescer.add(other);
+
+    coalescer.send(connection, string("response 1"), CONTROL);
+    coalescer.send(connection, string("response 2"), CONTROL);
+    coalescer.send(connection, string("chat"), CHAT);
+    coalescer.send(other, string("response"), CONTROL);
+
+    // nothing more is written to the connection that fell behind, the other one isn't affected
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 2);
+    for(auto const &write : socket->writes) {
+        if(write.ws == connection.ws) {
+            ROA_CHECK(write.kind == "terminate");
+        } else {
+            ROA_CHECK(write.payloads == (vector<string>{"response"}));
+        }
+    }
+
+    // terminating runs onDisconnection, which removes the connection, frames sent afterwards go nowhere
+    coalescer.remove(connection.connection_id);
+    coalescer.send(connection, string("late"), CONTROL);
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 2);
+}
+
+ROA_TEST(coalescer_holds_a_later_ticket_until_the_earlier_one_is_fulfilled) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    auto first = coalescer.reserve(connection.connection_id);
+    auto second = coalescer.reserve(connection.connection_id);
+    ROA_CHECK(first != second);
+
+    coalescer.fulfill(connection.connection_id, second, "second");
+    coalescer.flush();
+    ROA_CHECK(socket->writes.empty());
+
+    coalescer.fulfill(connection.connection_id, first, "first");
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"first", "second"}));
+}
+
+ROA_TEST(coalescer_moves_on_past_an_abandoned_ticket) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    auto failed = coalescer.reserve(connection.connection_id);
+    auto encoded = coalescer.reserve(connection.connection_id);
+    coalescer.send(connection, string("behind"), BULK);
+    coalescer.fulfill(connection.connection_id, encoded, "encoded");
+    coalescer.flush();
+    ROA_CHECK(socket->writes.empty());
+
+    coalescer.abandon(connection.connection_id, failed);
+    coalescer.flush();
+    ROA_CHECK(socket->payloads() == (vector<string>{"encoded", "behind"}));
+    ROA_CHECK(coalescer.dropped(BULK) == 0);
+}
+
+ROA_TEST(coalescer_closes_with_tickets_outstanding) {
+    uWS::Hub hub;
+    auto socket = make_shared<recording_socket>();
+    outbound_coalescer coalescer(socket);
+    coalescer.start(hub.getLoop(), 60000, test_limits());
+    uint64_t storage = 0;
+    user_connection connection(fake_socket(storage), 1);
+    coalescer.add(connection);
+
+    auto ticket = coalescer.reserve(connection.connection_id);
+    coalescer.send(connection, string("behind"), BULK);
+    coalescer.send(connection, string("error"), CONTROL);
+    coalescer.send(connection, string("chat"), CHAT);
+    coalescer.close(connection);
+
+    // control and chat don't wait for the ticket, the bulk held behind it is dropped with the connection
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 2);
+    ROA_CHECK(socket->payloads() == (vector<string>{"error", "chat"}));
+    ROA_CHECK(socket->writes.back().kind == "close");
+
+    // a worker finishing the payload after the close doesn't write to the closing socket
+    coalescer.fulfill(connection.connection_id, ticket, "late");
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 2);
+
+    // nor after onDisconnection removed the connection
+    coalescer.remove(connection.connection_id);
+    coalescer.abandon(connection.connection_id, ticket);
+    coalescer.fulfill(connection.connection_id, coalescer.reserve(connection.connection_id), "gone");
+    coalescer.flush();
+    ROA_CHECK(socket->writes.size() == 2);
+}
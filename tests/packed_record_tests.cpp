@@ -0,0 +1,81 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <string>
+#include <utility>
+#include <vector>
+#include <src/packed_record.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    bool split(string const &record, vector<string> &messages) {
+        vector<pair<char const *, size_t>> packed;
+        auto result = split_packed_record(record.data(), record.size(), packed);
+        messages.clear();
+        for(auto const &message : packed) {
+            messages.emplace_back(message.first, message.second);
+        }
+        return result;
+    }
+}
+
+ROA_TEST(packed_record_round_trips_its_messages) {
+    packed_record_writer writer;
+    vector<string> sent{"{\"type\":1}", "", string(300, 'x'), string("\0\1\2", 3)};
+    for(auto const &message : sent) {
+        auto expected = writer.size_with(message);
+        writer.append(message);
+        ROA_CHECK(writer.size() == expected);
+    }
+    ROA_CHECK(writer.count() == sent.size());
+
+    auto record = writer.take();
+    ROA_CHECK(is_packed_record(record.data(), record.size()));
+    ROA_CHECK(writer.empty());
+    ROA_CHECK(writer.size() == packed_record_header_size);
+
+    vector<string> received;
+    ROA_CHECK(split(record, received));
+    ROA_CHECK(received == sent);
+
+    // the writer starts over after take
+    writer.append("again");
+    ROA_CHECK(split(writer.take(), received));
+    ROA_CHECK(received == vector<string>{"again"});
+}
+
+ROA_TEST(packed_record_rejects_cut_short_and_trailing_bytes) {
+    packed_record_writer writer;
+    writer.append("first");
+    writer.append("second");
+    auto record = writer.take();
+
+    vector<string> received;
+    ROA_CHECK(!split(record.substr(0, record.size() - 1), received));
+    ROA_CHECK(received == vector<string>{"first"});
+
+    ROA_CHECK(!split(record + "x", received));
+    ROA_CHECK(!split(record.substr(0, packed_record_header_size - 1), received));
+    ROA_CHECK(received.empty());
+
+    string not_packed = "{\"type\":1,\"padding\":\"...\"}";
+    ROA_CHECK(!is_packed_record(not_packed.data(), not_packed.size()));
+}
@@ -0,0 +1,258 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <rdkafka.h>
+#include <rdkafka_mock.h>
+#include <roa_di.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <messages/chat/chat_send_message.h>
+#include <src/partitioned_producer.h>
+#include <src/packed_record.h>
+#include <src/kafka_settings.h>
+#include <src/kafka_message_view.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    // librdkafka's in process mock cluster, hosted by a client that never produces itself
+    class stand_in_broker {
+    public:
+        stand_in_broker(char const *topic, int partitions) : _host(nullptr), _cluster(nullptr) {
+            char errstr[512];
+            auto conf = rd_kafka_conf_new();
+            _host = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+            if(_host == nullptr) {
+                rd_kafka_conf_destroy(conf);
+                throw runtime_error(errstr);
+            }
+
+            _cluster = rd_kafka_mock_cluster_new(_host, 1);
+            if(_cluster == nullptr || rd_kafka_mock_topic_create(_cluster, topic, partitions, 1) != RD_KAFKA_RESP_ERR_NO_ERROR) {
+                throw runtime_error("couldn't create the mock cluster");
+            }
+        }
+
+        ~stand_in_broker() {
+            if(_cluster != nullptr) {
+                rd_kafka_mock_cluster_destroy(_cluster);
+            }
+            rd_kafka_destroy(_host);
+        }
+
+        string bootstraps() const {
+            return rd_kafka_mock_cluster_bootstraps(_cluster);
+        }
+
+    private:
+        rd_kafka_t *_host;
+        rd_kafka_mock_cluster_t *_cluster;
+    };
+
+    struct consumed_record {
+        int32_t partition;
+        uint64_t key;
+        string payload;
+    };
+
+    size_t messages_in(string const &payload) {
+        if(!is_packed_record(payload.data(), payload.size())) {
+            return 1;
+        }
+
+        vector<pair<char const *, size_t>> messages;
+        split_packed_record(payload.data(), payload.size(), messages);
+        return messages.size();
+    }
+
+    // reads every partition from the start until count messages arrived, packed ones counted one by one, or ten seconds passed
+    vector<consumed_record> consume(string const &bootstraps, char const *topic, int partitions, size_t count) {
+        char errstr[512];
+        auto conf = kafka_consumer_conf(bootstraps, "partitioned_producer_tests");
+        auto rk = rd_kafka_new(RD_KAFKA_CONSUMER, conf, errstr, sizeof(errstr));
+        if(rk == nullptr) {
+            rd_kafka_conf_destroy(conf);
+            throw runtime_error(errstr);
+        }
+        rd_kafka_poll_set_consumer(rk);
+
+        auto assignment = rd_kafka_topic_partition_list_new(partitions);
+        for(int32_t partition = 0; partition < partitions; partition++) {
+            rd_kafka_topic_partition_list_add(assignment, topic, partition)->offset = RD_KAFKA_OFFSET_BEGINNING;
+        }
+        rd_kafka_assign(rk, assignment);
+        rd_kafka_topic_partition_list_destroy(assignment);
+
+        vector<consumed_record> records;
+        size_t consumed = 0;
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(10);
+        while(consumed < count && chrono::steady_clock::now() < deadline) {
+            auto msg = rd_kafka_consumer_poll(rk, 100);
+            if(msg == nullptr) {
+                continue;
+            }
+
+            if(msg->err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+                uint64_t key = 0;
+                for(size_t i = 0; i < msg->key_len; i++) {
+                    key = (key << 8) | static_cast<unsigned char const *>(msg->key)[i];
+                }
+                records.push_back(consumed_record{msg->partition, key, string(static_cast<char const *>(msg->payload), msg->len)});
+                consumed += messages_in(records.back().payload);
+            }
+            rd_kafka_message_destroy(msg);
+        }
+
+        rd_kafka_consumer_close(rk);
+        rd_kafka_destroy(rk);
+        return records;
+    }
+}
+
+ROA_TEST(partitioned_producer_keeps_every_key_on_one_partition_in_order) {
+    stand_in_broker broker("keyed", 4);
+    auto common_injector = create_common_di_injector();
+    partitioned_producer producer(common_injector.create<shared_ptr<ikafka_producer<false>>>(), true);
+    producer.start(broker.bootstraps(), 5000);
+
+    // the client id doubles as the order the messages were produced in
+    for(uint64_t i = 1; i <= 400; i++) {
+        producer.enqueue_message("keyed", i % 8, binary_chat_send_message{{false, i, 1, 0}, "user", "target", "message"});
+    }
+    producer.close();
+
+    auto records = consume(broker.bootstraps(), "keyed", 4, 400);
+    ROA_CHECK(records.size() == 400);
+
+    map<uint64_t, int32_t> partitions;
+    map<uint64_t, uint64_t> last_sent;
+    for(auto const &record : records) {
+        auto msg = message<false>::deserialize<false>(record.payload);
+        ROA_CHECK(get<1>(msg) != nullptr);
+        if(!get<1>(msg)) {
+            continue;
+        }
+
+        auto sent = get<1>(msg)->sender.client_id;
+        ROA_CHECK(sent % 8 == record.key);
+        ROA_CHECK(partitions.emplace(record.key, record.partition).first->second == record.partition);
+        ROA_CHECK(last_sent[record.key] < sent);
+        last_sent[record.key] = sent;
+    }
+
+    // 8 keys on 4 partitions, all on one would mean the key wasn't used
+    map<int32_t, size_t> keys_per_partition;
+    for(auto const &key : partitions) {
+        keys_per_partition[key.second]++;
+    }
+    ROA_CHECK(keys_per_partition.size() > 1);
+}
+
+ROA_TEST(partitioned_producer_packs_per_partition_within_max_bytes) {
+    stand_in_broker broker("packed", 4);
+    auto common_injector = create_common_di_injector();
+    size_t const max_bytes = 1024;
+    partitioned_producer producer(common_injector.create<shared_ptr<ikafka_producer<false>>>(), true, 20, max_bytes);
+    producer.start(broker.bootstraps(), 5000);
+
+    // one message too large to pack, it has to arrive unpacked and still in order for its key
+    uint64_t const oversized = 200;
+    for(uint64_t i = 1; i <= 400; i++) {
+        producer.enqueue_message("packed", i % 8, binary_chat_send_message{{false, i, 1, 0}, "user", "target", i == oversized ? string(2 * max_bytes, 'x') : "message"});
+        if(i % 50 == 0) {
+            producer.poll(0);
+        }
+    }
+    producer.close();
+
+    auto records = consume(broker.bootstraps(), "packed", 4, 400);
+
+    map<uint64_t, int32_t> partitions;
+    map<uint64_t, uint64_t> last_sent;
+    size_t messages = 0;
+    size_t packed_records = 0;
+    bool oversized_unpacked = false;
+    for(auto const &record : records) {
+        vector<pair<char const *, size_t>> payloads;
+        if(is_packed_record(record.payload.data(), record.payload.size())) {
+            ROA_CHECK(record.payload.size() <= max_bytes);
+            ROA_CHECK(split_packed_record(record.payload.data(), record.payload.size(), payloads));
+            packed_records++;
+        } else {
+            payloads.emplace_back(record.payload.data(), record.payload.size());
+        }
+
+        for(size_t i = 0; i < payloads.size(); i++) {
+            auto msg = message<false>::deserialize<false>(string(payloads[i].first, payloads[i].second));
+            ROA_CHECK(get<1>(msg) != nullptr);
+            if(!get<1>(msg)) {
+                continue;
+            }
+            messages++;
+
+            auto sent = get<1>(msg)->sender.client_id;
+            auto key = sent % 8;
+            // a packed record is keyed like its first message, the others only share its partition
+            if(i == 0) {
+                ROA_CHECK(key == record.key);
+            }
+            if(sent == oversized) {
+                oversized_unpacked = payloads.size() == 1 && !is_packed_record(record.payload.data(), record.payload.size());
+            }
+            ROA_CHECK(partitions.emplace(key, record.partition).first->second == record.partition);
+            ROA_CHECK(last_sent[key] < sent);
+            last_sent[key] = sent;
+        }
+    }
+
+    ROA_CHECK(messages == 400);
+    ROA_CHECK(oversized_unpacked);
+    ROA_CHECK(packed_records > 0 && packed_records < records.size());
+}
+
+ROA_TEST(raw_records_need_the_keyed_producer) {
+    stand_in_broker broker("server-9", 2);
+    auto common_injector = create_common_di_injector();
+    partitioned_producer unkeyed(common_injector.create<shared_ptr<ikafka_producer<false>>>(), false);
+    ROA_CHECK(!unkeyed.enqueue_record("server-9", 10, "record"));
+
+    partitioned_producer producer(common_injector.create<shared_ptr<ikafka_producer<false>>>(), true);
+    producer.start(broker.bootstraps(), 5000);
+    auto record = position_view::write({false, 1, 1, 0}, 100, 1.5f, 2);
+    ROA_CHECK(producer.enqueue_record("server-9", 10, record));
+    producer.close();
+
+    auto records = consume(broker.bootstraps(), "server-9", 2, 1);
+    ROA_CHECK(records.size() == 1);
+    ROA_CHECK(records[0].key == 10);
+    ROA_CHECK(records[0].payload == record);
+}
+
+ROA_TEST(server_topics_are_interned_once_per_server) {
+    auto topic = server_topic(12);
+    ROA_CHECK(topic.str() == "server-12");
+    ROA_CHECK(server_topic(12) == topic);
+    ROA_CHECK(server_topic(13).str() == "server-13");
+    ROA_CHECK(server_topic(13) != topic);
+}
@@ -0,0 +1,111 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <json.hpp>
+#include <limits>
+#include <string>
+#include <vector>
+#include <messages/user_access_control/login_response_message.h>
+#include <messages/user_access_control/get_characters_response_message.h>
+#include <messages/chat/chat_receive_message.h>
+#include <messages/error_response_message.h>
+#include <src/gateway_messages/response_writers.h>
+
+using namespace std;
+using namespace roa;
+
+using json = nlohmann::json;
+
+// The writers replace the common library's serialize() on the wire, so whatever a client parses has to be identical.
+// Compared as parsed json, key order and whitespace are up to the serializer.
+
+ROA_TEST(login_response_writer_matches_common_serialization) {
+    for(int8_t admin_status : {int8_t{-1}, int8_t{0}, int8_t{1}}) {
+        for(uint64_t user_id : {uint64_t{0}, uint64_t{42}, numeric_limits<uint64_t>::max()}) {
+            string written;
+            write_login_response(written, admin_status, user_id);
+            auto expected = json_login_response_message{{false, 0, 0, 0}, admin_status, user_id}.serialize();
+            ROA_CHECK(json::parse(written) == json::parse(expected));
+        }
+    }
+}
+
+ROA_TEST(chat_receive_writer_matches_common_serialization) {
+    string const texts[] = {"", "hello", "quote \" backslash \\ newline \n tab \t", string("control \x01 nul ") + '\0', "caf\xc3\xa9 \xf0\x9f\x98\x80"};
+    // a channel message and a whisper delivered straight to someone on this gateway
+    for(string const &target : {string("#world"), string("bob")}) {
+        for(auto const &text : texts) {
+            string written;
+            write_chat_receive(written, "someone", target, text);
+            auto expected = json_chat_receive_message{{false, 0, 0, 0}, "someone", target, text}.serialize();
+            ROA_CHECK(json::parse(written) == json::parse(expected));
+        }
+    }
+}
+
+ROA_TEST(error_response_writer_matches_common_serialization) {
+    for(int32_t error_number : {-2, -1, 0, 404}) {
+        for(string const &text : {string(""), string("Need to login."), string("banned \"for\" now\n")}) {
+            string written;
+            write_error_response(written, error_number, text);
+            auto expected = json_error_response_message{{false, 0, 0, 0}, error_number, text}.serialize();
+            ROA_CHECK(json::parse(written) == json::parse(expected));
+        }
+    }
+}
+
+ROA_TEST(get_characters_response_writer_matches_common_serialization) {
+    vector<message_player> players;
+    for(uint32_t count = 0; count < 4; count++) {
+        string written;
+        write_get_characters_response(written, players.size(), [&](size_t i) {
+            return character_fields{players[i].player_id, players[i].player_name, players[i].map_name};
+        }, "world \"one\"");
+        auto expected = json_get_characters_response_message{{false, 0, 0, 0}, players, "world \"one\""}.serialize();
+        ROA_CHECK(json::parse(written) == json::parse(expected));
+
+        players.push_back({count + 1000, "player " + to_string(count), "map\\" + to_string(count)});
+    }
+}
+
+ROA_TEST(json_writer_writes_integer_extremes) {
+    string written;
+    json_writer(written).field("min", numeric_limits<int64_t>::min()).field("max", numeric_limits<uint64_t>::max())
+            .field("small", int8_t{-5}).field("flag", true).finish();
+    auto parsed = json::parse(written);
+    ROA_CHECK(parsed["min"].get<int64_t>() == numeric_limits<int64_t>::min());
+    ROA_CHECK(parsed["max"].get<uint64_t>() == numeric_limits<uint64_t>::max());
+    ROA_CHECK(parsed["small"].get<int>() == -5);
+    ROA_CHECK(parsed["flag"].get<bool>());
+}
+
+ROA_TEST(outbound_buffer_nested_use_keeps_the_outer_frame) {
+    outbound_buffer outer;
+    outer.str() = "outer frame";
+    {
+        outbound_buffer inner;
+        ROA_CHECK(inner.str().empty());
+        inner.str() = "inner frame";
+    }
+    ROA_CHECK(outer.str() == "outer frame");
+
+    // the inner one went back to the pool cleared, the next user starts empty
+    outbound_buffer reused;
+    ROA_CHECK(reused.str().empty());
+}
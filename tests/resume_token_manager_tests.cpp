@@ -0,0 +1,151 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <chrono>
+#include <string>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <src/resume_token_manager.h>
+
+using namespace std;
+using namespace roa;
+
+namespace {
+    string const secret = "resume token secret of at least 32 characters";
+
+    session_state logged_in(uint64_t user_id, string username) {
+        session_state session{};
+        session.state = LOGGED_IN;
+        session.admin_status = 1;
+        session.username = move(username);
+        session.user_id = user_id;
+        session.player_characters.push_back({7, 1, "character", {}, {}});
+        return session;
+    }
+
+    string to_hex(string const &data) {
+        static char const digits[] = "0123456789abcdef";
+        string hex;
+        for(unsigned char c : data) {
+            hex.push_back(digits[c >> 4]);
+            hex.push_back(digits[c & 0x0F]);
+        }
+        return hex;
+    }
+
+    string from_hex(string const &hex) {
+        string data;
+        for(size_t i = 0; i + 1 < hex.size(); i += 2) {
+            data.push_back(static_cast<char>(stoi(hex.substr(i, 2), nullptr, 16)));
+        }
+        return data;
+    }
+
+    string payload_of(string const &token) {
+        return from_hex(token.substr(0, token.find('.')));
+    }
+
+    // a token the way the manager would sign it, for payloads it never issued
+    string signed_token(string const &payload) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int digest_length = 0;
+        HMAC(EVP_sha256(), secret.data(), static_cast<int>(secret.length()), reinterpret_cast<unsigned char const *>(payload.data()),
+             payload.length(), digest, &digest_length);
+        return to_hex(payload) + "." + to_hex(string(reinterpret_cast<char const *>(digest), digest_length));
+    }
+
+    // the payload is user_id:admin_status:expires_at:nonce:username
+    string with_field(string const &payload, size_t index, string const &value) {
+        size_t start = 0;
+        for(size_t i = 0; i < index; i++) {
+            start = payload.find(':', start) + 1;
+        }
+        return payload.substr(0, start) + value + payload.substr(payload.find(':', start));
+    }
+}
+
+ROA_TEST(resume_token_is_redeemed_once) {
+    resume_token_manager tokens(secret, chrono::seconds(60));
+    auto token = tokens.issue(logged_in(5, "someone"));
+    ROA_CHECK(!token.empty());
+
+    auto session = tokens.redeem(token);
+    ROA_CHECK(session);
+    ROA_CHECK(session->user_id == 5);
+    ROA_CHECK(session->admin_status == 1);
+    ROA_CHECK(session->username == "someone");
+    ROA_CHECK(session->player_characters.size() == 1 && session->player_characters[0].id == 7);
+
+    ROA_CHECK(!tokens.redeem(token));
+}
+
+ROA_TEST(resume_token_superseded_by_a_newer_one_is_rejected) {
+    resume_token_manager tokens(secret, chrono::seconds(60));
+    auto older = tokens.issue(logged_in(5, "someone"));
+    auto newer = tokens.issue(logged_in(5, "someone"));
+
+    ROA_CHECK(!tokens.redeem(older));
+    ROA_CHECK(tokens.redeem(newer));
+}
+
+ROA_TEST(resume_token_past_its_expiry_is_rejected) {
+    resume_token_manager tokens(secret, chrono::seconds(60));
+    auto payload = payload_of(tokens.issue(logged_in(5, "someone")));
+    auto expired_at = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count() - 1;
+
+    // correctly signed and the nonce still cached, only the expiry is in the past
+    ROA_CHECK(!tokens.redeem(signed_token(with_field(payload, 2, to_string(expired_at)))));
+    ROA_CHECK(tokens.redeem(signed_token(payload)));
+}
+
+ROA_TEST(resume_token_with_tampered_payload_or_signature_is_rejected) {
+    resume_token_manager tokens(secret, chrono::seconds(60));
+    auto token = tokens.issue(logged_in(5, "someone"));
+    auto payload = payload_of(token);
+    auto signature = token.substr(token.find('.') + 1);
+
+    // an admin status raised without the secret
+    ROA_CHECK(!tokens.redeem(to_hex(with_field(payload, 1, "2")) + "." + signature));
+
+    auto flipped = signature;
+    flipped[0] = flipped[0] == '0' ? '1' : '0';
+    ROA_CHECK(!tokens.redeem(to_hex(payload) + "." + flipped));
+    ROA_CHECK(!tokens.redeem(to_hex(payload) + "." + signature.substr(2)));
+    ROA_CHECK(!tokens.redeem(to_hex(payload)));
+
+    resume_token_manager other_gateway("a different secret of at least 32 characters", chrono::seconds(60));
+    ROA_CHECK(!other_gateway.redeem(token));
+
+    // none of the above used up the real token
+    ROA_CHECK(tokens.redeem(token));
+}
+
+ROA_TEST(resume_token_keeps_a_username_containing_the_separator) {
+    resume_token_manager tokens(secret, chrono::seconds(60));
+    auto session = tokens.redeem(tokens.issue(logged_in(5, "some:one:")));
+    ROA_CHECK(session);
+    ROA_CHECK(session->user_id == 5);
+    ROA_CHECK(session->username == "some:one:");
+}
+
+ROA_TEST(resume_tokens_are_off_without_a_secret) {
+    resume_token_manager tokens("", chrono::seconds(60));
+    ROA_CHECK(!tokens.enabled());
+    ROA_CHECK(tokens.issue(logged_in(5, "someone")).empty());
+}
@@ -0,0 +1,131 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <string>
+#include <json.hpp>
+#include <src/snapshot_deltas.h>
+
+using namespace std;
+using namespace roa;
+using json = nlohmann::json;
+
+namespace {
+    constexpr uint32_t stream = 7;
+
+    string snapshot_with(int texture) {
+        json snapshot = {{"map_name", "test"}, {"tiles", json::array()}};
+        for(int i = 0; i < 64; i++) {
+            snapshot["tiles"].push_back({{"x", i}, {"texture", i == 3 ? texture : 1}});
+        }
+        return snapshot.dump();
+    }
+}
+
+ROA_TEST(snapshot_deltas_ignore_acknowledgements_for_unknown_connections) {
+    snapshot_deltas deltas(8, {stream});
+    deltas.acknowledge(1, stream, 0);
+    ROA_CHECK(!deltas.encode(1, stream, snapshot_with(1)));
+
+    deltas.add(2);
+    deltas.acknowledge(2, stream, 0);
+    deltas.remove(2);
+    // a late acknowledgement doesn't bring a removed connection back
+    deltas.acknowledge(2, stream, 0);
+    ROA_CHECK(!deltas.encode(2, stream, snapshot_with(1)));
+}
+
+ROA_TEST(snapshot_deltas_ignore_streams_that_were_not_configured) {
+    snapshot_deltas deltas(8, {stream});
+    deltas.add(1);
+    deltas.acknowledge(1, stream + 1, 0);
+    ROA_CHECK(!deltas.encode(1, stream + 1, snapshot_with(1)));
+    ROA_CHECK(!deltas.encode(1, stream, snapshot_with(1)));
+}
+
+ROA_TEST(snapshot_deltas_patch_against_the_acknowledged_baseline) {
+    snapshot_deltas deltas(8, {stream});
+    deltas.add(1);
+    deltas.acknowledge(1, stream, 0);
+
+    auto first = json::parse(deltas.encode(1, stream, snapshot_with(1)).value());
+    ROA_CHECK(first["sequence"] == 1 && first.count("snapshot") == 1 && first.count("baseline") == 0);
+    ROA_CHECK(first["snapshot"] == json::parse(snapshot_with(1)));
+
+    // not acknowledged yet, so still a full snapshot
+    auto second = json::parse(deltas.encode(1, stream, snapshot_with(2)).value());
+    ROA_CHECK(second["sequence"] == 2 && second.count("snapshot") == 1);
+
+    deltas.acknowledge(1, stream, 1);
+    auto third = json::parse(deltas.encode(1, stream, snapshot_with(3)).value());
+    ROA_CHECK(third["sequence"] == 3 && third["baseline"] == 1 && third.count("patch") == 1);
+    ROA_CHECK(json::parse(snapshot_with(1)).patch(third["patch"]) == json::parse(snapshot_with(3)));
+
+    // acknowledging an older frame than the baseline changes nothing
+    deltas.acknowledge(1, stream, 3);
+    deltas.acknowledge(1, stream, 2);
+    auto fourth = json::parse(deltas.encode(1, stream, snapshot_with(4)).value());
+    ROA_CHECK(fourth["baseline"] == 3);
+    ROA_CHECK(json::parse(snapshot_with(3)).patch(fourth["patch"]) == json::parse(snapshot_with(4)));
+}
+
+ROA_TEST(snapshot_deltas_fall_back_to_full_snapshots_when_acknowledgements_stop) {
+    snapshot_deltas deltas(2, {stream});
+    deltas.add(1);
+    deltas.acknowledge(1, stream, 0);
+    deltas.encode(1, stream, snapshot_with(1));
+    deltas.acknowledge(1, stream, 1);
+
+    ROA_CHECK(json::parse(deltas.encode(1, stream, snapshot_with(2)).value()).count("patch") == 1);
+    ROA_CHECK(json::parse(deltas.encode(1, stream, snapshot_with(3)).value()).count("patch") == 1);
+    // the third unacknowledged frame drops the baseline for the frames after it
+    ROA_CHECK(json::parse(deltas.encode(1, stream, snapshot_with(4)).value()).count("patch") == 1);
+    ROA_CHECK(json::parse(deltas.encode(1, stream, snapshot_with(5)).value()).count("snapshot") == 1);
+}
+
+ROA_TEST(snapshot_deltas_keep_reserved_sequences_when_fulfilled_out_of_order) {
+    snapshot_deltas deltas(8, {stream});
+    deltas.add(1);
+    deltas.acknowledge(1, stream, 0);
+
+    auto first = deltas.reserve(1, stream).value();
+    auto second = deltas.reserve(1, stream).value();
+    ROA_CHECK(first.sequence == 1 && second.sequence == 2);
+
+    auto second_frame = json::parse(deltas.fulfill(second, snapshot_with(2)));
+    auto first_frame = json::parse(deltas.fulfill(first, snapshot_with(1)));
+    ROA_CHECK(first_frame["sequence"] == 1 && first_frame["snapshot"] == json::parse(snapshot_with(1)));
+    ROA_CHECK(second_frame["sequence"] == 2 && second_frame["snapshot"] == json::parse(snapshot_with(2)));
+
+    deltas.acknowledge(1, stream, 2);
+    auto third = json::parse(deltas.encode(1, stream, snapshot_with(3)).value());
+    ROA_CHECK(third["baseline"] == 2);
+    ROA_CHECK(json::parse(snapshot_with(2)).patch(third["patch"]) == json::parse(snapshot_with(3)));
+}
+
+ROA_TEST(snapshot_deltas_send_full_snapshots_against_a_baseline_that_was_never_encoded) {
+    snapshot_deltas deltas(8, {stream});
+    deltas.add(1);
+    deltas.acknowledge(1, stream, 0);
+
+    // acknowledged while still being encoded, or its encoding failed
+    auto abandoned = deltas.reserve(1, stream).value();
+    deltas.acknowledge(1, stream, abandoned.sequence);
+    auto next = json::parse(deltas.encode(1, stream, snapshot_with(2)).value());
+    ROA_CHECK(next["sequence"] == 2 && next.count("snapshot") == 1);
+}
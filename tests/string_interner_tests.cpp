@@ -0,0 +1,104 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <src/string_interner.h>
+
+using namespace std;
+using namespace roa;
+
+ROA_TEST(equal_strings_share_a_stable_id) {
+    string_interner interner;
+
+    auto forest = interner.intern(string("forest"));
+    auto cave = interner.intern(string("cave"));
+    ROA_CHECK(forest != cave);
+    ROA_CHECK(forest.str() == "forest");
+    ROA_CHECK(cave.str() == "cave");
+
+    // the string_view lookup and later inserts don't change the id of a known string
+    for(uint32_t i = 0; i < 100; i++) {
+        interner.intern("map " + to_string(i));
+    }
+    ROA_CHECK(interner.intern(string_view("forest")) == forest);
+    ROA_CHECK(interner.intern(string("forest")).id() == forest.id());
+
+    // the empty string is the default handle
+    ROA_CHECK(interner.intern(string()) == interned_string());
+    ROA_CHECK(interned_string().str().empty());
+}
+
+ROA_TEST(views_stay_valid_while_the_interner_grows) {
+    string_interner interner;
+
+    auto first = interner.intern(string("first"));
+    auto const *address = &first.str();
+    auto const *characters = first.str().data();
+
+    // far beyond a deque block, a vector would have moved its strings several times by now
+    vector<interned_string> handles;
+    for(uint32_t i = 0; i < 10000; i++) {
+        handles.push_back(interner.intern("name " + to_string(i)));
+    }
+
+    ROA_CHECK(&first.str() == address);
+    ROA_CHECK(first.str().data() == characters);
+    ROA_CHECK(first.str() == "first");
+    for(uint32_t i = 0; i < handles.size(); i++) {
+        ROA_CHECK(handles[i].str() == "name " + to_string(i));
+    }
+}
+
+ROA_TEST(concurrent_inserts_and_lookups_agree_on_ids) {
+    constexpr uint32_t threads_count = 4;
+    constexpr uint32_t names = 2000;
+    string_interner interner;
+    auto known = interner.intern(string("known"));
+
+    vector<vector<interned_string>> seen(threads_count);
+    atomic<bool> wrong{false};
+    vector<thread> threads;
+    for(uint32_t t = 0; t < threads_count; t++) {
+        threads.emplace_back([&, t] {
+            // every thread inserts the same names in a different order, racing lookups of a name already known
+            for(uint32_t i = 0; i < names; i++) {
+                auto name = (i * (t + 1)) % names;
+                auto handle = interner.intern("name " + to_string(name));
+                if(handle.str() != "name " + to_string(name) || interner.intern(string_view("known")) != known) {
+                    wrong = true;
+                }
+                seen[t].push_back(handle);
+            }
+        });
+    }
+    for(auto &t : threads) {
+        t.join();
+    }
+
+    ROA_CHECK(!wrong.load());
+    for(uint32_t t = 0; t < threads_count; t++) {
+        for(uint32_t i = 0; i < names; i++) {
+            auto name = (i * (t + 1)) % names;
+            ROA_CHECK(seen[t][i] == interner.intern("name " + to_string(name)));
+        }
+    }
+}
@@ -0,0 +1,66 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Runs every registered test, or the ones whose name starts with one of the arguments.
+// usage: gateway_tests [test prefix...]
+
+#include "test_runner.h"
+#include <easylogging++.h>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace roa;
+
+INITIALIZE_EASYLOGGINGPP
+
+vector<tests::test_case> &tests::registered_tests() {
+    static vector<test_case> cases;
+    return cases;
+}
+
+int main(int argc, char **argv) {
+    el::Configurations defaultConf;
+    defaultConf.setGlobally(el::ConfigurationType::Enabled, "false");
+    el::Loggers::reconfigureAllLoggers(defaultConf);
+
+    size_t run = 0;
+    size_t failed = 0;
+    for(auto &test : tests::registered_tests()) {
+        bool selected = argc < 2;
+        for(int i = 1; i < argc; i++) {
+            selected = selected || strncmp(test.name, argv[i], strlen(argv[i])) == 0;
+        }
+
+        if(!selected) {
+            continue;
+        }
+
+        run++;
+        try {
+            test.run();
+            cout << "passed " << test.name << endl;
+        } catch(exception &e) {
+            failed++;
+            cout << "FAILED " << test.name << ": " << e.what() << endl;
+        }
+    }
+
+    cout << run - failed << "/" << run << " tests passed" << endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+namespace roa {
+    namespace tests {
+        struct test_case {
+            char const *name;
+            void (*run)();
+        };
+
+        std::vector<test_case> &registered_tests();
+
+        struct test_registrar {
+            test_registrar(char const *name, void (*run)()) {
+                registered_tests().push_back({name, run});
+            }
+        };
+
+        struct check_failure : std::runtime_error {
+            using std::runtime_error::runtime_error;
+        };
+    }
+}
+
+// Registers a test with RealmOfAesirGatewayTests, a failing ROA_CHECK or any exception fails it.
+#define ROA_TEST(name) \
+    static void name(); \
+    static roa::tests::test_registrar name##_registrar(#name, name); \
+    static void name()
+
+#define ROA_CHECK(condition) \
+    do { \
+        if(!(condition)) { \
+            throw roa::tests::check_failure(std::string(__FILE__) + ":" + std::to_string(__LINE__) + ": " #condition); \
+        } \
+    } while(false)
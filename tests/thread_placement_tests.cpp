@@ -0,0 +1,56 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <sched.h>
+#include <thread>
+#include <src/thread_placement.h>
+
+using namespace std;
+using namespace roa;
+
+ROA_TEST(parse_cpu_list_reads_ranges_and_single_cpus) {
+    auto cpus = parse_cpu_list("0-3,8");
+    ROA_CHECK(cpus && cpus.value() == (vector<int>{0, 1, 2, 3, 8}));
+    cpus = parse_cpu_list("5");
+    ROA_CHECK(cpus && cpus.value() == vector<int>{5});
+}
+
+ROA_TEST(parse_cpu_list_rejects_what_strtol_would_skip) {
+    for(auto list : {" 1", "+1", "-1", "1, 2", "1,+2", "1- 3", "1-+3", "0x1", "1,", "3-1", "1-", "a", "99999999999999999999"}) {
+        ROA_CHECK(!parse_cpu_list(list));
+    }
+}
+
+ROA_TEST(empty_cpu_list_undoes_an_inherited_pinning) {
+    cpu_set_t before;
+    ROA_CHECK(sched_getaffinity(0, sizeof(before), &before) == 0);
+
+    bool reset = false;
+    thread([&] {
+        // pinned like main used to be before spawning its threads, then placed without a list of its own
+        place_current_thread("roa-test", "0");
+        thread([&] {
+            place_current_thread("roa-test-child", "");
+            cpu_set_t after;
+            reset = sched_getaffinity(0, sizeof(after), &after) == 0 && CPU_EQUAL(&before, &after);
+        }).join();
+    }).join();
+
+    ROA_CHECK(reset);
+}
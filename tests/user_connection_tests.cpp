@@ -0,0 +1,83 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_runner.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <src/user_connection.h>
+
+using namespace std;
+using namespace roa;
+
+// Meant to run under -fsanitize=thread as well: writers publish concurrently, so compare-and-swap retries happen,
+// while readers dereference sessions inside epoch guards as the uws and consumer threads do.
+ROA_TEST(session_updates_survive_concurrent_writers_and_readers) {
+    constexpr uint32_t writers = 4;
+    constexpr uint32_t readers = 2;
+    constexpr uint64_t updates_per_writer = 20000;
+
+    user_connection connection(nullptr);
+    vector<player_character> characters(3);
+    for(size_t i = 0; i < characters.size(); i++) {
+        characters[i].id = i + 1;
+        characters[i].player_name = "character " + to_string(i);
+    }
+
+    atomic<uint32_t> writers_done{0};
+    atomic<bool> torn{false};
+    vector<thread> threads;
+
+    for(uint32_t w = 0; w < writers; w++) {
+        threads.emplace_back([&] {
+            for(uint64_t i = 0; i < updates_per_writer; i++) {
+                // the same shape as the login and resume handlers, everything copied in so a retry publishes the same
+                connection.update_session([&](session_state &updated) {
+                    updated.state = LOGGED_IN;
+                    updated.user_id++;
+                    updated.player_characters = characters;
+                });
+            }
+            writers_done.fetch_add(1);
+        });
+    }
+
+    for(uint32_t r = 0; r < readers; r++) {
+        threads.emplace_back([&] {
+            uint64_t last_user_id = 0;
+            while(writers_done.load() < writers) {
+                epoch_guard guard(session_reclaimer());
+                auto session = connection.session();
+                if(session->user_id < last_user_id || (session->user_id > 0 && session->player_characters.size() != characters.size())) {
+                    torn = true;
+                }
+                last_user_id = session->user_id;
+            }
+        });
+    }
+
+    for(auto &t : threads) {
+        t.join();
+    }
+
+    epoch_guard guard(session_reclaimer());
+    ROA_CHECK(!torn.load());
+    ROA_CHECK(connection.session()->user_id == writers * updates_per_writer);
+    ROA_CHECK(connection.session()->player_characters.size() == characters.size());
+    ROA_CHECK(connection.session()->player_characters[2].player_name == "character 2");
+}
@@ -0,0 +1,800 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Micro benchmarks of the gateway hot paths, without sockets or a broker.
+// usage: bench_gateway [case prefix...], runs every case without arguments
+
+#include <easylogging++.h>
+#include <macros.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <malloc.h>
+#include <new>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <messages/user_access_control/login_message.h>
+#include <messages/user_access_control/get_characters_response_message.h>
+#include <messages/chat/chat_send_message.h>
+#include <src/payload_compressor.h>
+#include <src/compression_dictionary.h>
+#include <src/area_of_interest.h>
+#include <src/json_scanner.h>
+#include <src/snapshot_deltas.h>
+#include <src/outbound_coalescer.h>
+#include <src/connection_registry.h>
+#include <src/chat_channel_registry.h>
+#include <src/worker_pool.h>
+#include <src/gateway_messages/gateway_message.h>
+#include <src/gateway_messages/response_writers.h>
+#include <src/kafka_message_view.h>
+
+using namespace std;
+using namespace roa;
+
+INITIALIZE_EASYLOGGINGPP
+
+namespace {
+    // counts the heap allocations of the calling thread, so a case can report allocations per operation
+    thread_local size_t allocations = 0;
+}
+
+void *operator new(size_t size) {
+    allocations++;
+    if(auto memory = malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
+
+namespace {
+    struct bench_case {
+        char const *name;
+        function<void(char const *name)> run;
+    };
+
+    // times every call of op on its own, so tail latencies show up next to the mean
+    template <class F>
+    void measure(char const *name, size_t iterations, F &&op) {
+        for(size_t i = 0; i < iterations / 10 + 1; i++) {
+            op(i);
+        }
+
+        vector<int64_t> samples;
+        samples.reserve(iterations);
+        auto start = chrono::steady_clock::now();
+        for(size_t i = 0; i < iterations; i++) {
+            auto op_start = chrono::steady_clock::now();
+            op(i);
+            samples.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - op_start).count());
+        }
+        auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+        sort(begin(samples), end(samples));
+        cout << name << ": " << iterations << " ops, " << elapsed / static_cast<int64_t>(max<size_t>(iterations, 1)) << " ns/op mean"
+             << ", p50 " << samples[samples.size() / 2] << " ns, p99 " << samples[samples.size() * 99 / 100] << " ns" << endl;
+    }
+
+    // a map payload shaped like the ones the world server sends, large and repetitive
+    string map_payload(size_t tiles, uint32_t seed) {
+        string payload = "{\"type\":3,\"map_name\":\"bench\",\"tiles\":[";
+        for(size_t i = 0; i < tiles; i++) {
+            if(i > 0) {
+                payload += ',';
+            }
+            payload += "{\"x\":" + to_string(i % 64) + ",\"y\":" + to_string(i / 64) + ",\"texture\":" + to_string((i * 7 + seed) % 13) + "}";
+        }
+        payload += "]}";
+        return payload;
+    }
+
+    // a character list response, just over the compression threshold, where a dictionary has the most to give
+    string characters_payload(uint32_t seed) {
+        string payload = "{\"type\":5,\"sender\":{\"is_server\":false,\"client_id\":0,\"server_origin_id\":0,\"server_destination_id\":0},\"players\":[";
+        for(uint32_t i = 0; i < 24; i++) {
+            if(i > 0) {
+                payload += ',';
+            }
+            payload += "{\"player_id\":" + to_string(1000 + seed * 24 + i) + ",\"player_name\":\"character_" + to_string(seed) + "_" + to_string(i)
+                       + "\",\"map_name\":\"map_" + to_string((seed + i) % 5) + "\"}";
+        }
+        payload += "],\"world_name\":\"bench_world\"}";
+        return payload;
+    }
+
+    // bytes on the wire and time per payload for every level and mode, the dictionary built from other maps and lists
+    void bench_compression(char const *name) {
+        vector<string> samples;
+        for(uint32_t seed = 100; seed < 164; seed++) {
+            samples.push_back(seed % 8 == 0 ? map_payload(4096, seed) : characters_payload(seed));
+        }
+        auto dictionary = build_compression_dictionary(samples);
+        cout << "  " << dictionary.size() << " byte dictionary from " << samples.size() << " samples" << endl;
+
+        struct payload_pair {
+            char const *name;
+            string payload;
+            string other_payload;
+        };
+        payload_pair const payloads[] = {
+                {"map", map_payload(4096, 0), map_payload(4096, 1)},
+                {"characters", characters_payload(0), characters_payload(1)},
+        };
+
+        for(auto const &payload : payloads) {
+            for(int level : {1, 6, 9}) {
+                for(auto mode : {PERMESSAGE_DEFLATE, PRESET_DICTIONARY}) {
+                    // one cache entry and two alternating payloads, every call deflates
+                    payload_compressor uncached(level, 1024, dictionary, 1);
+                    string case_name = string(name) + "/" + payload.name + "/level_" + to_string(level) + (mode == PERMESSAGE_DEFLATE ? "/deflate" : "/dictionary");
+                    size_t compressed_bytes = 0;
+                    measure(case_name.c_str(), payload.payload.size() > 16 * 1024 ? 200 : 20000, [&](size_t i) {
+                        compressed_bytes = uncached.encode(mode, i % 2 == 0 ? payload.payload : payload.other_payload).bytes.size();
+                    });
+                    cout << "  " << payload.payload.size() << " bytes -> " << compressed_bytes << " bytes" << endl;
+                }
+            }
+        }
+
+        // the same map to many clients, deflated once
+        payload_compressor cached(6, 1024, "", 32);
+        size_t compressed_bytes = 0;
+        measure((string(name) + "/map/cached").c_str(), 20000, [&](size_t) {
+            compressed_bytes += cached.encode(PERMESSAGE_DEFLATE, payloads[0].payload).bytes.size();
+        });
+    }
+
+    // what the gateway does with every client frame: validate, peek the type, and for admitted types the full parse
+    void bench_client_frames(char const *name) {
+        auto frame = json_login_message{{false, 0, 0, 0}, "bench_user", string(400, 'p'), ""}.serialize();
+        cout << "  " << frame.size() << " byte login frame" << endl;
+
+        bool valid = true;
+        measure((string(name) + "/utf8").c_str(), 200000, [&](size_t) {
+            valid = valid && is_valid_utf8(frame.data(), frame.size());
+        });
+
+        uint32_t type = 0;
+        measure((string(name) + "/peek").c_str(), 200000, [&](size_t) {
+            type += peek_message_type(frame.data(), frame.size()).value_or(0);
+        });
+
+        string str;
+        size_t parsed = 0;
+        measure((string(name) + "/parse").c_str(), 50000, [&](size_t) {
+            str.assign(frame);
+            parsed += get<1>(message<true>::deserialize<false>(str)) ? 1 : 0;
+        });
+
+        if(!valid || type == 0 || parsed == 0) {
+            cout << "  unexpected result, valid " << valid << " type " << type << " parsed " << parsed << endl;
+        }
+    }
+
+    // 5000 players spread over one map, the position update path: move, then find who hears about it
+    void bench_area_of_interest(char const *name) {
+        constexpr size_t players = 5000;
+        constexpr float map_size = 2048;
+        // large enough for the whole map query below, updates themselves use the 64 unit default radius
+        area_of_interest aoi(32, 2 * map_size);
+        auto map = location_names().intern(string("bench"));
+        mt19937 random(1);
+        uniform_real_distribution<float> coordinate(0, map_size);
+
+        vector<unique_ptr<user_connection>> connections;
+        for(uint64_t id = 1; id <= players; id++) {
+            connections.push_back(make_unique<user_connection>(nullptr, id));
+            aoi.place(*connections.back(), map, coordinate(random), coordinate(random));
+        }
+
+        size_t recipients = 0;
+        size_t updates = 0;
+        measure((string(name) + "/move_and_query").c_str(), 200000, [&](size_t i) {
+            updates++;
+            auto &connection = *connections[i % players];
+            float x = coordinate(random), y = coordinate(random);
+            aoi.move(connection, x, y);
+            recipients += aoi.visit_near(map.id(), x, y, 64, [](aoi_member const &) {});
+        });
+        cout << "  " << players << " players, " << static_cast<double>(recipients) / updates << " recipients per update" << endl;
+        recipients = 0;
+        updates = 0;
+
+        // the same update sent to everyone on the map, what the map channel costs without an area of interest
+        measure((string(name) + "/whole_map").c_str(), 2000, [&](size_t) {
+            updates++;
+            recipients += aoi.visit_near(map.id(), map_size / 2, map_size / 2, map_size, [](aoi_member const &) {});
+        });
+        cout << "  " << static_cast<double>(recipients) / updates << " recipients per update" << endl;
+    }
+
+    // map snapshots for one connection where a few tiles change between sends, the client acknowledging every frame
+    void bench_snapshot_deltas(char const *name) {
+        constexpr uint32_t stream = 1;
+        constexpr size_t tiles = 4096;
+        constexpr size_t changed_tiles = 16;
+        snapshot_deltas deltas(8, {stream});
+        deltas.add(1);
+        deltas.acknowledge(1, stream, 0);
+
+        mt19937 random(1);
+        vector<uint32_t> textures(tiles);
+        for(size_t i = 0; i < tiles; i++) {
+            textures[i] = (i * 7) % 13;
+        }
+
+        size_t snapshot_bytes = 0;
+        size_t sent_bytes = 0;
+        size_t sends = 0;
+        uint64_t sequence = 0;
+        measure((string(name) + "/encode_and_acknowledge").c_str(), 2000, [&](size_t) {
+            for(size_t i = 0; i < changed_tiles; i++) {
+                textures[random() % tiles] = random() % 13;
+            }
+
+            string snapshot = "{\"type\":3,\"map_name\":\"bench\",\"tiles\":[";
+            for(size_t i = 0; i < tiles; i++) {
+                if(i > 0) {
+                    snapshot += ',';
+                }
+                snapshot += "{\"x\":" + to_string(i % 64) + ",\"y\":" + to_string(i / 64) + ",\"texture\":" + to_string(textures[i]) + "}";
+            }
+            snapshot += "]}";
+
+            auto frame = deltas.encode(1, stream, snapshot);
+            sends++;
+            snapshot_bytes += snapshot.size();
+            sent_bytes += frame->size();
+            deltas.acknowledge(1, stream, ++sequence);
+        });
+        cout << "  " << changed_tiles << " of " << tiles << " tiles changed per send, " << sent_bytes / sends << " bytes sent per frame instead of "
+             << snapshot_bytes / sends << endl;
+    }
+
+    // chat lines and maps for the same connections, flushed every millisecond like OUTBOUND_FLUSH_INTERVAL_MS=1,
+    // shows how long chat is held while maps are paced out behind it
+    void bench_outbound_classes(char const *name) {
+        constexpr size_t connection_count = 1000;
+        constexpr size_t ticks = 2000;
+        uWS::Hub h;
+        auto &coalescer = outbound_frames();
+        coalescer.start(h.getLoop(), 1, outbound_limits{{1024 * 1024, 256 * 1024, 16 * 1024 * 1024}, 64 * 1024});
+
+        vector<unique_ptr<user_connection>> connections;
+        for(uint64_t id = 1; id <= connection_count; id++) {
+            connections.push_back(make_unique<user_connection>(nullptr, id));
+            coalescer.add(*connections.back());
+        }
+
+        // a map and the three surrounding maps take four flushes at 64 KiB per flush
+        string map(64 * 1024, 'm');
+        string chat(128, 'c');
+        mt19937 random(1);
+        int64_t flush_ns = 0;
+        for(size_t tick = 0; tick < ticks; tick++) {
+            for(size_t i = 0; i < connection_count / 100; i++) {
+                auto &connection = *connections[random() % connection_count];
+                for(int neighbour = 0; neighbour < 4; neighbour++) {
+                    coalescer.send(connection, map, BULK);
+                }
+            }
+            for(size_t i = 0; i < connection_count / 2; i++) {
+                coalescer.send(*connections[random() % connection_count], chat, CHAT);
+            }
+
+            this_thread::sleep_for(chrono::milliseconds(1));
+            auto flush_start = chrono::steady_clock::now();
+            coalescer.flush();
+            flush_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - flush_start).count();
+        }
+
+        cout << name << ": " << ticks << " flushes of " << connection_count << " connections, " << flush_ns / static_cast<int64_t>(ticks) << " ns/flush mean" << endl;
+        cout << "  chat held p50 < " << coalescer.held_us(CHAT, 0.5) << " us, p99 < " << coalescer.held_us(CHAT, 0.99) << " us, "
+             << coalescer.dropped(CHAT) << " dropped" << endl;
+        cout << "  bulk held p50 < " << coalescer.held_us(BULK, 0.5) << " us, p99 < " << coalescer.held_us(BULK, 0.99) << " us, "
+             << coalescer.dropped(BULK) << " dropped" << endl;
+
+        for(auto const &connection : connections) {
+            coalescer.remove(connection->connection_id);
+        }
+        coalescer.stop();
+    }
+
+    // counts the writes the coalescer hands to the sockets instead of making them
+    class counting_socket : public outbound_socket {
+    public:
+        void send(uWS::WebSocket<uWS::SERVER> *, char const *, size_t, uWS::OpCode, bool) override {
+            writes++;
+            messages++;
+        }
+
+        void send_batch(uWS::WebSocket<uWS::SERVER> *, vector<string> &payloads, uWS::OpCode, bool) override {
+            writes++;
+            messages += payloads.size();
+        }
+
+        void close(uWS::WebSocket<uWS::SERVER> *) override {
+        }
+
+        void terminate(uWS::WebSocket<uWS::SERVER> *) override {
+        }
+
+        size_t writes = 0;
+        size_t messages = 0;
+    };
+
+    // send and sendPrepared calls per delivered message for bursts of responses and chat, with every frame written
+    // as it's sent and with the frames of a connection gathered between flushes
+    void bench_outbound_writes(char const *name) {
+        constexpr size_t connection_count = 1000;
+        constexpr size_t ticks = 200;
+        string response(256, 'r');
+        string chat(128, 'c');
+
+        for(uint32_t flush_interval_ms : {0, 1}) {
+            uWS::Hub h;
+            auto socket = make_shared<counting_socket>();
+            outbound_coalescer coalescer(socket);
+            coalescer.start(h.getLoop(), flush_interval_ms, outbound_limits{{1024 * 1024, 256 * 1024, 16 * 1024 * 1024}, 64 * 1024});
+
+            // the counting socket never dereferences them, they only have to be non-null to be written to
+            vector<uint64_t> sockets(connection_count);
+            vector<unique_ptr<user_connection>> connections;
+            for(uint64_t id = 1; id <= connection_count; id++) {
+                connections.push_back(make_unique<user_connection>(reinterpret_cast<uWS::WebSocket<uWS::SERVER> *>(&sockets[id - 1]), id));
+                coalescer.add(*connections.back());
+            }
+
+            // a tenth of the connections ask for something and get a few responses, a busy channel reaches half of them
+            mt19937 random(1);
+            for(size_t tick = 0; tick < ticks; tick++) {
+                for(size_t i = 0; i < connection_count / 10; i++) {
+                    auto &connection = *connections[random() % connection_count];
+                    for(int j = 0; j < 3; j++) {
+                        coalescer.send(connection, response, CONTROL);
+                    }
+                }
+                for(int line = 0; line < 4; line++) {
+                    for(size_t i = 0; i < connection_count / 2; i++) {
+                        coalescer.send(*connections[random() % connection_count], chat, CHAT);
+                    }
+                }
+                coalescer.flush();
+            }
+
+            cout << name << "/" << (flush_interval_ms == 0 ? "uncoalesced" : "coalesced") << ": " << socket->messages << " messages in " << socket->writes
+                 << " writes, " << static_cast<double>(socket->writes) / static_cast<double>(max<size_t>(socket->messages, 1)) << " writes/message" << endl;
+
+            for(auto const &connection : connections) {
+                coalescer.remove(connection->connection_id);
+            }
+        }
+    }
+
+    // one connection's link at a fixed bandwidth on a simulated clock, writes queue behind each other in the order they're handed over
+    class link_socket : public outbound_socket {
+    public:
+        explicit link_socket(uint64_t bytes_per_ms) : _bytes_per_ms(bytes_per_ms) {
+        }
+
+        void send(uWS::WebSocket<uWS::SERVER> *, char const *data, size_t length, uWS::OpCode, bool) override {
+            transmit(string_view(data, length));
+        }
+
+        void send_batch(uWS::WebSocket<uWS::SERVER> *, vector<string> &payloads, uWS::OpCode, bool) override {
+            for(auto const &payload : payloads) {
+                transmit(payload);
+            }
+        }
+
+        void close(uWS::WebSocket<uWS::SERVER> *) override {
+        }
+
+        void terminate(uWS::WebSocket<uWS::SERVER> *) override {
+        }
+
+        uint64_t now_us = 0;
+        uint64_t bulk_done_us = 0;
+        // chat lines carry the time they were sent after the 'c'
+        vector<uint64_t> chat_latencies_us;
+
+    private:
+        void transmit(string_view payload) {
+            _busy_until_us = max(_busy_until_us, now_us) + payload.length() * 1000 / _bytes_per_ms;
+            if(payload[0] == 'c') {
+                chat_latencies_us.push_back(_busy_until_us - stoull(string(payload.substr(1, payload.find(' ') - 1))));
+            } else {
+                bulk_done_us = _busy_until_us;
+            }
+        }
+
+        uint64_t _bytes_per_ms;
+        uint64_t _busy_until_us = 0;
+    };
+
+    // a chat line every millisecond while 4 MiB of map data goes out on a 100 MB/s link, written as it's sent or coalesced
+    // every millisecond, as one frame or as frames small enough for the bulk pacing to interleave chat with them
+    void bench_chat_behind_bulk(char const *name) {
+        constexpr size_t ticks = 200;
+        constexpr size_t bulk_bytes = 4 * 1024 * 1024;
+        struct variant {
+            char const *name;
+            uint32_t flush_interval_ms;
+            size_t frame_bytes;
+        };
+
+        for(auto const &run : {variant{"uncoalesced", 0, bulk_bytes}, variant{"coalesced", 1, bulk_bytes}, variant{"coalesced_64k_frames", 1, 64 * 1024}}) {
+            uWS::Hub h;
+            auto socket = make_shared<link_socket>(100 * 1000);
+            outbound_coalescer coalescer(socket);
+            coalescer.start(h.getLoop(), run.flush_interval_ms, outbound_limits{{1024 * 1024, 256 * 1024, 16 * 1024 * 1024}, 64 * 1024});
+            uint64_t storage = 0;
+            user_connection connection(reinterpret_cast<uWS::WebSocket<uWS::SERVER> *>(&storage), 1);
+            coalescer.add(connection);
+
+            for(size_t tick = 0; tick < ticks; tick++) {
+                socket->now_us = tick * 1000;
+                if(tick == 0) {
+                    for(size_t sent = 0; sent < bulk_bytes; sent += run.frame_bytes) {
+                        coalescer.send(connection, string(run.frame_bytes, 'm'), BULK);
+                    }
+                }
+                auto chat = "c" + to_string(socket->now_us) + " ";
+                chat.resize(128, 'c');
+                coalescer.send(connection, move(chat), CHAT);
+
+                socket->now_us += 1000;
+                coalescer.flush();
+            }
+
+            auto &latencies = socket->chat_latencies_us;
+            sort(begin(latencies), end(latencies));
+            cout << name << "/" << run.name << ": chat latency p50 " << latencies[latencies.size() / 2] << " us, p99 " << latencies[latencies.size() * 99 / 100]
+                 << " us, max " << latencies.back() << " us, map data done after " << socket->bulk_done_us << " us" << endl;
+            coalescer.remove(connection.connection_id);
+        }
+    }
+
+    // time the thread handing kafka messages to handlers spends per map, encoding inline or handing it to workers
+    void bench_serialization_workers(char const *name) {
+        // enough different maps that no worker finds its next one in the single entry cache
+        vector<string> payloads;
+        for(uint32_t seed = 0; seed < 13; seed++) {
+            payloads.push_back(map_payload(4096, seed));
+        }
+        payload_compressor compressor(6, 1024, "", 1);
+
+        for(size_t workers : {0, 2}) {
+            worker_pool pool(workers, "");
+            atomic<size_t> encoded{0};
+            size_t submitted = 0;
+            auto start = chrono::steady_clock::now();
+            string case_name = string(name) + "/" + to_string(workers) + "_workers";
+            measure(case_name.c_str(), 500, [&](size_t i) {
+                submitted++;
+                pool.submit([&, i] {
+                    compressor.encode(PERMESSAGE_DEFLATE, payloads[i % payloads.size()]);
+                    encoded.fetch_add(1, memory_order_release);
+                });
+            });
+
+            while(encoded.load(memory_order_acquire) < submitted) {
+                this_thread::yield();
+            }
+            auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            cout << "  " << submitted << " maps encoded in " << elapsed << " us" << endl;
+        }
+    }
+
+    // a client chat frame up to the kafka record, split in the steps of the handler, with allocations per frame for each
+    void bench_chat_frame(char const *name) {
+        auto frame = json_chat_send_message{{false, 0, 0, 0}, "bench_user", "#world", string(120, 'm')}.serialize();
+        string const username = "bench_user";
+        message_sender const sender{false, 1, 1, 0};
+
+        string str;
+        size_t before = allocations;
+        size_t deserialized = 0;
+        measure((string(name) + "/deserialize").c_str(), 100000, [&](size_t) {
+            str.assign(frame);
+            deserialized += get<1>(message<true>::deserialize<false>(str)) ? 1 : 0;
+        });
+        auto deserialize_allocations = (allocations - before) / (100000 + 100000 / 10 + 1);
+
+        // the fields the inbound message hands over, refilled every time since moving empties them
+        string target;
+        string text;
+        auto rewrap = [&](char const *step, bool moved) {
+            size_t step_allocations = 0;
+            measure((string(name) + "/" + step).c_str(), 100000, [&](size_t) {
+                target.assign("#world");
+                text.assign(120, 'm');
+                auto start = allocations;
+                binary_chat_send_message outbound = moved ? binary_chat_send_message{sender, username, move(target), move(text)}
+                                                          : binary_chat_send_message{sender, username, target, text};
+                step_allocations += allocations - start;
+            });
+            return step_allocations / (100000 + 100000 / 10 + 1);
+        };
+        auto copied_allocations = rewrap("rewrap_copied", false);
+        auto moved_allocations = rewrap("rewrap_moved", true);
+
+        binary_chat_send_message outbound{sender, username, "#world", string(120, 'm')};
+        size_t serialized = 0;
+        before = allocations;
+        measure((string(name) + "/serialize").c_str(), 100000, [&](size_t) {
+            serialized += outbound.serialize().size();
+        });
+        auto serialize_allocations = (allocations - before) / (100000 + 100000 / 10 + 1);
+
+        cout << "  allocations per frame: deserialize " << deserialize_allocations << ", rewrap " << copied_allocations << " copied vs "
+             << moved_allocations << " moved, serialize " << serialize_allocations << endl;
+        if(deserialized == 0 || serialized == 0) {
+            cout << "  unexpected result, deserialized " << deserialized << " serialized " << serialized << endl;
+        }
+    }
+
+    // heap in use according to glibc, includes whatever libcuckoo and the registries keep per connection
+    size_t heap_in_use() {
+        return mallinfo2().uordblks;
+    }
+
+    // what the gateway keeps per connection, first idle like on connect, then logged in with three characters
+    void bench_connection_memory(char const *name) {
+        for(size_t count : {size_t{10000}, size_t{100000}, size_t{500000}}) {
+            connection_registry connections(16);
+            chat_channel_registry channels;
+            snapshot_deltas deltas(8, {1});
+
+            auto before = heap_in_use();
+            for(uint64_t id = 1; id <= count; id++) {
+                auto connection = make_shared<user_connection>(nullptr, id);
+                outbound_frames().add(*connection);
+                deltas.add(id);
+                connections.insert(move(connection));
+            }
+            auto idle = heap_in_use();
+
+            auto world_name = location_names().intern(string("bench_world"));
+            for(uint64_t id = 1; id <= count; id++) {
+                connections.find_fn(id, [&](user_connection &connection) {
+                    connection.update_session([&](session_state &session) {
+                        session.state = LOGGED_IN;
+                        session.username = "bench_user_" + to_string(id);
+                        session.user_id = id;
+                        session.player_characters.reserve(3);
+                        for(uint64_t character = 0; character < 3; character++) {
+                            session.player_characters.push_back({id * 3 + character, 1, "character_" + to_string(character),
+                                                                 location_names().intern("map_" + to_string(id % 16)), world_name});
+                        }
+                    });
+                    channels.subscribe_logged_in(connection, *connection.session());
+                });
+            }
+            auto logged_in = heap_in_use();
+
+            cout << name << ": " << count << " connections, " << (idle - before) / count << " bytes idle, "
+                 << (logged_in - before) / count << " bytes logged in per connection" << endl;
+
+            for(uint64_t id = 1; id <= count; id++) {
+                connections.find_fn(id, [&](user_connection &connection) {
+                    channels.unsubscribe_all(connection);
+                });
+                deltas.remove(id);
+                outbound_frames().remove(id);
+                connections.erase(id);
+            }
+        }
+    }
+
+    // the uws thread connecting and disconnecting while another thread looks connections up and broadcasts to a channel,
+    // the connections coming and going join a channel of their own so the broadcast reaches the same 1000 either way
+    void bench_connection_churn(char const *name) {
+        constexpr uint64_t stable_connections = 10000;
+        constexpr uint64_t churning_connections = 10000;
+        connection_registry connections(16);
+        chat_channel_registry channels;
+
+        // broadcasts are held for the coalescer, nothing is written to the missing sockets
+        uWS::Hub h;
+        bool coalescing = outbound_frames().enabled();
+        outbound_frames().start(h.getLoop(), 60000, outbound_limits{{1024 * 1024, 256 * 1024, 1024 * 1024}, 64 * 1024});
+
+        for(uint64_t id = 1; id <= stable_connections; id++) {
+            auto connection = make_shared<user_connection>(nullptr, id);
+            outbound_frames().add(*connection);
+            if(id % 10 == 0) {
+                channels.subscribe("world:bench", *connection);
+            }
+            connections.insert(move(connection));
+        }
+
+        auto run = [&](char const *suffix) {
+            mt19937 random(1);
+            size_t found = 0;
+            measure((string(name) + "/lookup" + suffix).c_str(), 200000, [&](size_t) {
+                found += connections.find_fn(random() % stable_connections + 1, [](user_connection &) {}) ? 1 : 0;
+            });
+
+            // flushed every time like the loop does, with one frame per subscriber
+            string chat(128, 'c');
+            size_t sent = 0;
+            measure((string(name) + "/broadcast_and_flush" + suffix).c_str(), 2000, [&](size_t) {
+                sent += channels.broadcast("world:bench", chat);
+                outbound_frames().flush();
+            });
+
+            if(found == 0 || sent == 0) {
+                cout << "  unexpected result, found " << found << " sent " << sent << endl;
+            }
+        };
+
+        run("_idle");
+
+        atomic<bool> stop{false};
+        atomic<uint64_t> churned{0};
+        thread churn([&] {
+            uint64_t next = stable_connections + 1;
+            while(!stop.load(memory_order_relaxed)) {
+                auto connection = make_shared<user_connection>(nullptr, next);
+                outbound_frames().add(*connection);
+                channels.subscribe("map:churn", *connection);
+                connections.insert(move(connection));
+
+                if(next > stable_connections + churning_connections) {
+                    auto gone = connections.erase(next - churning_connections);
+                    if(gone) {
+                        channels.unsubscribe_all(*gone);
+                        outbound_frames().remove(gone->connection_id);
+                    }
+                }
+                next++;
+                churned.fetch_add(1, memory_order_relaxed);
+            }
+        });
+
+        auto churn_start = chrono::steady_clock::now();
+        run("_churn");
+        stop.store(true, memory_order_relaxed);
+        churn.join();
+        auto churn_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - churn_start).count();
+        cout << "  " << churned.load() * 1000000 / static_cast<uint64_t>(max<int64_t>(churn_us, 1)) << " connects and disconnects per second meanwhile" << endl;
+
+        if(!coalescing) {
+            outbound_frames().stop();
+        }
+    }
+
+    // the backend records the gateway reads most, as a cereal message and as a view, up to the frame for the client
+    void bench_message_views(char const *name) {
+        message_sender const sender{true, 42, 1, 0};
+        auto chat_record = binary_chat_send_message{sender, "bench_user", "#world", string(120, 'm')}.serialize();
+        auto chat_view_record = chat_send_view::write(sender, "bench_user", "#world", string(120, 'm'));
+
+        vector<message_player> players;
+        for(uint64_t i = 0; i < 8; i++) {
+            players.push_back({i + 1000, "player " + to_string(i), "map " + to_string(i % 3)});
+        }
+        auto characters_record = binary_get_characters_response_message{sender, players, "bench_world"}.serialize();
+        auto characters_view_record = get_characters_response_view::write(sender, players, "bench_world");
+        cout << "  chat " << chat_record.size() << " vs " << chat_view_record.size() << " bytes, get_characters " << characters_record.size()
+             << " vs " << characters_view_record.size() << " bytes" << endl;
+
+        // the consumer hands out the payload, deserializing needs it as a string
+        string str;
+        string frame;
+        size_t written = 0;
+        measure((string(name) + "/chat_message").c_str(), 200000, [&](size_t) {
+            str.assign(chat_record);
+            auto msg = get<1>(message<false>::deserialize<false>(str));
+            if(auto chat = dynamic_cast<binary_chat_send_message const *>(msg.get())) {
+                frame.clear();
+                write_chat_receive(frame, chat->from_username, chat->target, chat->message);
+                written++;
+            }
+        });
+
+        size_t view_written = 0;
+        measure((string(name) + "/chat_view").c_str(), 200000, [&](size_t) {
+            auto view = kafka_message_view::parse(chat_view_record.data(), chat_view_record.size());
+            if(auto chat = view ? chat_send_view::from(*view) : STD_OPTIONAL<chat_send_view>{}) {
+                frame.clear();
+                write_chat_receive(frame, chat->from_username, chat->target, chat->message);
+                view_written++;
+            }
+        });
+
+        measure((string(name) + "/get_characters_message").c_str(), 100000, [&](size_t) {
+            str.assign(characters_record);
+            auto msg = get<1>(message<false>::deserialize<false>(str));
+            if(auto response = dynamic_cast<binary_get_characters_response_message const *>(msg.get())) {
+                frame.clear();
+                write_get_characters_response(frame, response->players.size(), [&](size_t i) {
+                    return character_fields{response->players[i].player_id, response->players[i].player_name, response->players[i].map_name};
+                }, response->world_name);
+                written++;
+            }
+        });
+
+        measure((string(name) + "/get_characters_view").c_str(), 100000, [&](size_t) {
+            auto view = kafka_message_view::parse(characters_view_record.data(), characters_view_record.size());
+            if(auto response = view ? get_characters_response_view::from(*view) : STD_OPTIONAL<get_characters_response_view>{}) {
+                frame.clear();
+                write_get_characters_response(frame, response->player_count, [&](size_t i) {
+                    auto index = static_cast<uint32_t>(i);
+                    return character_fields{response->player_id(index), response->player_name(index), response->map_name(index)};
+                }, response->world_name);
+                view_written++;
+            }
+        });
+
+        if(written == 0 || view_written == 0) {
+            cout << "  unexpected result, written " << written << " from messages, " << view_written << " from views" << endl;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    el::Configurations defaultConf;
+    defaultConf.setGlobally(el::ConfigurationType::Enabled, "false");
+    defaultConf.set(el::Level::Error, el::ConfigurationType::Enabled, "true");
+    el::Loggers::reconfigureAllLoggers(defaultConf);
+
+    vector<bench_case> cases{
+            {"compression", bench_compression},
+            {"client_frames", bench_client_frames},
+            {"chat_frame", bench_chat_frame},
+            {"area_of_interest", bench_area_of_interest},
+            {"snapshot_deltas", bench_snapshot_deltas},
+            {"outbound_classes", bench_outbound_classes},
+            {"outbound_writes", bench_outbound_writes},
+            {"chat_behind_bulk", bench_chat_behind_bulk},
+            {"serialization_workers", bench_serialization_workers},
+            {"message_views", bench_message_views},
+            {"connection_memory", bench_connection_memory},
+            {"connection_churn", bench_connection_churn},
+    };
+
+    for(auto &bench : cases) {
+        bool selected = argc < 2;
+        for(int i = 1; i < argc; i++) {
+            selected = selected || string(bench.name).compare(0, strlen(argv[i]), argv[i]) == 0;
+        }
+
+        if(selected) {
+            bench.run(bench.name);
+        }
+    }
+
+    return 0;
+}
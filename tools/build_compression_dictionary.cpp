@@ -0,0 +1,67 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Writes the preset dictionary the gateway loads from COMPRESSION_DICTIONARY_FILE, built from typical payloads.
+// Samples are json messages as clients receive them, one per line, e.g. map and character list responses saved from a
+// client's websocket log. Clients opting into roa-deflate-dictionary need the same file to inflate.
+// usage: build_compression_dictionary <dictionary file> <sample file>...
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <src/compression_dictionary.h>
+
+using namespace std;
+using namespace roa;
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        cerr << "usage: " << argv[0] << " <dictionary file> <sample file>..." << endl;
+        return 1;
+    }
+
+    vector<string> samples;
+    size_t sample_bytes = 0;
+    for(int i = 2; i < argc; i++) {
+        ifstream sample_file(argv[i]);
+        if(!sample_file) {
+            cerr << "could not open " << argv[i] << endl;
+            return 1;
+        }
+
+        string line;
+        while(getline(sample_file, line)) {
+            if(!line.empty()) {
+                sample_bytes += line.size();
+                samples.push_back(move(line));
+            }
+        }
+    }
+
+    auto dictionary = build_compression_dictionary(samples);
+    ofstream dictionary_file(argv[1], ios::binary | ios::trunc);
+    dictionary_file.write(dictionary.data(), static_cast<streamsize>(dictionary.size()));
+    if(!dictionary_file) {
+        cerr << "could not write " << argv[1] << endl;
+        return 1;
+    }
+
+    cout << dictionary.size() << " byte dictionary from " << samples.size() << " samples of " << sample_bytes << " bytes" << endl;
+    return 0;
+}
@@ -0,0 +1,290 @@
+/*
+    Realm of Aesir backend
+    Copyright (C) 2016  Michael de Lang
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Replays a capture written with TRAFFIC_CAPTURE_FILE through the gateway handlers without sockets or a broker.
+// Every captured connection gets a socketless stand-in with its captured id, frames the handlers send to it are
+// queued in the outbound coalescer like on the gateway and dropped when it disconnects.
+// usage: replay_traffic <capture file> [speed, 1 = real time, 0 = as fast as possible]
+
+#include <easylogging++.h>
+#include <json.hpp>
+#include <kafka_producer.h>
+#include <exceptions.h>
+#include <roa_di.h>
+#include <macros.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <unordered_set>
+#include <src/message_handlers/handler_registration.h>
+#include <src/message_handlers/gateway/gateway_send_map_handler.h>
+#include <src/message_handlers/client/client_resume_session_handler.h>
+#include <src/message_handlers/client/client_position_handler.h>
+#include <src/message_handlers/gateway/gateway_chat_send_handler.h>
+#include <src/gateway_messages/gateway_message.h>
+#include <src/gateway_messages/snapshot_messages.h>
+#include <src/traffic_replayer.h>
+#include <src/multicast_envelope.h>
+#include <src/kafka_message_view.h>
+#include <src/json_scanner.h>
+#include <src/connection_registry.h>
+#include <src/outbound_coalescer.h>
+#include <src/config.h>
+
+using namespace std;
+using namespace roa;
+
+using json = nlohmann::json;
+
+INITIALIZE_EASYLOGGINGPP
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        cerr << "usage: " << argv[0] << " <capture file> [speed]" << endl;
+        return 1;
+    }
+
+    el::Configurations defaultConf;
+    defaultConf.setGlobally(el::ConfigurationType::Enabled, "false");
+    defaultConf.set(el::Level::Error, el::ConfigurationType::Enabled, "true");
+    el::Loggers::reconfigureAllLoggers(defaultConf);
+
+    double speed = argc > 2 ? stod(argv[2]) : 1.0;
+
+    Config config{};
+    config.server_id = 1;
+    config.aoi_radius = 64.0f;
+    config.position_updates_per_second = 10;
+    atomic<bool> quit{false};
+
+    // never started, whatever the handlers produce stays queued in the producer
+    auto common_injector = create_common_di_injector();
+    auto producer = make_shared<partitioned_producer>(common_injector.create<shared_ptr<ikafka_producer<false>>>(), false);
+    auto tokens = make_shared<resume_token_manager>("", chrono::seconds(300));
+    auto compressor = make_shared<payload_compressor>(0, 0, "", 0);
+    auto channels = make_shared<chat_channel_registry>();
+    auto local_deliveries = make_shared<local_chat_deliveries>(chrono::seconds(30));
+    auto aoi = make_shared<area_of_interest>(32.0f, 64.0f);
+    auto deltas = make_shared<snapshot_deltas>(8, vector<uint32_t>{gateway_send_map_handler::message_id});
+    auto workers = make_shared<worker_pool>(0, "");
+    connection_registry connections(16);
+    unordered_set<uint64_t> live;
+
+    message_dispatcher<false> client_msg_dispatcher;
+    register_client_handlers(client_msg_dispatcher, config, producer, channels, local_deliveries, aoi);
+    client_resume_session_handler resume_handler(config, tokens, channels);
+    client_position_handler position_handler(config, producer, aoi);
+
+    message_dispatcher<false> server_gateway_msg_dispatcher;
+    register_gateway_handlers(server_gateway_msg_dispatcher, config, &quit, tokens, compressor, channels, local_deliveries, deltas, workers);
+
+    // the loop never runs, so frames are held until the connection is removed instead of written to a socket
+    uWS::Hub h;
+    outbound_frames().start(h.getLoop(), 1000, outbound_limits{{1024 * 1024, 256 * 1024, 16 * 1024 * 1024}, 64 * 1024});
+
+    uint64_t counts[5] = {};
+    uint64_t failures = 0;
+    uint64_t unknown_connections = 0;
+    uint64_t multicast_recipients = 0;
+    uint64_t views = 0;
+    uint64_t bytes = 0;
+    string str;
+    vector<pair<char const *, size_t>> batch;
+
+    // like on the consumer, messages for connections that aren't connected are dropped, except chat
+    auto dispatch_to_connection = [&](uint32_t type, uint64_t id, auto &&trigger) {
+        auto connection = connections.find(id);
+        if(!connection) {
+            if(type == gateway_chat_send_handler::message_id) {
+                trigger(STD_OPTIONAL<reference_wrapper<user_connection>>{});
+            } else {
+                unknown_connections++;
+            }
+            return;
+        }
+
+        trigger(make_optional(ref(*connection)));
+    };
+
+    auto handle_client_message = [&](char const *data, size_t length, user_connection &connection) {
+        auto type = peek_message_type(data, length);
+        if(!type) {
+            throw runtime_error("message without type");
+        }
+
+        if(is_gateway_message(type.value())) {
+            str.assign(data, length);
+            if(type.value() == client_resume_session_handler::message_id) {
+                auto resume_msg = resume_session_message::deserialize(json::parse(str));
+                if(resume_msg) {
+                    resume_handler.handle_message(resume_msg.value(), connection);
+                }
+            } else if(type.value() == snapshot_ack_message::id) {
+                auto ack_msg = snapshot_ack_message::deserialize(json::parse(str));
+                if(ack_msg) {
+                    deltas->acknowledge(connection.connection_id, ack_msg->stream, ack_msg->sequence);
+                }
+            } else if(type.value() == client_position_handler::message_id) {
+                auto position_msg = position_message::deserialize(json::parse(str));
+                if(position_msg) {
+                    position_handler.handle_message(position_msg.value(), connection);
+                }
+            }
+            return;
+        }
+
+        if(!client_msg_dispatcher.admits(type.value(), make_optional(ref(connection)))) {
+            return;
+        }
+
+        str.assign(data, length);
+        auto msg = message<true>::deserialize<false>(str);
+        if(get<1>(msg)) {
+            client_msg_dispatcher.trigger_handler(move(msg), make_optional(ref(connection)));
+        }
+    };
+
+    auto remove_connection = [&](uint64_t connection_id) {
+        auto connection = connections.erase(connection_id);
+        if(!connection) {
+            return;
+        }
+
+        channels->unsubscribe_all(*connection);
+        aoi->remove(connection_id);
+        deltas->remove(connection_id);
+        outbound_frames().remove(connection_id);
+        live.erase(connection_id);
+    };
+
+    try {
+        traffic_replayer replayer(argv[1]);
+        auto start = chrono::steady_clock::now();
+
+        auto replayed = replayer.replay(speed, [&](traffic_record const &record) {
+            counts[static_cast<uint8_t>(record.kind) % 5]++;
+            bytes += record.length;
+            epoch_guard guard(session_reclaimer());
+            try {
+                if(record.kind == traffic_record_kind::CONNECT) {
+                    auto connection = make_shared<user_connection>(nullptr, record.connection_id);
+                    outbound_frames().add(*connection);
+                    deltas->add(record.connection_id);
+                    connections.insert(move(connection));
+                    live.insert(record.connection_id);
+                } else if(record.kind == traffic_record_kind::DISCONNECT) {
+                    remove_connection(record.connection_id);
+                } else if(record.kind == traffic_record_kind::WS_FRAME) {
+                    auto connection = connections.find(record.connection_id);
+                    if(!connection) {
+                        unknown_connections++;
+                        return;
+                    }
+
+                    try {
+                        if(!is_valid_utf8(record.data, record.length)) {
+                            throw runtime_error("invalid utf-8");
+                        }
+
+                        auto split = split_message_batch(record.data, record.length, batch);
+                        if(split == message_batch::MALFORMED) {
+                            throw runtime_error("malformed batch");
+                        }
+
+                        if(split == message_batch::BATCH) {
+                            for(auto const &client_msg : batch) {
+                                handle_client_message(client_msg.first, client_msg.second, *connection);
+                            }
+                        } else {
+                            handle_client_message(record.data, record.length, *connection);
+                        }
+                    } catch(exception &e) {
+                        // the gateway disconnects clients sending malformed messages
+                        remove_connection(record.connection_id);
+                        throw;
+                    }
+                } else if(record.kind == traffic_record_kind::KAFKA_MESSAGE) {
+                    if(multicast_envelope::is_envelope(record.data, record.length)) {
+                        auto envelope = multicast_envelope::parse(record.data, record.length);
+                        if(!envelope) {
+                            failures++;
+                        } else if(envelope->destination() == config.server_id) {
+                            multicast_recipients += envelope->connection_count();
+                        }
+                        return;
+                    }
+
+                    // read in place like on the loop, replaying a capture of chat and get_characters views benchmarks that path
+                    if(kafka_message_view::is_view(record.data, record.length)) {
+                        auto view = kafka_message_view::parse(record.data, record.length);
+                        if(!view) {
+                            failures++;
+                            return;
+                        }
+
+                        dispatch_to_connection(view->type(), view->sender().client_id, [&](STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+                            if(!server_gateway_msg_dispatcher.trigger_view(view->type(), *view, connection)) {
+                                failures++;
+                            } else {
+                                views++;
+                            }
+                        });
+                        return;
+                    }
+
+                    auto msg = message<false>::deserialize<false>(string(record.data, record.length));
+                    if(get<1>(msg)) {
+                        dispatch_to_connection(get<0>(msg), get<1>(msg)->sender.client_id, [&](STD_OPTIONAL<reference_wrapper<user_connection>> connection) {
+                            server_gateway_msg_dispatcher.trigger_handler(move(msg), connection);
+                        });
+                    }
+                }
+            } catch(exception &e) {
+                failures++;
+            }
+        });
+
+        // connections still open at the end of the capture hold frames that would otherwise be written out on stop
+        vector<uint64_t> remaining(begin(live), end(live));
+        for(auto connection_id : remaining) {
+            remove_connection(connection_id);
+        }
+        outbound_frames().stop();
+
+        auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        cout << "replayed " << replayed << " records in " << elapsed << " us" << endl;
+        cout << "  connects:       " << counts[static_cast<uint8_t>(traffic_record_kind::CONNECT)] << endl;
+        cout << "  disconnects:    " << counts[static_cast<uint8_t>(traffic_record_kind::DISCONNECT)] << endl;
+        cout << "  ws frames:      " << counts[static_cast<uint8_t>(traffic_record_kind::WS_FRAME)] << endl;
+        cout << "  kafka messages: " << counts[static_cast<uint8_t>(traffic_record_kind::KAFKA_MESSAGE)] << endl;
+        cout << "  no connection:  " << unknown_connections << endl;
+        cout << "  multicast ids:  " << multicast_recipients << endl;
+        cout << "  message views:  " << views << endl;
+        cout << "  failed:         " << failures << endl;
+        if(elapsed > 0) {
+            cout << "  records/s:      " << replayed * 1000000 / elapsed << endl;
+            cout << "  ns/record:      " << elapsed * 1000 / max<uint64_t>(replayed, 1) << endl;
+            cout << "  GB/s:           " << static_cast<double>(bytes) / 1000 / elapsed << endl;
+        }
+    } catch (const runtime_error& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}